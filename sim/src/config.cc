@@ -130,6 +130,8 @@ int crimson::qos_simulation::parse_config_file(const std::string &fname, sim_con
     g_conf.server_random_selection = stobool(val);
   if (!cf.read("global", "server_soft_limit", val))
     g_conf.server_soft_limit = stobool(val);
+  if (!cf.read("global", "server_shed_expired", val))
+    g_conf.server_shed_expired = stobool(val);
 
   for (uint i = 0; i < g_conf.server_groups; i++) {
     srv_group_t st;
@@ -140,6 +142,26 @@ int crimson::qos_simulation::parse_config_file(const std::string &fname, sim_con
       st.server_iops = std::stoul(val);
     if (!cf.read(section, "server_threads", val))
       st.server_threads = std::stoul(val);
+    if (!cf.read(section, "server_bandwidth", val))
+      st.server_bandwidth = std::stod(val);
+    if (!cf.read(section, "server_size_cost", val))
+      st.server_size_cost = stobool(val);
+    if (!cf.read(section, "server_seek_time", val))
+      st.server_seek_time = std::stoul(val);
+    if (!cf.read(section, "server_run_requests", val))
+      st.server_run_requests = std::stoul(val);
+    if (!cf.read(section, "server_queue_depth", val))
+      st.server_queue_depth = std::stoul(val);
+    if (!cf.read(section, "server_adaptive_depth", val))
+      st.server_adaptive_depth = stobool(val);
+    if (!cf.read(section, "server_numa_node", val))
+      st.server_numa_node = std::stoi(val);
+    if (!cf.read(section, "server_uring_path", val))
+      st.server_uring_path = val;
+    if (!cf.read(section, "server_uring_size", val))
+      st.server_uring_size = std::stoul(val);
+    if (!cf.read(section, "server_uring_write_percent", val))
+      st.server_uring_write_percent = std::stoul(val);
     g_conf.srv_group.push_back(st);
   }
 
@@ -162,8 +184,22 @@ int crimson::qos_simulation::parse_config_file(const std::string &fname, sim_con
       ct.client_reservation = std::stod(val);
     if (!cf.read(section, "client_limit", val))
       ct.client_limit = std::stod(val);
+    if (!cf.read(section, "client_burst", val))
+      ct.client_burst = std::stod(val);
+    if (!cf.read(section, "client_bw_reservation", val))
+      ct.client_bw_reservation = std::stod(val);
+    if (!cf.read(section, "client_bw_limit", val))
+      ct.client_bw_limit = std::stod(val);
     if (!cf.read(section, "client_weight", val))
       ct.client_weight = std::stod(val);
+    if (!cf.read(section, "client_req_timeout", val))
+      ct.client_req_timeout = std::stoul(val);
+    if (!cf.read(section, "client_req_size", val))
+      ct.client_req_size = std::stoul(val);
+    if (!cf.read(section, "client_pacing_depth", val))
+      ct.client_pacing_depth = std::stoul(val);
+    if (!cf.read(section, "client_limit_lookahead", val))
+      ct.client_limit_lookahead = std::stod(val);
     g_conf.cli_group.push_back(ct);
   }
 
@@ -28,6 +28,13 @@ namespace crimson {
       double client_reservation;
       double client_limit;
       double client_weight;
+      double client_burst;     // requests allowed above limit after a pause
+      double client_bw_reservation; // bytes/sec; 0 means none
+      double client_bw_limit;       // bytes/sec; 0 means none
+      uint client_req_timeout; // milliseconds; 0 means no deadline
+      uint client_req_size;    // bytes
+      uint client_pacing_depth; // see ServiceTracker; 0 means no pacing
+      double client_limit_lookahead; // secs; 0 means no limit pacing
 
       cli_group_t(uint _client_count = 100,
 		  uint _client_wait = 0,
@@ -37,7 +44,14 @@ namespace crimson {
 		  uint _client_outstanding_ops = 100,
 		  double _client_reservation = 20.0,
 		  double _client_limit = 60.0,
-		  double _client_weight = 1.0) :
+		  double _client_weight = 1.0,
+		  double _client_burst = 0.0,
+		  double _client_bw_reservation = 0.0,
+		  double _client_bw_limit = 0.0,
+		  uint _client_req_timeout = 0,
+		  uint _client_req_size = 4096,
+		  uint _client_pacing_depth = 0,
+		  double _client_limit_lookahead = 0.0) :
 	client_count(_client_count),
 	client_wait(std::chrono::seconds(_client_wait)),
 	client_total_ops(_client_total_ops),
@@ -46,7 +60,14 @@ namespace crimson {
 	client_outstanding_ops(_client_outstanding_ops),
 	client_reservation(_client_reservation),
 	client_limit(_client_limit),
-	client_weight(_client_weight)
+	client_weight(_client_weight),
+	client_burst(_client_burst),
+	client_bw_reservation(_client_bw_reservation),
+	client_bw_limit(_client_bw_limit),
+	client_req_timeout(_client_req_timeout),
+	client_req_size(_client_req_size),
+	client_pacing_depth(_client_pacing_depth),
+	client_limit_lookahead(_client_limit_lookahead)
       {
 	// empty
       }
@@ -63,7 +84,14 @@ namespace crimson {
 	  std::fixed << std::setprecision(1) <<
 	  "client_reservation = " << cli_group.client_reservation << "\n" <<
 	  "client_limit = " << cli_group.client_limit << "\n" <<
-	  "client_weight = " << cli_group.client_weight;
+	  "client_weight = " << cli_group.client_weight << "\n" <<
+	  "client_burst = " << cli_group.client_burst << "\n" <<
+	  "client_bw_reservation = " << cli_group.client_bw_reservation << "\n" <<
+	  "client_bw_limit = " << cli_group.client_bw_limit << "\n" <<
+	  "client_req_timeout = " << cli_group.client_req_timeout << "\n" <<
+	  "client_req_size = " << cli_group.client_req_size << "\n" <<
+	  "client_pacing_depth = " << cli_group.client_pacing_depth << "\n" <<
+	  "client_limit_lookahead = " << cli_group.client_limit_lookahead;
 	return out;
       }
     }; // class cli_group_t
@@ -73,13 +101,44 @@ namespace crimson {
       uint server_count;
       uint server_iops;
       uint server_threads;
+      double server_bandwidth; // bytes/sec; 0 means size is ignored
+      bool server_size_cost;   // charge requests by size in the queue
+      uint server_seek_time;   // microseconds to switch between clients
+      uint server_run_requests; // max same-client run; 1 disables runs
+      uint server_queue_depth; // requests waiting for a thread; 0 = threads
+      bool server_adaptive_depth; // AIMD-limit outstanding requests
+      int server_numa_node;    // node to place queues on; -1 = none
+      std::string server_uring_path; // file to do real I/O on; see
+                                     // uring_device.h; empty = sleep
+      uint server_uring_size;  // MiB of the file to use
+      uint server_uring_write_percent;
 
       srv_group_t(uint _server_count = 100,
 		  uint _server_iops = 40,
-		  uint _server_threads = 1) :
+		  uint _server_threads = 1,
+		  double _server_bandwidth = 0.0,
+		  bool _server_size_cost = false,
+		  uint _server_seek_time = 0,
+		  uint _server_run_requests = 1,
+		  uint _server_queue_depth = 0,
+		  bool _server_adaptive_depth = false,
+		  int _server_numa_node = -1,
+		  const std::string& _server_uring_path = "",
+		  uint _server_uring_size = 1024,
+		  uint _server_uring_write_percent = 0) :
 	server_count(_server_count),
 	server_iops(_server_iops),
-	server_threads(_server_threads)
+	server_threads(_server_threads),
+	server_bandwidth(_server_bandwidth),
+	server_size_cost(_server_size_cost),
+	server_seek_time(_server_seek_time),
+	server_run_requests(_server_run_requests),
+	server_queue_depth(_server_queue_depth),
+	server_adaptive_depth(_server_adaptive_depth),
+	server_numa_node(_server_numa_node),
+	server_uring_path(_server_uring_path),
+	server_uring_size(_server_uring_size),
+	server_uring_write_percent(_server_uring_write_percent)
       {
 	// empty
       }
@@ -89,7 +148,19 @@ namespace crimson {
 	out <<
 	  "server_count = " << srv_group.server_count << "\n" <<
 	  "server_iops = " << srv_group.server_iops << "\n" <<
-	  "server_threads = " << srv_group.server_threads;
+	  "server_threads = " << srv_group.server_threads << "\n" <<
+	  std::fixed << std::setprecision(1) <<
+	  "server_bandwidth = " << srv_group.server_bandwidth << "\n" <<
+	  "server_size_cost = " << srv_group.server_size_cost << "\n" <<
+	  "server_seek_time = " << srv_group.server_seek_time << "\n" <<
+	  "server_run_requests = " << srv_group.server_run_requests << "\n" <<
+	  "server_queue_depth = " << srv_group.server_queue_depth << "\n" <<
+	  "server_adaptive_depth = " << srv_group.server_adaptive_depth << "\n" <<
+	  "server_numa_node = " << srv_group.server_numa_node << "\n" <<
+	  "server_uring_path = " << srv_group.server_uring_path << "\n" <<
+	  "server_uring_size = " << srv_group.server_uring_size << "\n" <<
+	  "server_uring_write_percent = " <<
+	  srv_group.server_uring_write_percent;
 	return out;
       }
     }; // class srv_group_t
@@ -100,6 +171,7 @@ namespace crimson {
       uint client_groups;
       bool server_random_selection;
       bool server_soft_limit;
+      bool server_shed_expired;
 
       std::vector<cli_group_t> cli_group;
       std::vector<srv_group_t> srv_group;
@@ -107,11 +179,13 @@ namespace crimson {
       sim_config_t(uint _server_groups = 1,
 		   uint _client_groups = 1,
 		   bool _server_random_selection = false,
-		   bool _server_soft_limit = true) :
+		   bool _server_soft_limit = true,
+		   bool _server_shed_expired = false) :
 	server_groups(_server_groups),
 	client_groups(_client_groups),
 	server_random_selection(_server_random_selection),
-	server_soft_limit(_server_soft_limit)
+	server_soft_limit(_server_soft_limit),
+	server_shed_expired(_server_shed_expired)
       {
 	srv_group.reserve(server_groups);
 	cli_group.reserve(client_groups);
@@ -123,7 +197,8 @@ namespace crimson {
 	  "server_groups = " << sim_config.server_groups << "\n" <<
 	  "client_groups = " << sim_config.client_groups << "\n" <<
 	  "server_random_selection = " << sim_config.server_random_selection << "\n" <<
-	  "server_soft_limit = " << sim_config.server_soft_limit;
+	  "server_soft_limit = " << sim_config.server_soft_limit << "\n" <<
+	  "server_shed_expired = " << sim_config.server_shed_expired;
 	return out;
       }
     }; // class sim_config_t
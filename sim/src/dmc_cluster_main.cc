@@ -0,0 +1,660 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+/* dmc_cluster runs a dmc_sim configuration as separate processes on
+ * one host: one per server and one per client, talking over
+ * Unix-domain sockets in the frames of dmc_wire.h. Unlike dmc_sim,
+ * whose clients call into their servers, requests and responses
+ * (with their ReqParams and PhaseType) are serialized and cross
+ * process boundaries, so those costs show up in the results.
+ */
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <poll.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <map>
+#include <vector>
+#include <random>
+#include <iostream>
+#include <iomanip>
+
+#include "test_dmclock.h"
+#include "config.h"
+#include "dmc_wire.h"
+
+
+namespace dmc = crimson::dmclock;
+namespace test = crimson::test_dmc;
+namespace sim = crimson::qos_simulation;
+namespace wire = crimson::test_dmc::wire;
+
+
+namespace {
+
+  using Clock = std::chrono::steady_clock;
+
+  // what each child sends the parent when done; small enough that
+  // the pipe write is atomic
+  struct Result {
+    enum : uint32_t { client, server } kind;
+    uint32_t id;
+    uint64_t reservation_count;
+    uint64_t proportion_count;
+    uint64_t elapsed_ns;  // client: first to last response
+    uint64_t qos_ns;      // time in the dmclock code
+    uint64_t qos_count;
+    uint64_t send_ns;     // time to encode and send frames
+    uint64_t send_count;
+  };
+
+
+  // a socket; frames are written whole under the lock
+  struct Conn {
+    const int  fd;
+    std::mutex mtx;
+
+    Conn(int _fd) : fd(_fd) {}
+    ~Conn() { close(fd); }
+
+    bool send(const char* buf, size_t len) {
+      std::lock_guard<std::mutex> g(mtx);
+      return wire::write_full(fd, buf, len);
+    }
+  };
+  using ConnRef = std::shared_ptr<Conn>;
+
+
+  struct SendStats {
+    std::atomic<uint64_t> ns{0};
+    std::atomic<uint64_t> count{0};
+
+    void add(Clock::time_point start) {
+      ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+	Clock::now() - start).count();
+      ++count;
+    }
+  };
+
+
+  struct Cluster {
+    sim::sim_config_t conf;
+    std::string       dir;
+    uint              server_count = 0;
+    uint              client_count = 0;
+    uint32_t          max_req_size = 0;
+
+    uint client_group(ClientId c) const {
+      uint group_max = 0;
+      uint i = 0;
+      for (; i < conf.client_groups; ++i) {
+	group_max += conf.cli_group[i].client_count;
+	if (c < group_max) {
+	  break;
+	}
+      }
+      return i;
+    }
+
+    uint server_group(ServerId s) const {
+      uint group_max = 0;
+      uint i = 0;
+      for (; i < conf.server_groups; ++i) {
+	group_max += conf.srv_group[i].server_count;
+	if (s < group_max) {
+	  break;
+	}
+      }
+      return i;
+    }
+
+    std::string socket_path(ServerId s) const {
+      return dir + "/server." + std::to_string(s);
+    }
+  };
+
+
+  void die(const std::string& what) {
+    std::cerr << "dmc_cluster: " << what << ": " << strerror(errno) <<
+      std::endl;
+    _exit(1);
+  }
+
+
+  void send_result(int result_fd, const Result& result) {
+    if (write(result_fd, &result, sizeof(result)) != sizeof(result)) {
+      die("writing result");
+    }
+  }
+
+
+  sockaddr_un make_addr(const std::string& path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+      errno = ENAMETOOLONG;
+      die(path);
+    }
+    strcpy(addr.sun_path, path.c_str());
+    return addr;
+  }
+
+
+  void run_server(const Cluster& cl,
+		  ServerId id,
+		  int ready_fd,
+		  int control_fd,
+		  int result_fd) {
+    const sim::srv_group_t& sg = cl.conf.srv_group[cl.server_group(id)];
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = make_addr(cl.socket_path(id));
+    if (listen_fd < 0 ||
+	bind(listen_fd, (sockaddr*) &addr, sizeof(addr)) < 0 ||
+	listen(listen_fd, SOMAXCONN) < 0) {
+      die("listening on " + cl.socket_path(id));
+    }
+
+    std::mutex conns_mtx;
+    std::map<ClientId,ConnRef> conns;
+    SendStats send_stats;
+    test::DmcServer* server = nullptr;
+
+    auto client_info_f = [&cl](const ClientId& c) -> dmc::ClientInfo {
+      return test::client_info(cl.conf.cli_group[cl.client_group(c)]);
+    };
+
+    test::DmcServer::ClientRespFunc client_response_f =
+      [&](ClientId client_id,
+	  const sim::TestResponse& resp,
+	  const ServerId& server_id,
+	  const dmc::PhaseType& phase) {
+      // an expired request's response carries an empty load hint, as
+      // the server's queue may be locked while it sheds
+      dmc::LoadHint load;
+      if (!resp.expired &&
+	  cl.conf.cli_group[cl.client_group(client_id)].
+	  client_pacing_depth > 0) {
+	load = server->get_priority_queue().get_load_hint(client_id);
+      }
+      auto start = Clock::now();
+      ConnRef conn;
+      {
+	std::lock_guard<std::mutex> g(conns_mtx);
+	conn = conns[client_id];
+      }
+      char buf[wire::response_len];
+      wire::encode_response(buf, server_id, resp, phase, load);
+      if (conn) {
+	(void) conn->send(buf, sizeof(buf)); // client may have exited
+      }
+      send_stats.add(start);
+    };
+
+    auto create_queue_f =
+      [&](test::DmcQueue::CanHandleRequestFunc can_f,
+	  test::DmcQueue::HandleRequestFunc handle_f) -> test::DmcQueue* {
+      test::DmcQueue* queue =
+	new test::DmcQueue(client_info_f, can_f, handle_f,
+			   cl.conf.server_soft_limit);
+      queue->set_request_expired_func(
+	[&server](const ClientId& client,
+		  std::unique_ptr<sim::TestRequest> request) {
+	  server->request_expired(client, std::move(request));
+	});
+      test::configure_queue(*queue, sg);
+      return queue;
+    };
+
+    server = new test::DmcServer(id,
+				 sg.server_iops,
+				 sg.server_threads,
+				 client_response_f,
+				 test::dmc_server_accumulate_f,
+				 create_queue_f,
+				 sg.server_bandwidth,
+				 std::chrono::microseconds(sg.server_seek_time));
+    (void) test::configure_server(*server, sg, cl.max_req_size);
+
+    // one reader per client connection; a connection's first request
+    // tells us which client it is
+    auto read_requests = [&](ConnRef conn) {
+      char buf[wire::request_len];
+      bool first = true;
+      while (wire::read_full(conn->fd, buf, sizeof(buf))) {
+	ClientId client;
+	sim::TestRequest request(0, 0, 0);
+	dmc::ReqParams params;
+	wire::decode_request(buf, client, request, params);
+	if (first) {
+	  std::lock_guard<std::mutex> g(conns_mtx);
+	  conns[client] = conn;
+	  first = false;
+	}
+	if (cl.conf.server_shed_expired && request.deadline > 0.0) {
+	  server->post_w_deadline(request, client, params);
+	} else {
+	  server->post(request, client, params);
+	}
+      }
+    };
+
+    std::thread([&] {
+	int fd;
+	while ((fd = accept(listen_fd, nullptr, nullptr)) >= 0) {
+	  std::thread(read_requests, std::make_shared<Conn>(fd)).detach();
+	}
+      }).detach();
+
+    char c = 0;
+    if (write(ready_fd, &c, 1) != 1) {
+      die("signalling ready");
+    }
+
+    // run until the parent closes the control pipe
+    while (read(control_fd, &c, 1) > 0) {
+      // empty
+    }
+
+    const auto& stats = server->get_internal_stats();
+    Result result;
+    result.kind = Result::server;
+    result.id = id;
+    result.reservation_count = server->get_accumulator().reservation_count;
+    result.proportion_count = server->get_accumulator().proportion_count;
+    result.elapsed_ns = 0;
+    result.qos_ns =
+      (stats.add_request_time + stats.request_complete_time).count();
+    result.qos_count = stats.add_request_count;
+    result.send_ns = send_stats.ns;
+    result.send_count = send_stats.count;
+    send_result(result_fd, result);
+
+    // the server's threads are not stopped cleanly
+    _exit(0);
+  } // run_server
+
+
+  void run_client(const Cluster& cl, ClientId id, int result_fd) {
+    const sim::cli_group_t& cg = cl.conf.cli_group[cl.client_group(id)];
+
+    // as Simulation's make_server_select_alt_range and
+    // make_server_select_ran_range
+    std::default_random_engine prng(
+      std::chrono::system_clock::now().time_since_epoch().count() + id);
+    std::vector<ServerId> server_ids;
+    for (ServerId s = 0; s < cl.server_count; ++s) {
+      server_ids.push_back(s);
+    }
+    const uint16_t servers_per = cg.client_server_select_range;
+    const bool random = cl.conf.server_random_selection;
+    sim::ServerSelectFunc server_select_f =
+      [&](uint64_t seed) -> const ServerId& {
+      double factor = double(cl.server_count) / cl.client_count;
+      uint offset = (random ? prng() : seed) % servers_per;
+      uint index = (uint(0.5 + id * factor) + offset) % cl.server_count;
+      return server_ids[index];
+    };
+
+    // the client starts sending from its constructor, so its pointer
+    // is published once it exists
+    std::mutex client_mtx;
+    std::condition_variable client_cv;
+    test::DmcClient* client = nullptr;
+    auto get_client = [&]() -> test::DmcClient& {
+      std::unique_lock<std::mutex> l(client_mtx);
+      client_cv.wait(l, [&] { return nullptr != client; });
+      return *client;
+    };
+
+    auto read_responses = [&](ConnRef conn) {
+      char buf[wire::response_len];
+      test::DmcClient& c = get_client();
+      while (wire::read_full(conn->fd, buf, sizeof(buf))) {
+	ServerId server;
+	sim::TestResponse resp(0);
+	dmc::PhaseType phase;
+	dmc::LoadHint load;
+	wire::decode_response(buf, server, resp, phase, load);
+	if (cg.client_pacing_depth > 0) {
+	  c.get_service_tracker().track_load(server, load);
+	}
+	c.receive_response(resp, server, phase);
+      }
+    };
+
+    std::mutex conns_mtx;
+    std::map<ServerId,ConnRef> conns;
+    SendStats send_stats;
+
+    test::SubmitFunc submit_f =
+      [&](const ServerId& server,
+	  const sim::TestRequest& request,
+	  const ClientId& client_id,
+	  const dmc::ReqParams& req_params) {
+      ConnRef conn;
+      {
+	std::lock_guard<std::mutex> g(conns_mtx);
+	ConnRef& c = conns[server];
+	if (!c) {
+	  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	  sockaddr_un addr = make_addr(cl.socket_path(server));
+	  if (fd < 0 || connect(fd, (sockaddr*) &addr, sizeof(addr)) < 0) {
+	    die("connecting to " + cl.socket_path(server));
+	  }
+	  c = std::make_shared<Conn>(fd);
+	  std::thread(read_responses, c).detach();
+	}
+	conn = c;
+      }
+
+      auto start = Clock::now();
+      char buf[wire::request_len];
+      wire::encode_request(buf, client_id, request, req_params);
+      if (!conn->send(buf, sizeof(buf))) {
+	die("sending to " + cl.socket_path(server));
+      }
+      send_stats.add(start);
+    };
+
+    test::DmcClient* c =
+      new test::DmcClient(id,
+			  submit_f,
+			  server_select_f,
+			  test::dmc_client_accumulate_f,
+			  test::client_instructions(cg),
+			  test::client_send_after(cg));
+    test::configure_client(*c, cg);
+    {
+      std::lock_guard<std::mutex> g(client_mtx);
+      client = c;
+    }
+    client_cv.notify_all();
+
+    client->wait_until_done();
+
+    const auto& stats = client->get_internal_stats();
+    const auto& op_times = client->get_op_times();
+    Result result;
+    result.kind = Result::client;
+    result.id = id;
+    result.reservation_count = client->get_accumulator().reservation_count;
+    result.proportion_count = client->get_accumulator().proportion_count;
+    result.elapsed_ns = op_times.empty() ? 0 :
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+	op_times.back() - op_times.front()).count();
+    result.qos_ns =
+      (stats.get_req_params_time + stats.track_resp_time).count();
+    result.qos_count = stats.get_req_params_count;
+    result.send_ns = send_stats.ns;
+    result.send_count = send_stats.count;
+    send_result(result_fd, result);
+
+    // reader threads are still blocked on their sockets
+    _exit(0);
+  } // run_client
+
+
+  void print_per_op(const std::string& what, uint64_t ns, uint64_t count) {
+    std::cout << what << ": " <<
+      (count ? double(ns) / count : 0.0) << " nanoseconds per op (" <<
+      count << " ops)" << std::endl;
+  }
+
+} // namespace
+
+
+int main(int argc, char* argv[]) {
+  std::vector<const char*> args;
+  for (int i = 1; i < argc; ++i) {
+    args.push_back(argv[i]);
+  }
+
+  std::string conf_file_list;
+  sim::ceph_argparse_early_args(args, &conf_file_list);
+
+  Cluster cl;
+  if (conf_file_list.empty()) {
+    std::cerr << "usage: dmc_cluster -c <dmc_sim config>" << std::endl;
+    return 1;
+  }
+  if (sim::parse_config_file(conf_file_list, cl.conf)) {
+    return 1;
+  }
+
+  for (auto& cg : cl.conf.cli_group) {
+    cl.client_count += cg.client_count;
+    cl.max_req_size = std::max(cl.max_req_size, cg.client_req_size);
+  }
+  for (auto& sg : cl.conf.srv_group) {
+    cl.server_count += sg.server_count;
+  }
+
+  std::cout << "[global]" << std::endl << cl.conf << std::endl;
+  for (uint i = 0; i < cl.conf.client_groups; ++i) {
+    std::cout << std::endl << "[client." << i << "]" << std::endl;
+    std::cout << cl.conf.cli_group[i] << std::endl;
+  }
+  for (uint i = 0; i < cl.conf.server_groups; ++i) {
+    std::cout << std::endl << "[server." << i << "]" << std::endl;
+    std::cout << cl.conf.srv_group[i] << std::endl;
+  }
+  std::cout << std::endl;
+
+  char dir[] = "/tmp/dmc_cluster.XXXXXX";
+  if (!mkdtemp(dir)) {
+    die("creating socket directory");
+  }
+  cl.dir = dir;
+
+  int result_pipe[2];
+  int ready_pipe[2];
+  if (pipe(result_pipe) < 0 || pipe(ready_pipe) < 0) {
+    die("creating pipes");
+  }
+
+  // children must not hold other servers' control pipes open, or
+  // those servers would never see them close
+  std::vector<int> control_fds;
+  std::vector<pid_t> server_pids;
+  for (ServerId s = 0; s < cl.server_count; ++s) {
+    int control_pipe[2];
+    if (pipe(control_pipe) < 0) {
+      die("creating pipes");
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+      die("forking server");
+    } else if (0 == pid) {
+      for (int fd : control_fds) close(fd);
+      close(control_pipe[1]);
+      close(result_pipe[0]);
+      close(ready_pipe[0]);
+      run_server(cl, s, ready_pipe[1], control_pipe[0], result_pipe[1]);
+    }
+    close(control_pipe[0]);
+    control_fds.push_back(control_pipe[1]);
+    server_pids.push_back(pid);
+  }
+  close(ready_pipe[1]);
+  for (uint i = 0; i < cl.server_count; ++i) {
+    char c;
+    if (read(ready_pipe[0], &c, 1) != 1) {
+      die("waiting for servers");
+    }
+  }
+
+  std::cout << "cluster started" << std::endl;
+  auto start = Clock::now();
+
+  std::vector<pid_t> client_pids;
+  for (ClientId c = 0; c < cl.client_count; ++c) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      die("forking client");
+    } else if (0 == pid) {
+      for (int fd : control_fds) close(fd);
+      close(result_pipe[0]);
+      close(ready_pipe[0]);
+      run_client(cl, c, result_pipe[1]);
+    }
+    client_pids.push_back(pid);
+  }
+
+  // the children hold the only write ends now, so the pipe reaches
+  // end of file once they have all exited
+  close(result_pipe[1]);
+
+  // results are read as they arrive, since children that outnumber
+  // what the pipe buffers would otherwise block writing them
+  std::vector<Result> clients(cl.client_count);
+  std::vector<Result> servers(cl.server_count);
+  std::vector<bool> client_done(cl.client_count, false);
+  size_t clients_left = cl.client_count;
+  auto read_result = [&]() -> bool {
+    Result r;
+    if (read(result_pipe[0], &r, sizeof(r)) != sizeof(r)) {
+      return false;
+    }
+    if (Result::client == r.kind) {
+      clients[r.id] = r;
+      if (!client_done[r.id]) {
+	client_done[r.id] = true;
+	--clients_left;
+      }
+    } else {
+      servers[r.id] = r;
+    }
+    return true;
+  };
+
+  bool failed = false;
+  auto check_status = [&failed](int status) {
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      failed = true;
+    }
+  };
+  auto reap = [&](pid_t pid) {
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+      failed = true;
+    } else {
+      check_status(status);
+    }
+  };
+
+  // a client that dies without reporting counts as done, so while no
+  // result is pending, look for clients that have exited
+  std::vector<bool> client_reaped(cl.client_count, false);
+  while (clients_left > 0) {
+    struct pollfd pfd = { result_pipe[0], POLLIN, 0 };
+    if (poll(&pfd, 1, 100) > 0) {
+      if (!read_result()) {
+	break;
+      }
+      continue;
+    }
+    for (ClientId c = 0; c < cl.client_count; ++c) {
+      int status;
+      if (!client_reaped[c] &&
+	  client_pids[c] == waitpid(client_pids[c], &status, WNOHANG)) {
+	client_reaped[c] = true;
+	check_status(status);
+	// its result, if it sent one, was in the pipe before it exited
+	while (poll(&pfd, 1, 0) > 0 && read_result()) {
+	  // empty
+	}
+	if (!client_done[c]) {
+	  client_done[c] = true;
+	  --clients_left;
+	}
+      }
+    }
+  }
+  auto elapsed = Clock::now() - start;
+
+  for (ClientId c = 0; c < cl.client_count; ++c) {
+    if (!client_reaped[c]) {
+      reap(client_pids[c]);
+    }
+  }
+  for (int fd : control_fds) {
+    close(fd);
+  }
+  while (read_result()) {
+    // the servers' results, up to end of file
+  }
+  for (pid_t pid : server_pids) {
+    reap(pid);
+  }
+
+  for (ServerId s = 0; s < cl.server_count; ++s) {
+    unlink(cl.socket_path(s).c_str());
+  }
+  rmdir(dir);
+
+  if (failed) {
+    std::cerr << "dmc_cluster: a client or server failed" << std::endl;
+    return 1;
+  }
+
+  std::cout << "cluster completed in " <<
+    std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() <<
+    " millisecs" << std::endl << std::endl;
+
+  const int head_w = 12;
+  const int data_w = 9;
+
+  std::cout << "==== Client Data ====" << std::endl;
+  std::cout << std::setw(head_w) << "client:" << std::setw(data_w) <<
+    "res_ops" << std::setw(data_w) << "prop_ops" << std::setw(data_w) <<
+    "ops/sec" << std::endl;
+  uint64_t qos_ns = 0, qos_count = 0, send_ns = 0, send_count = 0;
+  for (auto& c : clients) {
+    const uint64_t ops = c.reservation_count + c.proportion_count;
+    std::cout << std::setw(head_w - 1) << c.id << ":" <<
+      std::setw(data_w) << c.reservation_count <<
+      std::setw(data_w) << c.proportion_count <<
+      std::setw(data_w) << std::fixed << std::setprecision(1) <<
+      (c.elapsed_ns ? ops * 1e9 / c.elapsed_ns : 0.0) << std::endl;
+    qos_ns += c.qos_ns;
+    qos_count += c.qos_count;
+    send_ns += c.send_ns;
+    send_count += c.send_count;
+  }
+  print_per_op("client time in QOS algorithm", qos_ns, qos_count);
+  print_per_op("client time to send requests", send_ns, send_count);
+
+  std::cout << std::endl << "==== Server Data ====" << std::endl;
+  std::cout << std::setw(head_w) << "server:" << std::setw(data_w) <<
+    "res_ops" << std::setw(data_w) << "prop_ops" << std::endl;
+  qos_ns = qos_count = send_ns = send_count = 0;
+  for (auto& s : servers) {
+    std::cout << std::setw(head_w - 1) << s.id << ":" <<
+      std::setw(data_w) << s.reservation_count <<
+      std::setw(data_w) << s.proportion_count << std::endl;
+    qos_ns += s.qos_ns;
+    qos_count += s.qos_count;
+    send_ns += s.send_ns;
+    send_count += s.send_count;
+  }
+  print_per_op("server time in QOS algorithm", qos_ns, qos_count);
+  print_per_op("server time to send responses", send_ns, send_count);
+
+  return 0;
+} // main
@@ -0,0 +1,152 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#pragma once
+
+
+/* Fixed-size frames dmc_cluster's processes exchange over Unix-domain
+ * stream sockets. Each connection carries requests one way and
+ * responses the other, so frames need no type or length header.
+ * Fields are copied in host byte order, as both ends share a host.
+ */
+
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "dmclock_recs.h"
+#include "sim_recs.h"
+
+
+namespace crimson {
+  namespace test_dmc {
+    namespace wire {
+
+      namespace dmc = crimson::dmclock;
+      namespace sim = crimson::qos_simulation;
+
+      // client, server, epoch, op, size, delta, rho, deadline
+      static const size_t request_len = 7 * sizeof(uint32_t) + sizeof(double);
+
+      // server, epoch, load depth, phase + expired, load delay,
+      // deadline
+      static const size_t response_len =
+	3 * sizeof(uint32_t) + 2 * sizeof(uint8_t) + sizeof(float) +
+	sizeof(double);
+
+
+      class Encoder {
+	char* p;
+      public:
+	Encoder(char* buf) : p(buf) {}
+	template<typename T>
+	Encoder& operator<<(const T& v) {
+	  memcpy(p, &v, sizeof(v));
+	  p += sizeof(v);
+	  return *this;
+	}
+      };
+
+
+      class Decoder {
+	const char* p;
+      public:
+	Decoder(const char* buf) : p(buf) {}
+	template<typename T>
+	Decoder& operator>>(T& v) {
+	  memcpy(&v, p, sizeof(v));
+	  p += sizeof(v);
+	  return *this;
+	}
+      };
+
+
+      inline void encode_request(char* buf,
+				 const ClientId& client,
+				 const sim::TestRequest& request,
+				 const dmc::ReqParams& params) {
+	Encoder(buf) << uint32_t(client) << uint32_t(request.server) <<
+	  request.epoch << request.op << request.size <<
+	  params.delta << params.rho << request.deadline;
+      }
+
+
+      inline void decode_request(const char* buf,
+				 ClientId& client,
+				 sim::TestRequest& request,
+				 dmc::ReqParams& params) {
+	uint32_t c, s;
+	Decoder(buf) >> c >> s >>
+	  request.epoch >> request.op >> request.size >>
+	  params.delta >> params.rho >> request.deadline;
+	client = c;
+	request.server = s;
+      }
+
+
+      inline void encode_response(char* buf,
+				  const ServerId& server,
+				  const sim::TestResponse& response,
+				  dmc::PhaseType phase,
+				  const dmc::LoadHint& load) {
+	Encoder(buf) << uint32_t(server) << response.epoch <<
+	  load.queue_depth <<
+	  uint8_t(phase) << uint8_t(response.expired) <<
+	  load.delay << response.deadline;
+      }
+
+
+      inline void decode_response(const char* buf,
+				  ServerId& server,
+				  sim::TestResponse& response,
+				  dmc::PhaseType& phase,
+				  dmc::LoadHint& load) {
+	uint32_t s;
+	uint8_t ph, expired;
+	Decoder(buf) >> s >> response.epoch >>
+	  load.queue_depth >>
+	  ph >> expired >>
+	  load.delay >> response.deadline;
+	server = s;
+	phase = dmc::PhaseType(ph);
+	response.expired = expired;
+      }
+
+
+      // false if the peer closed the socket or on error
+      inline bool write_full(int fd, const char* buf, size_t len) {
+	while (len > 0) {
+	  ssize_t r = send(fd, buf, len, MSG_NOSIGNAL);
+	  if (r < 0) {
+	    if (EINTR == errno) continue;
+	    return false;
+	  }
+	  buf += r;
+	  len -= r;
+	}
+	return true;
+      }
+
+
+      inline bool read_full(int fd, char* buf, size_t len) {
+	while (len > 0) {
+	  ssize_t r = recv(fd, buf, len, 0);
+	  if (r < 0 && EINTR == errno) continue;
+	  if (r <= 0) return false;
+	  buf += r;
+	  len -= r;
+	}
+	return true;
+      }
+
+    } // namespace wire
+  } // namespace test_dmc
+} // namespace crimson
@@ -39,6 +39,8 @@ namespace crimson {
 	  uint32_t count;
 	  std::chrono::microseconds time_bw_reqs;
 	  uint16_t max_outstanding;
+	  std::chrono::milliseconds timeout; // 0 means no deadline
+	  uint32_t size; // bytes per request
 	} req_params;
       } args;
 
@@ -52,13 +54,16 @@ namespace crimson {
       }
 
       CliInst(req_op_t,
-	      uint32_t count, double ops_per_sec, uint16_t max_outstanding) :
+	      uint32_t count, double ops_per_sec, uint16_t max_outstanding,
+	      uint32_t timeout_ms = 0, uint32_t size = 4096) :
 	op(CliOp::req)
       {
 	args.req_params.count = count;
 	args.req_params.max_outstanding = max_outstanding;
 	uint32_t us = uint32_t(0.5 + 1.0 / ops_per_sec * 1000000);
 	args.req_params.time_bw_reqs = std::chrono::microseconds(us);
+	args.req_params.timeout = std::chrono::milliseconds(timeout_ms);
+	args.req_params.size = size;
       }
     };
 
@@ -95,6 +100,10 @@ namespace crimson {
 
       using ClientAccumFunc = std::function<void(Accum&,const RespPm&)>;
 
+      // when the client may send its next request to the server, as
+      // get_time(); it waits for a response if the time is TimeMax
+      using SendAfterFunc = std::function<double(SvcTrk&,const ServerId&)>;
+
       typedef std::chrono::time_point<std::chrono::steady_clock> TimePoint;
 
       static TimePoint now() { return std::chrono::steady_clock::now(); }
@@ -111,6 +120,7 @@ namespace crimson {
       const SubmitFunc submit_f;
       const ServerSelectFunc server_select_f;
       const ClientAccumFunc accum_f;
+      const SendAfterFunc send_after_f;
 
       std::vector<CliInst> instructions;
 
@@ -137,6 +147,11 @@ namespace crimson {
       Accum                    accumulator;
       InternalStats            internal_stats;
 
+      // responses to requests with a deadline that were shed unserved
+      // or that arrived after the deadline, respectively
+      uint32_t                 expired_ops = 0;
+      uint32_t                 late_ops = 0;
+
       std::thread              thd_req;
       std::thread              thd_resp;
 
@@ -146,11 +161,13 @@ namespace crimson {
 		      const SubmitFunc& _submit_f,
 		      const ServerSelectFunc& _server_select_f,
 		      const ClientAccumFunc& _accum_f,
-		      const std::vector<CliInst>& _instrs) :
+		      const std::vector<CliInst>& _instrs,
+		      const SendAfterFunc& _send_after_f = SendAfterFunc()) :
 	id(_id),
 	submit_f(_submit_f),
 	server_select_f(_server_select_f),
 	accum_f(_accum_f),
+	send_after_f(_send_after_f),
 	instructions(_instrs),
 	service_tracker(),
 	outstanding_ops(0),
@@ -210,8 +227,13 @@ namespace crimson {
 
       const Accum& get_accumulator() const { return accumulator; }
 
+      SvcTrk& get_service_tracker() { return service_tracker; }
+
       const InternalStats& get_internal_stats() const { return internal_stats; }
 
+      uint32_t get_expired_ops() const { return expired_ops; }
+      uint32_t get_late_ops() const { return late_ops; }
+
     protected:
 
       void run_req() {
@@ -230,6 +252,22 @@ namespace crimson {
 	      auto now = std::chrono::steady_clock::now();
 	      const ServerId& server = server_select_f(o);
 
+	      if (send_after_f) {
+		// the request waits here rather than in the server's queue
+		l.lock();
+		double when;
+		while ((when = send_after_f(service_tracker, server)) >
+		       get_time()) {
+		  auto wait = std::chrono::milliseconds(10);
+		  if (when - get_time() < 0.01) {
+		    wait = std::chrono::milliseconds(
+		      long(1 + 1000 * (when - get_time())));
+		  }
+		  cv_req.wait_for(l, wait);
+		}
+		l.unlock();
+	      }
+
 	      ReqPm rp =
 		time_stats_w_return<decltype(internal_stats.get_req_params_time),
 				    ReqPm>(internal_stats.mtx,
@@ -240,7 +278,13 @@ namespace crimson {
 	      count_stats(internal_stats.mtx,
 			  internal_stats.get_req_params_count);
 
-	      TestRequest req(server, o, 12);
+	      double deadline = 0.0;
+	      if (i.args.req_params.timeout.count() > 0) {
+		deadline = get_time() +
+		  i.args.req_params.timeout.count() / 1000.0;
+	      }
+
+	      TestRequest req(server, o, 12, deadline, i.args.req_params.size);
 	      submit_f(server, req, id, rp);
 	      ++outstanding_ops;
 	      l.lock(); // lock for return to top of loop
@@ -278,24 +322,30 @@ namespace crimson {
 
 	    l.unlock();
 
-	    // data collection
-
-	    op_times.push_back(now());
-	    accum_f(accumulator, item.resp_params);
-
-	    // processing
+	    if (item.response.expired) {
+	      // the server never served it, so there's nothing to track
+	      ++expired_ops;
+	    } else {
+	      // data collection
+
+	      op_times.push_back(now());
+	      accum_f(accumulator, item.resp_params);
+	      if (item.response.deadline > 0.0 &&
+		  get_time() > item.response.deadline) {
+		++late_ops;
+	      }
 
-#if 0 // not needed
-	    TestResponse& resp = item.response;
-#endif
+	      // processing
 
-	    time_stats(internal_stats.mtx,
-		       internal_stats.track_resp_time,
-		       [&](){
-			 service_tracker.track_resp(item.server_id, item.resp_params);
-		       });
-	    count_stats(internal_stats.mtx,
-			internal_stats.track_resp_count);
+	      time_stats(internal_stats.mtx,
+			 internal_stats.track_resp_time,
+			 [&](){
+			   service_tracker.track_resp(item.server_id,
+						      item.resp_params);
+			 });
+	      count_stats(internal_stats.mtx,
+			  internal_stats.track_resp_count);
+	    }
 
 	    --outstanding_ops;
 	    if (notify_req_cv) {
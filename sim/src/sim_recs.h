@@ -18,10 +18,13 @@
 
 #include <cmath>
 #include <limits>
+#include <functional>
 #include <string>
 #include <mutex>
 #include <iostream>
 
+#include "dmclock_util.h"
+
 
 using ClientId = uint;
 using ServerId = uint;
@@ -34,6 +37,9 @@ namespace crimson {
       raise(SIGCONT);
     }
 
+    // request deadlines are on dmclock's clock
+    using crimson::dmclock::get_time;
+
     template<typename T>
     void time_stats(std::mutex& mtx,
 		    T& time_accumulate,
@@ -75,19 +81,25 @@ namespace crimson {
       ServerId server; // allows debugging
       uint32_t epoch;
       uint32_t op;
+      double   deadline; // 0.0 when the client never gives up
+      uint32_t size;     // bytes transferred
 
       TestRequest(ServerId _server,
 		  uint32_t _epoch,
-		  uint32_t _op) :
+		  uint32_t _op,
+		  double _deadline = 0.0,
+		  uint32_t _size = 4096) :
 	server(_server),
 	epoch(_epoch),
-	op(_op)
+	op(_op),
+	deadline(_deadline),
+	size(_size)
       {
 	// empty
       }
 
       TestRequest(const TestRequest& r) :
-	TestRequest(r.server, r.epoch, r.op)
+	TestRequest(r.server, r.epoch, r.op, r.deadline, r.size)
       {
 	// empty
       }
@@ -96,15 +108,23 @@ namespace crimson {
 
     struct TestResponse {
       uint32_t epoch;
+      double   deadline; // copied from the request
+      bool     expired;  // request was shed unserved at its deadline
 
-      TestResponse(uint32_t _epoch) :
-	epoch(_epoch)
+      TestResponse(uint32_t _epoch,
+		   double _deadline = 0.0,
+		   bool _expired = false) :
+	epoch(_epoch),
+	deadline(_deadline),
+	expired(_expired)
       {
 	// empty
       }
 
       TestResponse(const TestResponse& r) :
-	epoch(r.epoch)
+	epoch(r.epoch),
+	deadline(r.deadline),
+	expired(r.expired)
       {
 	// empty
       }
@@ -112,6 +132,9 @@ namespace crimson {
       friend std::ostream& operator<<(std::ostream& out, const TestResponse& resp) {
 	out << "{ ";
 	out << "epoch:" << resp.epoch;
+	if (resp.expired) {
+	  out << " expired";
+	}
 	out << " }";
 	return out;
       }
@@ -28,13 +28,15 @@ namespace crimson {
 	ClientId                     client;
 	std::unique_ptr<TestRequest> request;
 	RespPm                       additional;
+	double                       post_time;
 
 	QueueItem(const ClientId&                _client,
 		  std::unique_ptr<TestRequest>&& _request,
 		  const RespPm&                  _additional) :
 	  client(_client),
 	  request(std::move(_request)),
-	  additional(_additional)
+	  additional(_additional),
+	  post_time(get_time())
 	{
 	  // empty
 	}
@@ -48,12 +50,14 @@ namespace crimson {
 	std::chrono::nanoseconds request_complete_time;
 	uint32_t add_request_count;
 	uint32_t request_complete_count;
+	uint32_t request_expired_count;
 
 	InternalStats() :
 	  add_request_time(0),
 	  request_complete_time(0),
 	  add_request_count(0),
-	  request_complete_count(0)
+	  request_complete_count(0),
+	  request_expired_count(0)
 	{
 	  // empty
 	}
@@ -67,6 +71,14 @@ namespace crimson {
       using ServerAccumFunc = std::function<void(Accum& accumulator,
 						 const RespPm& additional)>;
 
+      // tells the queue a request completed; latency is in seconds
+      // from hand-off to the server until completion
+      using RequestCompletedFunc = std::function<void(Q&, double latency)>;
+
+      // does a request's work in place of the sleep model, on the
+      // given server thread (0 to thread_pool_size - 1)
+      using OpFunc = std::function<void(size_t thread,const TestRequest&)>;
+
     protected:
 
       const ServerId                 id;
@@ -77,6 +89,17 @@ namespace crimson {
 
       bool                           finishing;
       std::chrono::microseconds      op_time;
+      double                         bandwidth; // bytes/sec; 0 ignores size
+      // added when consecutive requests come from different clients,
+      // as an HDD seeks between clients' sequential streams
+      std::chrono::microseconds      seek_time;
+      bool                           has_last_client;
+      ClientId                       last_client;
+      // has_avail_thread is true while no more than this many
+      // requests wait for a thread
+      size_t                         queue_depth;
+      RequestCompletedFunc           request_completed_f;
+      OpFunc                         op_f;
 
       std::mutex                     inner_queue_mtx;
       std::condition_variable        inner_queue_cv;
@@ -97,8 +120,9 @@ namespace crimson {
     public:
 
       using CanHandleRequestFunc = std::function<bool(void)>;
-      using HandleRequestFunc =
-	std::function<void(const ClientId&,std::unique_ptr<TestRequest>,const RespPm&)>;
+      // the queue's own type; inner_post ignores any arguments after
+      // the phase, such as the cost a dmclock push queue charged
+      using HandleRequestFunc = typename Q::HandleRequestFunc;
       using CreateQueueF = std::function<Q*(CanHandleRequestFunc,HandleRequestFunc)>;
 					
 
@@ -107,7 +131,10 @@ namespace crimson {
 		      size_t _thread_pool_size,
 		      const ClientRespFunc& _client_resp_f,
 		      const ServerAccumFunc& _accum_f,
-		      CreateQueueF _create_queue_f) :
+		      CreateQueueF _create_queue_f,
+		      double _bandwidth = 0.0,
+		      std::chrono::microseconds _seek_time =
+		      std::chrono::microseconds(0)) :
 	id(_id),
 	priority_queue(_create_queue_f(std::bind(&SimulatedServer::has_avail_thread,
 						 this),
@@ -120,6 +147,13 @@ namespace crimson {
 	iops(_iops),
 	thread_pool_size(_thread_pool_size),
 	finishing(false),
+	bandwidth(_bandwidth),
+	seek_time(_seek_time),
+	has_last_client(false),
+	queue_depth(_thread_pool_size),
+	request_completed_f([](Q& q, double latency) {
+	    q.request_completed();
+	  }),
 	accum_f(_accum_f)
       {
 	op_time =
@@ -128,7 +162,7 @@ namespace crimson {
 	std::chrono::milliseconds delay(1000);
 	threads = new std::thread[thread_pool_size];
 	for (size_t i = 0; i < thread_pool_size; ++i) {
-	  threads[i] = std::thread(&SimulatedServer::run, this, delay);
+	  threads[i] = std::thread(&SimulatedServer::run, this, i, delay);
 	}
       }
 
@@ -158,9 +192,52 @@ namespace crimson {
 		    internal_stats.add_request_count);
       }
 
+      // like post, but the queue may shed the request if it is still
+      // queued at the request's deadline; Q must support deadlines
+      void post_w_deadline(const TestRequest& request,
+			   const ClientId& client_id,
+			   const ReqPm& req_params)
+      {
+	time_stats(internal_stats.mtx,
+		   internal_stats.add_request_time,
+		   [&](){
+		     priority_queue->add_request_deadline(request,
+							  client_id,
+							  req_params,
+							  request.deadline);
+		   });
+	count_stats(internal_stats.mtx,
+		    internal_stats.add_request_count);
+      }
+
+      // called by the queue for a request it shed at its deadline; the
+      // client still gets a response so it can stop waiting on it
+      void request_expired(const ClientId& client,
+			   std::unique_ptr<TestRequest> request) {
+	TestResponse resp(request->epoch, request->deadline, true);
+	client_resp_f(client, resp, id, RespPm());
+	count_stats(internal_stats.mtx,
+		    internal_stats.request_expired_count);
+      }
+
       bool has_avail_thread() {
 	InnerQGuard g(inner_queue_mtx);
-	return inner_queue.size() <= thread_pool_size;
+	return inner_queue.size() <= queue_depth;
+      }
+
+      void set_queue_depth(size_t depth) {
+	InnerQGuard g(inner_queue_mtx);
+	queue_depth = depth;
+      }
+
+      void set_request_completed_func(const RequestCompletedFunc& f) {
+	InnerQGuard g(inner_queue_mtx);
+	request_completed_f = f;
+      }
+
+      void set_op_func(const OpFunc& f) {
+	InnerQGuard g(inner_queue_mtx);
+	op_f = f;
       }
 
       const Accum& get_accumulator() const { return accumulator; }
@@ -181,7 +258,7 @@ namespace crimson {
 	inner_queue_cv.notify_one();
       }
 
-      void run(std::chrono::milliseconds check_period) {
+      void run(size_t thread, std::chrono::milliseconds check_period) {
 	Lock l(inner_queue_mtx);
 	while(true) {
 	  while(inner_queue.empty() && !finishing) {
@@ -192,15 +269,27 @@ namespace crimson {
 	    auto client = front.client;
 	    auto req = std::move(front.request);
 	    auto additional = front.additional;
+	    auto post_time = front.post_time;
+	    auto completed_f = request_completed_f;
+	    auto do_op_f = op_f;
 	    inner_queue.pop_front();
+	    const bool seek = has_last_client && last_client != client;
+	    has_last_client = true;
+	    last_client = client;
 
 	    l.unlock();
 
-	    // simulation operation by sleeping; then call function to
-	    // notify server of completion
-	    std::this_thread::sleep_for(op_time);
-
-	    TestResponse resp(req->epoch);
+	    // simulation operation by sleeping, or doing it; then call
+	    // function to notify server of completion
+	    if (do_op_f) {
+	      do_op_f(thread, *req);
+	    } else {
+	      std::this_thread::sleep_for(op_time + transfer_time(req->size) +
+					  (seek ? seek_time :
+					   std::chrono::microseconds(0)));
+	    }
+
+	    TestResponse resp(req->epoch, req->deadline);
 	    // TODO: rather than assuming this constructor exists, perhaps
 	    // pass in a function that does this mapping?
 	    client_resp_f(client, resp, id, additional);
@@ -208,7 +297,7 @@ namespace crimson {
 	    time_stats(internal_stats.mtx,
 		       internal_stats.request_complete_time,
 		       [&](){
-			 priority_queue->request_completed();
+			 completed_f(*priority_queue, get_time() - post_time);
 		       });
 	    count_stats(internal_stats.mtx,
 			internal_stats.request_complete_count);
@@ -219,6 +308,15 @@ namespace crimson {
 	  }
 	}
       }
+
+      // each thread gets an equal share of the bandwidth
+      std::chrono::microseconds transfer_time(uint32_t size) const {
+	if (0.0 == bandwidth) {
+	  return std::chrono::microseconds(0);
+	}
+	return std::chrono::microseconds(
+	  (int) (0.5 + thread_pool_size * 1000000.0 * size / bandwidth));
+      }
     }; // class SimulatedServer
 
   }; // namespace qos_simulation
@@ -13,6 +13,8 @@
 
 #include <memory>
 #include <chrono>
+#include <mutex>
+#include <condition_variable>
 #include <map>
 #include <random>
 #include <iostream>
@@ -40,6 +42,12 @@ namespace crimson {
 
       ServerMap servers;
       ClientMap clients;
+
+      // a server may answer a client's request before add_clients
+      // has stored that client, so get_client waits for it; clients
+      // is only changed with clients_mtx held
+      std::mutex              clients_mtx;
+      std::condition_variable clients_cv;
       std::vector<ServerId> server_ids;
 
       TimePoint early_time;
@@ -90,7 +98,15 @@ namespace crimson {
 
       uint get_client_count() const { return client_count; }
       uint get_server_count() const { return server_count; }
-      TC& get_client(ClientId id) { return *clients[id]; }
+      TC& get_client(ClientId id) {
+	std::unique_lock<std::mutex> l(clients_mtx);
+	typename ClientMap::const_iterator it;
+	clients_cv.wait(l, [&] {
+	    it = clients.find(id);
+	    return clients.end() != it;
+	  });
+	return *it->second;
+      }
       TS& get_server(ServerId id) { return *servers[id]; }
       const ServerId& get_server_id(uint index) const {
 	return server_ids[index];
@@ -131,7 +147,12 @@ namespace crimson {
 	client_count += count;
 
 	for (; i < client_count; ++i) {
-	  clients[i] = create_client_f(i);
+	  TC* client = create_client_f(i);
+	  {
+	    std::lock_guard<std::mutex> g(clients_mtx);
+	    clients[i] = client;
+	  }
+	  clients_cv.notify_all();
 	}
 
 	clients_created_time = now();
@@ -292,6 +313,7 @@ namespace crimson {
 	T request_complete_time(0);
 	uint32_t add_request_count = 0;
 	uint32_t request_complete_count = 0;
+	uint32_t request_expired_count = 0;
 
 	for (uint i = 0; i < get_server_count(); ++i) {
 	  const auto& server = get_server(i);
@@ -302,6 +324,7 @@ namespace crimson {
 	    std::chrono::duration_cast<T>(is.request_complete_time);
 	  add_request_count += is.add_request_count;
 	  request_complete_count += is.request_complete_count;
+	  request_expired_count += is.request_expired_count;
 	}
 
 	double add_request_time_per_unit =
@@ -322,9 +345,15 @@ namespace crimson {
 	  "    average: " << request_complete_time_unit <<
 	  " " << time_unit << " per request/response" << std::endl;
 
+	if (request_expired_count > 0) {
+	  out << "requests shed at deadline: " << request_expired_count <<
+	    std::endl;
+	}
+
 	out << std::endl;
 
-	assert(add_request_count == request_complete_count);
+	assert(add_request_count ==
+	       request_complete_count + request_expired_count);
 	out << "server timing for QOS algorithm: " <<
 	  add_request_time_per_unit + request_complete_time_unit <<
 	  " " << time_unit << " per request/response" << std::endl;
@@ -338,10 +367,12 @@ namespace crimson {
 	T get_req_params_time(0);
 	uint32_t track_resp_count = 0;
 	uint32_t get_req_params_count = 0;
+	uint32_t expired_ops = 0;
 
 	for (uint i = 0; i < get_client_count(); ++i) {
 	  const auto& client = get_client(i);
 	  const auto& is = client.get_internal_stats();
+	  expired_ops += client.get_expired_ops();
 	  track_resp_time +=
 	    std::chrono::duration_cast<T>(is.track_resp_time);
 	  get_req_params_time +=
@@ -370,7 +401,7 @@ namespace crimson {
 
 	out << std::endl;
 
-	assert(track_resp_count == get_req_params_count);
+	assert(track_resp_count + expired_ops == get_req_params_count);
 	out << "client timing for QOS algorithm: " <<
 	  track_resp_time_unit + get_req_params_time_unit << " " <<
 	  time_unit << " per request/response" << std::endl;
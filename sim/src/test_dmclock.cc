@@ -6,6 +6,9 @@
  */
 
 
+#include <limits>
+#include <iostream>
+
 #include "dmclock_recs.h"
 #include "dmclock_server.h"
 #include "dmclock_client.h"
@@ -18,6 +21,7 @@
 
 
 namespace test = crimson::test_dmc;
+namespace sim = crimson::qos_simulation;
 
 
 void test::dmc_server_accumulate_f(test::DmcAccum& a,
@@ -38,3 +42,112 @@ void test::dmc_client_accumulate_f(test::DmcAccum& a,
     ++a.proportion_count;
   }
 }
+
+
+test::dmc::ClientInfo test::client_info(const sim::cli_group_t& cg) {
+  return dmc::ClientInfo(cg.client_reservation,
+			 cg.client_weight,
+			 cg.client_limit,
+			 dmc::BandwidthInfo(cg.client_bw_reservation,
+					    cg.client_bw_limit),
+			 cg.client_burst);
+}
+
+
+std::vector<sim::CliInst>
+test::client_instructions(const sim::cli_group_t& cg) {
+  sim::CliInst req(sim::req_op,
+		   (uint32_t)cg.client_total_ops,
+		   (double)cg.client_iops_goal,
+		   (uint16_t)cg.client_outstanding_ops,
+		   (uint32_t)cg.client_req_timeout,
+		   (uint32_t)cg.client_req_size);
+  if (cg.client_wait == std::chrono::seconds(0)) {
+    return { req };
+  } else {
+    return { sim::CliInst(sim::wait_op, cg.client_wait), req };
+  }
+}
+
+
+test::DmcClient::SendAfterFunc
+test::client_send_after(const sim::cli_group_t& cg) {
+  if (cg.client_pacing_depth > 0 || cg.client_limit_lookahead > 0.0) {
+    return [](dmc::ServiceTracker<ServerId>& tracker,
+	      const ServerId& server) -> double {
+      return tracker.get_send_after(server);
+    };
+  }
+  return DmcClient::SendAfterFunc();
+}
+
+
+void test::configure_client(DmcClient& client, const sim::cli_group_t& cg) {
+  client.get_service_tracker().set_pacing_depth(cg.client_pacing_depth);
+  if (cg.client_limit_lookahead > 0.0) {
+    client.get_service_tracker().set_limit_pacing(cg.client_limit,
+						  cg.client_limit_lookahead);
+  }
+}
+
+
+void test::configure_queue(DmcQueue& queue, const sim::srv_group_t& sg) {
+  queue.set_request_bytes_func(
+    [](const sim::TestRequest& request) -> uint64_t {
+      return request.size;
+    });
+  if (sg.server_size_cost && sg.server_bandwidth > 0.0) {
+    // a 4KiB request is the unit the client rates are given in
+    dmc::SizeCost size_cost(1.0 / sg.server_iops,
+			    sg.server_bandwidth,
+			    4096);
+    queue.set_request_cost_func(
+      [size_cost](const sim::TestRequest& request) -> double {
+	return size_cost(request.size);
+      });
+  }
+  queue.set_run_limit(sg.server_run_requests);
+  if (sg.server_numa_node >= 0 &&
+      !queue.set_numa_node(sg.server_numa_node)) {
+    static bool warned = false;
+    if (!warned) {
+      std::cerr << "warning: queues not placed on NUMA node " <<
+	sg.server_numa_node << "; see numa_arena.h" << std::endl;
+      warned = true;
+    }
+  }
+  if (sg.server_adaptive_depth) {
+    queue.set_concurrency_limit(
+      dmc::AimdConcurrency(sg.server_threads, 256));
+  }
+}
+
+
+sim::UringDevice* test::configure_server(DmcServer& server,
+					 const sim::srv_group_t& sg,
+					 uint32_t max_req_size) {
+  if (sg.server_adaptive_depth) {
+    // the queue's limiter alone decides how much is outstanding
+    server.set_queue_depth(std::numeric_limits<size_t>::max());
+    server.set_request_completed_func(
+      [](DmcQueue& q, double latency) {
+	q.request_completed(latency);
+      });
+  } else if (sg.server_queue_depth > 0) {
+    server.set_queue_depth(sg.server_queue_depth);
+  }
+  if (sg.server_uring_path.empty()) {
+    return nullptr;
+  }
+  sim::UringDevice* device =
+    new sim::UringDevice(sg.server_uring_path,
+			 uint64_t(sg.server_uring_size) << 20,
+			 sg.server_threads,
+			 max_req_size,
+			 sg.server_uring_write_percent);
+  server.set_op_func(
+    [device](size_t thread, const sim::TestRequest& req) {
+      device->io(thread, req);
+    });
+  return device;
+}
@@ -15,6 +15,8 @@
 #include "sim_client.h"
 
 #include "simulate.h"
+#include "config.h"
+#include "uring_device.h"
 
 
 namespace crimson {
@@ -52,5 +54,26 @@ namespace crimson {
 
     extern void dmc_client_accumulate_f(DmcAccum& a,
 					const dmc::PhaseType& phase);
+
+    // the settings below are shared by dmc_sim and dmc_cluster
+
+    extern dmc::ClientInfo client_info(const sim::cli_group_t& cg);
+
+    extern std::vector<sim::CliInst>
+    client_instructions(const sim::cli_group_t& cg);
+
+    // what the client waits on before sending, if it paces itself
+    extern DmcClient::SendAfterFunc
+    client_send_after(const sim::cli_group_t& cg);
+
+    extern void configure_client(DmcClient& client,
+				 const sim::cli_group_t& cg);
+
+    extern void configure_queue(DmcQueue& queue, const sim::srv_group_t& sg);
+
+    // returns the device the server does its I/O on, if any
+    extern sim::UringDevice* configure_server(DmcServer& server,
+					      const sim::srv_group_t& sg,
+					      uint32_t max_req_size);
   } // namespace test_dmc
 } // namespace crimson
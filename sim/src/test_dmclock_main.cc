@@ -74,6 +74,7 @@ int main(int argc, char* argv[]) {
     const uint client_groups = g_conf.client_groups;
     const bool server_random_selection = g_conf.server_random_selection;
     const bool server_soft_limit = g_conf.server_soft_limit;
+    const bool server_shed_expired = g_conf.server_shed_expired;
     uint server_total_count = 0;
     uint client_total_count = 0;
 
@@ -87,10 +88,7 @@ int main(int argc, char* argv[]) {
 
     std::vector<test::dmc::ClientInfo> client_info;
     for (uint i = 0; i < client_groups; ++i) {
-      client_info.push_back(test::dmc::ClientInfo 
-			  { cli_group[i].client_reservation,
-			    cli_group[i].client_weight,
-			    cli_group[i].client_limit } );
+      client_info.push_back(test::client_info(cli_group[i]));
     }
 
     auto ret_client_group_f = [&](const ClientId& c) -> uint {
@@ -135,59 +133,91 @@ int main(int argc, char* argv[]) {
 
     // lambda to post a request to the identified server; called by client
     test::SubmitFunc server_post_f =
-        [&simulation](const ServerId& server,
-                      const sim::TestRequest& request,
-                      const ClientId& client_id,
-                      const test::dmc::ReqParams& req_params) {
+        [&simulation, server_shed_expired](const ServerId& server,
+                                           const sim::TestRequest& request,
+                                           const ClientId& client_id,
+                                           const test::dmc::ReqParams& req_params) {
         test::DmcServer& s = simulation->get_server(server);
-        s.post(request, client_id, req_params);
+        if (server_shed_expired && request.deadline > 0.0) {
+          s.post_w_deadline(request, client_id, req_params);
+        } else {
+          s.post(request, client_id, req_params);
+        }
     };
 
     std::vector<std::vector<sim::CliInst>> cli_inst;
     for (uint i = 0; i < client_groups; ++i) {
-      if (cli_group[i].client_wait == std::chrono::seconds(0)) {
-	cli_inst.push_back(
-	    { { sim::req_op, 
-	        (uint32_t)cli_group[i].client_total_ops,
-	        (double)cli_group[i].client_iops_goal, 
-	        (uint16_t)cli_group[i].client_outstanding_ops } } );
-      } else {
-	cli_inst.push_back(
-	    { { sim::wait_op, cli_group[i].client_wait },
-	      { sim::req_op, 
-	        (uint32_t)cli_group[i].client_total_ops,
-		(double)cli_group[i].client_iops_goal, 
-		(uint16_t)cli_group[i].client_outstanding_ops } } );
-      }
+      cli_inst.push_back(test::client_instructions(cli_group[i]));
     }
 
     simulation = new test::MySim();
 
     test::DmcServer::ClientRespFunc client_response_f =
-        [&simulation](ClientId client_id,
-                      const sim::TestResponse& resp,
-                      const ServerId& server_id,
-                      const dmc::PhaseType& phase) {
-        simulation->get_client(client_id).receive_response(resp,
-                                                           server_id,
-                                                           phase);
+        [&simulation, &cli_group, ret_client_group_f](
+          ClientId client_id,
+          const sim::TestResponse& resp,
+          const ServerId& server_id,
+          const dmc::PhaseType& phase) {
+        test::DmcClient& client = simulation->get_client(client_id);
+        // an expired request's response carries no load hint, as the
+        // server's queue may be locked while it sheds
+        if (!resp.expired &&
+            cli_group[ret_client_group_f(client_id)].client_pacing_depth > 0) {
+          // the load hint the server would return with the response
+          const dmc::LoadHint load =
+            simulation->get_server(server_id).get_priority_queue().
+            get_load_hint(client_id);
+          client.get_service_tracker().track_load(server_id, load);
+        }
+        client.receive_response(resp, server_id, phase);
     };
 
-    test::CreateQueueF create_queue_f =
-        [&](test::DmcQueue::CanHandleRequestFunc can_f,
-            test::DmcQueue::HandleRequestFunc handle_f) -> test::DmcQueue* {
-        return new test::DmcQueue(client_info_f, can_f, handle_f, server_soft_limit);
+    // queue settings can differ by server group
+    auto make_create_queue_f = [&](uint group) -> test::CreateQueueF {
+      const sim::srv_group_t& sg = srv_group[group];
+      return [&, sg](test::DmcQueue::CanHandleRequestFunc can_f,
+                     test::DmcQueue::HandleRequestFunc handle_f) -> test::DmcQueue* {
+        test::DmcQueue* queue =
+          new test::DmcQueue(client_info_f, can_f, handle_f, server_soft_limit);
+        queue->set_request_expired_func(
+          [&simulation](const ClientId& client,
+                        std::unique_ptr<sim::TestRequest> request) {
+            test::DmcServer& s = simulation->get_server(request->server);
+            s.request_expired(client, std::move(request));
+          });
+        test::configure_queue(*queue, sg);
+        return queue;
+      };
     };
 
  
+    // devices for servers doing real I/O; never freed, as the
+    // servers' threads are not
+    std::vector<sim::UringDevice*> devices;
+    uint32_t max_req_size = 0;
+    for (uint i = 0; i < client_groups; ++i) {
+      max_req_size = std::max(max_req_size,
+                              (uint32_t) cli_group[i].client_req_size);
+    }
+
     auto create_server_f = [&](ServerId id) -> test::DmcServer* {
       uint i = ret_server_group_f(id);
-      return new test::DmcServer(id,
-                                 srv_group[i].server_iops,
-				 srv_group[i].server_threads,
-				 client_response_f,
-				 test::dmc_server_accumulate_f,
-				 create_queue_f);
+      test::DmcServer* server =
+        new test::DmcServer(id,
+                            srv_group[i].server_iops,
+                            srv_group[i].server_threads,
+                            client_response_f,
+                            test::dmc_server_accumulate_f,
+                            make_create_queue_f(i),
+                            srv_group[i].server_bandwidth,
+                            std::chrono::microseconds(
+                              srv_group[i].server_seek_time));
+      sim::UringDevice* device =
+        test::configure_server(*server, srv_group[i], max_req_size);
+      if (device) {
+        devices.push_back(device);
+      }
+      return server;
     };
 
     auto create_client_f = [&](ClientId id) -> test::DmcClient* {
@@ -199,11 +229,15 @@ int main(int argc, char* argv[]) {
       } else {
 	server_select_f = simulation->make_server_select_ran_range(client_server_select_range);
       }
-      return new test::DmcClient(id,
-				 server_post_f,
-				 std::bind(server_select_f, _1, id),
-				 test::dmc_client_accumulate_f,
-				 cli_inst[i]);
+      test::DmcClient* client =
+        new test::DmcClient(id,
+                            server_post_f,
+                            std::bind(server_select_f, _1, id),
+                            test::dmc_client_accumulate_f,
+                            cli_inst[i],
+                            test::client_send_after(cli_group[i]));
+      test::configure_client(*client, cli_group[i]);
+      return client;
     };
 
 #if 1
@@ -226,6 +260,26 @@ int main(int argc, char* argv[]) {
     simulation->display_stats(std::cout,
                               &test::server_data, &test::client_data,
                               server_disp_filter, client_disp_filter);
+
+    if (!devices.empty()) {
+      uint64_t io_count = 0;
+      uint64_t io_ns = 0;
+      for (auto d : devices) {
+        io_count += d->get_io_count();
+        io_ns += d->get_io_ns();
+      }
+      std::cout << std::endl << "device: " <<
+        (devices.front()->is_uring() ? "io_uring" : "pread/pwrite") <<
+        (devices.front()->is_direct() ? ", O_DIRECT" : ", buffered") <<
+        std::endl;
+      std::cout << "total time in I/O: " << io_ns << " nanoseconds;" <<
+        std::endl;
+      std::cout << "    count: " << io_count << ";" << std::endl;
+      if (io_count > 0) {
+        std::cout << "    average: " << double(io_ns) / io_count <<
+          " nanoseconds per I/O" << std::endl;
+      }
+    }
 } // main
 
 
@@ -259,6 +313,36 @@ void test::client_data(std::ostream& out,
     }
     out << " " << std::setw(data_w) << std::setprecision(data_prec) <<
         std::fixed << total_p << std::endl;
+
+    // ops that completed after the client's deadline, and ops the
+    // server shed unserved; goodput is everything else
+    int total_late = 0;
+    out << std::setw(head_w) << "late_ops:";
+    for (uint i = 0; i < sim->get_client_count(); ++i) {
+        const auto& client = sim->get_client(i);
+        auto l = client.get_late_ops();
+        total_late += l;
+        if (!client_disp_filter(i)) continue;
+        out << " " << std::setw(data_w) << l;
+    }
+    out << " " << std::setw(data_w) << std::setprecision(data_prec) <<
+        std::fixed << total_late << std::endl;
+
+    int total_exp = 0;
+    out << std::setw(head_w) << "exp_ops:";
+    for (uint i = 0; i < sim->get_client_count(); ++i) {
+        const auto& client = sim->get_client(i);
+        auto e = client.get_expired_ops();
+        total_exp += e;
+        if (!client_disp_filter(i)) continue;
+        out << " " << std::setw(data_w) << e;
+    }
+    out << " " << std::setw(data_w) << std::setprecision(data_prec) <<
+        std::fixed << total_exp << std::endl;
+
+    out << std::setw(head_w) << "goodput:" << " " <<
+        (total_r + total_p - total_late) << " ops within deadline" <<
+        std::endl;
 }
 
 
@@ -290,6 +374,23 @@ void test::server_data(std::ostream& out,
     out << " " << std::setw(data_w) << std::setprecision(data_prec) <<
         std::fixed << total_p << std::endl;
 
+    out << std::setw(head_w) << "run_ops:";
+    size_t total_run = 0;
+    double max_run_err = 0.0;
+    for (uint i = 0; i < sim->get_server_count(); ++i) {
+        const auto& q = sim->get_server(i).get_priority_queue();
+        auto rn = q.get_run_sched_count();
+        total_run += rn;
+        max_run_err = std::max(max_run_err, q.get_run_fairness_error());
+        if (!server_disp_filter(i)) continue;
+        out << " " << std::setw(data_w) << rn;
+    }
+    out << " " << std::setw(data_w) << std::setprecision(data_prec) <<
+        std::fixed << total_run << std::endl;
+    out << std::setw(head_w) << "run_err:" << " " <<
+        std::setprecision(data_prec) << std::fixed << max_run_err <<
+        std::endl;
+
     const auto& q = sim->get_server(0).get_priority_queue();
     out << std::endl <<
 	" k-way heap: " << q.get_heap_branching_factor() << std::endl
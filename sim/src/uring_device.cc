@@ -0,0 +1,286 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+#include <chrono>
+#include <algorithm>
+#include <new>
+#include <system_error>
+
+#include "uring_device.h"
+
+
+namespace sim = crimson::qos_simulation;
+
+
+// O_DIRECT needs buffers, offsets, and sizes aligned to the logical
+// block size; 4KiB covers the devices we run on
+static const uint32_t io_align = 4096;
+
+
+static inline uint32_t align_up(uint32_t size) {
+  return (size + io_align - 1) / io_align * io_align;
+}
+
+
+// splitmix64; spreads offsets over the file
+static inline uint64_t mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+
+struct sim::UringDevice::Ring {
+  void*    buf = nullptr;
+  uint64_t seq = 0;
+
+#ifdef HAVE_IO_URING
+  int      ring_fd = -1;
+  void*    sq_ptr = MAP_FAILED;
+  size_t   sq_len = 0;
+  void*    cq_ptr = MAP_FAILED;
+  size_t   cq_len = 0;
+  struct io_uring_sqe* sqes = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+  size_t   sqes_len = 0;
+
+  unsigned* sq_tail;
+  unsigned* sq_mask;
+  unsigned* sq_array;
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned* cq_mask;
+  struct io_uring_cqe* cqes;
+
+  // false if the kernel refuses io_uring, e.g. under seccomp, in
+  // which case the ring is left unused
+  bool setup() {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ring_fd = syscall(__NR_io_uring_setup, 1, &p);
+    if (ring_fd < 0) {
+      return false;
+    }
+    if (!map(p)) {
+      release();
+      return false;
+    }
+    return true;
+  }
+
+  bool map(const struct io_uring_params& p) {
+    sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+      sq_len = cq_len = std::max(sq_len, cq_len);
+    }
+    sq_ptr = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == sq_ptr) {
+      return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+      cq_ptr = sq_ptr;
+    } else {
+      cq_ptr = mmap(nullptr, cq_len, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+      if (MAP_FAILED == cq_ptr) {
+	return false;
+      }
+    }
+    sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = static_cast<struct io_uring_sqe*>(
+      mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE,
+	   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+    if (MAP_FAILED == sqes) {
+      return false;
+    }
+
+    char* sq = static_cast<char*>(sq_ptr);
+    char* cq = static_cast<char*>(cq_ptr);
+    sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+    return true;
+  }
+
+  // submits one read or write and waits for it; returns the result
+  // as the kernel reports it (bytes, or -errno)
+  int submit_wait(int fd, bool write, uint32_t size, uint64_t offset) {
+    unsigned tail = *sq_tail;
+    unsigned index = tail & *sq_mask;
+    struct io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = size;
+    sqe->off = offset;
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    int r;
+    do {
+      r = syscall(__NR_io_uring_enter, ring_fd, 1, 1,
+		  IORING_ENTER_GETEVENTS, nullptr, 0);
+    } while (r < 0 && EINTR == errno);
+    if (r < 0) {
+      return -errno;
+    }
+
+    unsigned head = *cq_head;
+    while (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+      // io_uring_enter returned before the completion was posted
+      (void) syscall(__NR_io_uring_enter, ring_fd, 0, 1,
+		     IORING_ENTER_GETEVENTS, nullptr, 0);
+    }
+    int res = cqes[head & *cq_mask].res;
+    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+    return res;
+  }
+
+  bool is_uring() const {
+    return ring_fd >= 0;
+  }
+
+  void release() {
+    if (MAP_FAILED != sqes) munmap(sqes, sqes_len);
+    if (MAP_FAILED != cq_ptr && cq_ptr != sq_ptr) munmap(cq_ptr, cq_len);
+    if (MAP_FAILED != sq_ptr) munmap(sq_ptr, sq_len);
+    if (ring_fd >= 0) close(ring_fd);
+    sqes = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    cq_ptr = sq_ptr = MAP_FAILED;
+    ring_fd = -1;
+  }
+
+  ~Ring() {
+    release();
+    free(buf);
+  }
+#else
+  bool setup() {
+    return false;
+  }
+
+  int submit_wait(int fd, bool write, uint32_t size, uint64_t offset) {
+    (void) fd;
+    (void) write;
+    (void) size;
+    (void) offset;
+    return -ENOSYS;
+  }
+
+  bool is_uring() const {
+    return false;
+  }
+
+  ~Ring() {
+    free(buf);
+  }
+#endif
+}; // struct Ring
+
+
+sim::UringDevice::UringDevice(const std::string& path,
+			      uint64_t _file_size,
+			      size_t ring_count,
+			      uint32_t max_request_size,
+			      uint32_t _write_percent) :
+  direct(true),
+  max_size(align_up(max_request_size)),
+  write_percent(_write_percent),
+  io_count(0),
+  io_ns(0)
+{
+  fd = open(path.c_str(), O_RDWR | O_CREAT | O_DIRECT, 0644);
+  if (fd < 0 && EINVAL == errno) {
+    // tmpfs and some others refuse O_DIRECT
+    direct = false;
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  }
+  if (fd < 0) {
+    throw std::system_error(errno, std::system_category(), path);
+  }
+
+  file_size = _file_size / max_size * max_size;
+  if (file_size < max_size ||
+      ftruncate(fd, file_size) < 0) {
+    int err = file_size < max_size ? EINVAL : errno;
+    close(fd);
+    throw std::system_error(err, std::system_category(), path);
+  }
+
+  for (size_t i = 0; i < ring_count; ++i) {
+    std::unique_ptr<Ring> ring(new Ring);
+    if (posix_memalign(&ring->buf, io_align, max_size)) {
+      close(fd);
+      throw std::bad_alloc();
+    }
+    memset(ring->buf, 0xa5, max_size);
+    (void) ring->setup(); // else this thread uses pread/pwrite
+    rings.emplace_back(std::move(ring));
+  }
+}
+
+
+sim::UringDevice::~UringDevice() {
+  rings.clear();
+  close(fd);
+}
+
+
+bool sim::UringDevice::is_uring() const {
+  return !rings.empty() && rings.front()->is_uring();
+}
+
+
+void sim::UringDevice::io(size_t ring_index, const TestRequest& request) {
+  Ring& ring = *rings[ring_index];
+  const uint32_t size = std::min(align_up(request.size), max_size);
+  const uint64_t h = mix((uint64_t(request.epoch) << 32) ^ ++ring.seq ^
+			 (uint64_t(ring_index) << 48));
+  const uint64_t offset = h % (file_size / max_size) * max_size;
+  const bool write = (h >> 32) % 100 < write_percent;
+
+  auto start = std::chrono::steady_clock::now();
+  int r;
+  if (ring.is_uring()) {
+    r = ring.submit_wait(fd, write, size, offset);
+  } else if (write) {
+    r = pwrite(fd, ring.buf, size, offset);
+    if (r < 0) r = -errno;
+  } else {
+    r = pread(fd, ring.buf, size, offset);
+    if (r < 0) r = -errno;
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  if (r < 0) {
+    throw std::system_error(-r, std::system_category(),
+			    write ? "uring write" : "uring read");
+  }
+  ++io_count;
+  io_ns +=
+    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
@@ -0,0 +1,78 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#pragma once
+
+
+/* UringDevice lets SimulatedServer do real I/O against a local file or
+ * ramdisk instead of sleeping, so the queue's cost can be weighed
+ * against the CPU cost of an I/O. Each server thread has its own
+ * io_uring (built with cmake -DIO_URING=yes) and waits for its one
+ * request; the file is opened O_DIRECT where the file system allows
+ * it. Without io_uring, or where the kernel refuses it, pread and
+ * pwrite are used.
+ *
+ * As SimulatedServer hands each thread one request at a time, the
+ * device sees at most server_threads I/Os in flight; to test a given
+ * queue depth, set server_threads to it. Batching several requests
+ * per ring would need the server to dispatch more than one to a
+ * thread, which would change what its threads model.
+ */
+
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "sim_recs.h"
+
+
+namespace crimson {
+  namespace qos_simulation {
+
+    class UringDevice {
+      struct Ring;
+
+      int                                fd;
+      bool                               direct;
+      uint64_t                           file_size;
+      uint32_t                           max_size;
+      uint32_t                           write_percent;
+      std::vector<std::unique_ptr<Ring>> rings;
+
+      std::atomic<uint64_t>              io_count;
+      std::atomic<uint64_t>              io_ns;
+
+    public:
+
+      // creates the file if needed; one ring per server thread;
+      // throws std::system_error if the file cannot be used
+      UringDevice(const std::string& path,
+		  uint64_t file_size,
+		  size_t ring_count,
+		  uint32_t max_request_size,
+		  uint32_t write_percent = 0);
+
+      ~UringDevice();
+
+      // does the request's I/O on the given thread's ring, returning
+      // once it completes; offsets are spread pseudo-randomly over
+      // the file and write_percent of requests write
+      void io(size_t ring, const TestRequest& request);
+
+      bool is_direct() const { return direct; }
+      bool is_uring() const;
+      uint64_t get_io_count() const { return io_count; }
+      uint64_t get_io_ns() const { return io_ns; }
+    }; // class UringDevice
+
+  } // namespace qos_simulation
+} // namespace crimson
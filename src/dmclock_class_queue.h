@@ -0,0 +1,259 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#pragma once
+
+/* PullClassQueue schedules requests in two levels. Each request
+ * belongs to an op class (e.g., client io, recovery, scrub). Classes
+ * are scheduled against one another with dmclock using a class-level
+ * reservation, weight, and limit, and within a class the per-client
+ * dmclock of a PullPriorityQueue picks the request. Classes marked
+ * strict form a FIFO lane that is dispatched ahead of all others and
+ * is intended for tiny, latency-critical ops (e.g., heartbeats).
+ *
+ * Classes are kept in heaps by TwoLevelPullQueue, so selecting one
+ * costs O(log classes), and with the small, fixed set of classes a
+ * caller has, a constant amount per dispatch independent of the
+ * number of clients and requests.
+ */
+
+#include <assert.h>
+
+#include <memory>
+#include <functional>
+#include <deque>
+#include <chrono>
+
+#include "dmclock_server.h"
+#include "dmclock_two_level_queue.h"
+
+
+namespace crimson {
+
+  namespace dmclock {
+
+    struct ClassInfo {
+      const ClientInfo qos;    // class-level reservation, weight, limit
+      const bool       strict; // dispatched FIFO ahead of dmclock classes
+
+      ClassInfo(double _reservation, double _weight, double _limit) :
+	qos(_reservation, _weight, _limit),
+	strict(false)
+      {
+	// empty
+      }
+
+      // a class in the strict-priority lane; it bypasses dmclock, so
+      // its ops must be few and cheap or they will starve the others
+      static ClassInfo strict_lane() {
+	return ClassInfo();
+      }
+
+    protected:
+
+      ClassInfo() :
+	qos(0.0, 1.0, 0.0),
+	strict(true)
+      {
+	// empty
+      }
+    }; // struct ClassInfo
+
+
+    // K is the op class type, C the client type, R the request type
+    template<typename K, typename C, typename R, uint B=2>
+    class PullClassQueue : public TwoLevelPullQueue<K,C,R,B> {
+      using super = TwoLevelPullQueue<K,C,R,B>;
+
+    public:
+
+      using RequestRef = typename super::RequestRef;
+      using ClientInfoFunc = typename super::ClientInfoFunc;
+      using ClassInfoFunc = std::function<ClassInfo(const K&)>;
+      using NextReqType = typename super::NextReqType;
+
+      struct Retn {
+	C          client;
+	K          op_class;
+	RequestRef request;
+	PhaseType  phase;       // per-client phase, for the client tracker
+	PhaseType  class_phase; // phase the class was scheduled in
+      };
+
+      // When a request is pulled, this is the return type.
+      using PullReq = typename super::template PullReqOf<Retn>;
+
+    protected:
+
+      using GroupRec = typename super::GroupRec;
+      using DataGuard = typename super::DataGuard;
+
+      // holds the class itself, as an idle class record may be erased
+      struct StrictEntry {
+	K          op_class;
+	C          client;
+	RequestRef request;
+      };
+
+      ClassInfoFunc           class_info_f;
+      std::deque<StrictEntry> strict_lane;
+
+      // performance data collection
+      size_t strict_sched_count = 0;
+
+    public:
+
+      // with allow_limit_break, both class limits and client limits
+      // within a class may be broken
+      PullClassQueue(ClassInfoFunc _class_info_f,
+		     ClientInfoFunc _client_info_f,
+		     bool _allow_limit_break = false) :
+	super(_client_info_f,
+	      nullptr,
+	      std::chrono::minutes(10),
+	      std::chrono::minutes(15),
+	      std::chrono::minutes(6),
+	      _allow_limit_break,
+	      true),
+	class_info_f(_class_info_f)
+      {
+	// empty
+      }
+
+
+      // these versions start no thread; the cleaning jobs run on the
+      // executor, which must outlive the queue. The ages apply to
+      // both the classes and the clients within them.
+      template<typename Rep, typename Per>
+      PullClassQueue(ClassInfoFunc _class_info_f,
+		     ClientInfoFunc _client_info_f,
+		     TimerExecutor& _executor,
+		     std::chrono::duration<Rep,Per> _idle_age,
+		     std::chrono::duration<Rep,Per> _erase_age,
+		     std::chrono::duration<Rep,Per> _check_time,
+		     bool _allow_limit_break = false) :
+	super(_client_info_f,
+	      &_executor,
+	      _idle_age, _erase_age, _check_time,
+	      _allow_limit_break,
+	      true),
+	class_info_f(_class_info_f)
+      {
+	// empty
+      }
+
+
+      PullClassQueue(ClassInfoFunc _class_info_f,
+		     ClientInfoFunc _client_info_f,
+		     TimerExecutor& _executor,
+		     bool _allow_limit_break = false) :
+	PullClassQueue(_class_info_f,
+		       _client_info_f,
+		       _executor,
+		       std::chrono::minutes(10),
+		       std::chrono::minutes(15),
+		       std::chrono::minutes(6),
+		       _allow_limit_break)
+      {
+	// empty
+      }
+
+
+      inline void add_request(const R& request,
+			      const K& op_class,
+			      const C& client_id,
+			      const ReqParams& req_params,
+			      double addl_cost = 0.0) {
+	add_request(RequestRef(new R(request)),
+		    op_class, client_id, req_params, get_time(), addl_cost);
+      }
+
+
+      inline void add_request_time(const R& request,
+				   const K& op_class,
+				   const C& client_id,
+				   const ReqParams& req_params,
+				   const Time time,
+				   double addl_cost = 0.0) {
+	add_request(RequestRef(new R(request)),
+		    op_class, client_id, req_params, time, addl_cost);
+      }
+
+
+      // this does the work; the versions above provide alternate interfaces
+      void add_request(RequestRef&&     request,
+		       const K&         op_class,
+		       const C&         client_id,
+		       const ReqParams& req_params,
+		       const Time       time,
+		       double           addl_cost = 0.0) {
+	DataGuard g(this->data_mtx);
+	GroupRec* cls = this->find_group(op_class);
+	if (nullptr == cls) {
+	  const ClassInfo info = class_info_f(op_class);
+	  cls = &this->add_group(op_class, info.qos, !info.strict);
+	}
+
+	if (!cls->queue) {
+	  cls->last_tick = ++this->tick;
+	  strict_lane.push_back(
+	    StrictEntry{op_class, client_id, std::move(request)});
+	  return;
+	}
+
+	this->do_add_request(*cls, std::move(request),
+			     client_id, req_params, time, addl_cost);
+      }
+
+
+      inline PullReq pull_request() {
+	return pull_request(get_time());
+      }
+
+
+      PullReq pull_request(Time now) {
+	DataGuard g(this->data_mtx);
+
+	if (!strict_lane.empty()) {
+	  StrictEntry& e = strict_lane.front();
+	  PullReq result;
+	  result.type = NextReqType::returning;
+	  result.data = Retn{e.client,
+			     e.op_class,
+			     std::move(e.request),
+			     PhaseType::priority,
+			     PhaseType::priority};
+	  strict_lane.pop_front();
+	  ++strict_sched_count;
+	  return result;
+	}
+
+	return this->template do_pull_request<Retn>(now);
+      }
+
+
+      bool empty() const {
+	DataGuard g(this->data_mtx);
+	return strict_lane.empty() && 0 == this->request_total;
+      }
+
+
+      size_t request_count() const {
+	DataGuard g(this->data_mtx);
+	return strict_lane.size() + this->request_total;
+      }
+
+
+      size_t class_count() const {
+	DataGuard g(this->data_mtx);
+	return this->group_map.size();
+      }
+    }; // class PullClassQueue
+
+  } // namespace dmclock
+} // namespace crimson
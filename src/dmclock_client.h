@@ -10,6 +10,7 @@
 
 #include <map>
 #include <deque>
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include <mutex>
@@ -30,12 +31,24 @@ namespace crimson {
       uint32_t  my_delta;
       uint32_t  my_rho;
 
+      // the client's backlog at the server as of its last LoadHint,
+      // plus requests sent since, and when its head request was due
+      uint32_t  load_depth;
+      Time      load_due;
+
+      // the limit tag the server will have given the client's last
+      // request, mirrored for limit pacing
+      Time      limit_tag;
+
       ServerInfo(Counter _delta_prev_req,
 		 Counter _rho_prev_req) :
 	delta_prev_req(_delta_prev_req),
 	rho_prev_req(_rho_prev_req),
 	my_delta(0),
-	my_rho(0)
+	my_rho(0),
+	load_depth(0),
+	load_due(TimeZero),
+	limit_tag(TimeZero)
       {
 	// empty
       }
@@ -58,6 +71,7 @@ namespace crimson {
     template<typename S>
     class ServiceTracker {
       FRIEND_TEST(dmclock_client, server_erase);
+      FRIEND_TEST(dmclock_client, server_erase_executor);
 
       using TimePoint = decltype(std::chrono::steady_clock::now());
       using Duration = std::chrono::milliseconds;
@@ -68,6 +82,14 @@ namespace crimson {
       std::map<S,ServerInfo>  server_map;
       mutable std::mutex      data_mtx;      // protects Counters and map
 
+      // requests the client lets queue at a server; 0 disables pacing
+      uint32_t                pacing_depth = 0;
+
+      // the client's own limit and how far ahead of its limit tag a
+      // request may be sent; 0 limit_inv disables limit pacing
+      double                  limit_inv = 0.0;
+      double                  limit_lookahead = 0.0;
+
       using DataGuard = std::lock_guard<decltype(data_mtx)>;
 
       // clean config
@@ -109,6 +131,33 @@ namespace crimson {
       }
 
 
+      // these versions start no thread; the cleaning job runs on the
+      // executor, which must outlive the tracker
+      template<typename Rep, typename Per>
+      ServiceTracker(TimerExecutor& executor,
+		     std::chrono::duration<Rep,Per> _clean_every,
+		     std::chrono::duration<Rep,Per> _clean_age) :
+	delta_counter(1),
+	rho_counter(1),
+	clean_age(std::chrono::duration_cast<Duration>(_clean_age))
+      {
+	cleaning_job =
+	  std::unique_ptr<RunEvery>(
+	    new RunEvery(executor,
+			 _clean_every,
+			 std::bind(&ServiceTracker::do_clean, this)));
+      }
+
+
+      ServiceTracker(TimerExecutor& executor) :
+	ServiceTracker(executor,
+		       std::chrono::minutes(5),
+		       std::chrono::minutes(10))
+      {
+	// empty
+      }
+
+
       /*
        * Incorporates the RespParams received into the various counter.
        */
@@ -134,6 +183,102 @@ namespace crimson {
       }
 
 
+      /*
+       * As above, also noting the LoadHint the server returned.
+       */
+      void track_resp(const S& server_id,
+		      const PhaseType& phase,
+		      const LoadHint& load) {
+	track_resp(server_id, phase);
+	track_load(server_id, load);
+      }
+
+
+      /*
+       * Notes the client's backlog at the server, as reported in a
+       * LoadHint, for pacing; see set_pacing_depth.
+       */
+      void track_load(const S& server_id, const LoadHint& load) {
+	DataGuard g(data_mtx);
+	auto it = server_map.find(server_id);
+	if (server_map.end() == it) {
+	  return;
+	}
+	it->second.load_depth = load.queue_depth;
+	it->second.load_due =
+	  load.delay > 0.0 ? get_time() + load.delay : TimeZero;
+      }
+
+
+      /*
+       * With pacing, the client holds back requests to a server at
+       * which depth or more of its requests are queued, so that they
+       * wait on the client rather than in the server's memory. It
+       * needs the servers' LoadHints (see track_load).
+       */
+      void set_pacing_depth(uint32_t depth) {
+	DataGuard g(data_mtx);
+	pacing_depth = depth;
+      }
+
+
+      /*
+       * With limit pacing, the client holds back a request until the
+       * limit tag the server would give it is within lookahead
+       * seconds, so the server only queues work it can schedule
+       * soon. The tag is computed as the server would, from the
+       * client's limit (its ClientInfo limit, in ops/sec; 0 disables
+       * limit pacing) and the delta sent with each request.
+       */
+      void set_limit_pacing(double limit, double lookahead) {
+	DataGuard g(data_mtx);
+	limit_inv = 0.0 == limit ? 0.0 : 1.0 / limit;
+	limit_lookahead = lookahead;
+      }
+
+
+      /*
+       * Returns when the client should send its next request to the
+       * server: TimeZero for now, TimeMax to wait for a response from
+       * it, or the time its limit allows. A client queued at the
+       * server with its head request not yet eligible is told to wait
+       * until it is. This only reads the tracker's state; a head
+       * request whose due time has passed counts as dispatched until
+       * the next LoadHint replaces the depth.
+       */
+      Time get_send_after(const S& server) const {
+	return get_send_after(server, get_time());
+      }
+
+
+      // as above, at the given time
+      Time get_send_after(const S& server, const Time now) const {
+	DataGuard g(data_mtx);
+	auto it = server_map.find(server);
+	if (server_map.end() == it) {
+	  return TimeZero;
+	}
+
+	const ServerInfo& si = it->second;
+	Time result = TimeZero;
+	if (0.0 != limit_inv) {
+	  Time tag = next_limit_tag(si, now);
+	  if (tag - limit_lookahead > now) {
+	    result = tag - limit_lookahead;
+	  }
+	}
+	if (0 == pacing_depth || si.load_depth < pacing_depth) {
+	  return result;
+	}
+
+	if (TimeZero != si.load_due && si.load_due <= now) {
+	  // the server has likely dispatched the head request by now
+	  return si.load_depth - 1 < pacing_depth ? result : TimeMax;
+	}
+	return std::max(result, TimeZero != si.load_due ? si.load_due : TimeMax);
+      }
+
+
       /*
        * Returns the ReqParams for the given server.
        */
@@ -141,7 +286,11 @@ namespace crimson {
 	DataGuard g(data_mtx);
 	auto it = server_map.find(server);
 	if (server_map.end() == it) {
-	  server_map.emplace(server, ServerInfo(delta_counter, rho_counter));
+	  auto ins =
+	    server_map.emplace(server, ServerInfo(delta_counter, rho_counter));
+	  if (0.0 != limit_inv) {
+	    ins.first->second.limit_tag = get_time();
+	  }
 	  return ReqParams(1, 1);
 	} else {
 	  Counter delta =
@@ -149,7 +298,13 @@ namespace crimson {
 	  Counter rho =
 	    1 + rho_counter - it->second.rho_prev_req - it->second.my_rho;
 
+	  if (0.0 != limit_inv) {
+	    it->second.limit_tag = next_limit_tag(it->second, get_time());
+	  }
 	  it->second.req_update(delta_counter, rho_counter);
+	  if (pacing_depth > 0) {
+	    ++it->second.load_depth;
+	  }
 
 	  return ReqParams(uint32_t(delta), uint32_t(rho));
 	}
@@ -157,6 +312,16 @@ namespace crimson {
 
     private:
 
+      // the limit tag the server would give the next request, with
+      // the same delta get_req_params would send
+      Time next_limit_tag(const ServerInfo& si, const Time& now) const {
+	if (TimeZero == si.limit_tag) {
+	  return now;
+	}
+	Counter delta = 1 + delta_counter - si.delta_prev_req - si.my_delta;
+	return std::max(si.limit_tag + delta * limit_inv, now);
+      }
+
       /*
        * This is being called regularly by RunEvery. Every time it's
        * called it notes the time and delta counter (mark point) in a
@@ -0,0 +1,253 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#pragma once
+
+/* A C++20 coroutine interface to the pull priority queue; the rest of
+ * the library remains C++11, and this header is empty unless compiled
+ * as C++20 or later.
+ *
+ * A coroutine that does "co_await queue.next()" resumes with the Retn
+ * of the next request the queue schedules. If none can be scheduled
+ * now it is suspended, and it is resumed directly by the thread that
+ * makes a request schedulable. An add_request* call does so at once.
+ * For a queued request whose reservation or limit time has not come,
+ * a queue given a TimerExecutor schedules resume_waiters on it for
+ * that time; otherwise the event loop must call resume_waiters when
+ * get_ready_fd becomes readable. Waiters are resumed in the order
+ * they suspended, and no thread is created for the queue.
+ */
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <optional>
+
+#include "dmclock_server.h"
+#include "timer_executor.h"
+
+
+namespace crimson {
+
+  namespace dmclock {
+
+    template<typename C, typename R, uint B=2>
+    class CoroutinePullQueue : public PullPriorityQueue<C,R,B> {
+      using super = PullPriorityQueue<C,R,B>;
+
+    public:
+
+      using Retn = typename super::PullReq::Retn;
+
+    protected:
+
+      struct Waiter {
+	std::coroutine_handle<> handle;
+	std::optional<Retn>*    retn;
+      };
+
+      // waiters_mtx is taken before the queue's data_mtx
+      std::mutex         waiters_mtx;
+      std::deque<Waiter> waiters;
+
+      // if set, resume_waiters runs on it when a request comes due
+      TimerExecutor*       executor = nullptr;
+      TimerExecutor::JobId wake_job = 0;
+
+    public:
+
+      class NextAwaitable {
+	friend CoroutinePullQueue;
+
+	CoroutinePullQueue& queue;
+	std::optional<Retn> retn;
+
+	NextAwaitable(CoroutinePullQueue& _queue) :
+	  queue(_queue)
+	{
+	  // empty
+	}
+
+      public:
+
+	bool await_ready() {
+	  return false;
+	}
+
+	// re-checks and registers under waiters_mtx so an add_request
+	// racing with the suspension can't be missed
+	bool await_suspend(std::coroutine_handle<> handle) {
+	  std::lock_guard<std::mutex> g(queue.waiters_mtx);
+	  if (queue.waiters.empty()) {
+	    auto pr = queue.pull_request();
+	    if (pr.is_retn()) {
+	      retn.emplace(std::move(pr.get_retn()));
+	      return false;
+	    }
+	    if (pr.is_future()) {
+	      queue.wake_at(pr.getTime());
+	    }
+	  }
+	  queue.waiters.push_back(Waiter{handle, &retn});
+	  return true;
+	}
+
+	Retn await_resume() {
+	  return std::move(*retn);
+	}
+      }; // class NextAwaitable
+
+
+      // without an executor, the event loop resumes waiters on
+      // requests that come due; see resume_waiters
+      CoroutinePullQueue(typename super::ClientInfoFunc _client_info_f,
+			 bool _allow_limit_break = false) :
+	super(_client_info_f, _allow_limit_break)
+      {
+	// empty
+      }
+
+
+      template<typename Rep, typename Per>
+      CoroutinePullQueue(typename super::ClientInfoFunc _client_info_f,
+			 std::chrono::duration<Rep,Per> _idle_age,
+			 std::chrono::duration<Rep,Per> _erase_age,
+			 std::chrono::duration<Rep,Per> _check_time,
+			 bool _allow_limit_break = false) :
+	super(_client_info_f,
+	      _idle_age, _erase_age, _check_time,
+	      _allow_limit_break)
+      {
+	// empty
+      }
+
+
+      // these versions resume waiters on requests that come due on
+      // the executor's threads, and clean on it as well; the
+      // executor must outlive the queue
+      CoroutinePullQueue(typename super::ClientInfoFunc _client_info_f,
+			 TimerExecutor& _executor,
+			 bool _allow_limit_break = false) :
+	super(_client_info_f, _executor, _allow_limit_break)
+      {
+	add_wake_job(_executor);
+      }
+
+
+      template<typename Rep, typename Per>
+      CoroutinePullQueue(typename super::ClientInfoFunc _client_info_f,
+			 TimerExecutor& _executor,
+			 std::chrono::duration<Rep,Per> _idle_age,
+			 std::chrono::duration<Rep,Per> _erase_age,
+			 std::chrono::duration<Rep,Per> _check_time,
+			 bool _allow_limit_break = false) :
+	super(_client_info_f,
+	      _executor,
+	      _idle_age, _erase_age, _check_time,
+	      _allow_limit_break)
+      {
+	add_wake_job(_executor);
+      }
+
+
+      ~CoroutinePullQueue() {
+	if (executor) {
+	  executor->cancel(wake_job);
+	}
+      }
+
+
+      // the awaitable is meant to be co_awaited at once
+      NextAwaitable next() {
+	return NextAwaitable(*this);
+      }
+
+
+      // every public way of adding a request is wrapped, so that any
+      // add resumes waiters
+
+      template<typename... Args>
+      void add_request(Args&&... args) {
+	super::add_request(std::forward<Args>(args)...);
+	resume_waiters();
+      }
+
+
+      template<typename... Args>
+      void add_request_time(Args&&... args) {
+	super::add_request_time(std::forward<Args>(args)...);
+	resume_waiters();
+      }
+
+
+      template<typename... Args>
+      void add_request_deadline(Args&&... args) {
+	super::add_request_deadline(std::forward<Args>(args)...);
+	resume_waiters();
+      }
+
+
+      // hands schedulable requests to suspended coroutines, resuming
+      // them on the calling thread; without an executor, call this
+      // when get_ready_fd becomes readable so waiters blocked on a
+      // reservation or limit time are resumed
+      void resume_waiters() {
+	while (true) {
+	  std::unique_lock<std::mutex> l(waiters_mtx);
+	  if (waiters.empty()) {
+	    return;
+	  }
+	  auto pr = super::pull_request();
+	  if (!pr.is_retn()) {
+	    if (pr.is_future()) {
+	      wake_at(pr.getTime());
+	    }
+	    return;
+	  }
+	  Waiter w = waiters.front();
+	  waiters.pop_front();
+	  w.retn->emplace(std::move(pr.get_retn()));
+	  l.unlock();
+	  w.handle.resume();
+	}
+      }
+
+
+      size_t waiter_count() {
+	std::lock_guard<std::mutex> g(waiters_mtx);
+	return waiters.size();
+      }
+
+    protected:
+
+      void add_wake_job(TimerExecutor& _executor) {
+	executor = &_executor;
+	wake_job = executor->add_job(
+	  std::bind(&CoroutinePullQueue::resume_waiters, this));
+      }
+
+
+      // waiters_mtx must be held by caller; an early wake, as the
+      // clocks can drift, finds the request still due later and
+      // schedules another
+      void wake_at(Time when) {
+	if (executor) {
+	  executor->schedule_at(wake_job,
+				super::executor_time(when, get_time()));
+	}
+      }
+    }; // class CoroutinePullQueue
+
+  } // namespace dmclock
+} // namespace crimson
+
+#endif // C++20 coroutines
@@ -0,0 +1,160 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#pragma once
+
+/* PullQueueGroup is a set of PullPriorityQueues, one per worker shard,
+ * whose workers steal from one another. A worker pulls from its own
+ * shard first; if that has nothing schedulable now, it looks at up to
+ * max_probe sibling shards and takes the request that comes first in
+ * dmclock order (reservation-phase requests before weight-phase ones,
+ * then by tag, since all shards share a clock). Siblings in use by
+ * another thread are skipped rather than waited on, which bounds the
+ * contention a stealing worker adds.
+ *
+ * A stolen request is still charged to its client in its own shard,
+ * so each client's tags stay in one queue.
+ */
+
+#include <assert.h>
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+#include "dmclock_server.h"
+
+
+namespace crimson {
+
+  namespace dmclock {
+
+    template<typename C, typename R, uint B=2>
+    class PullQueueGroup {
+
+    public:
+
+      using Queue = PullPriorityQueue<C,R,B>;
+      using PullReq = typename Queue::PullReq;
+      using ClientInfoFunc = typename Queue::ClientInfoFunc;
+
+    protected:
+
+      struct Shard {
+	Queue               queue;
+	std::atomic<size_t> steal_count;  // requests its worker stole
+	std::atomic<size_t> stolen_count; // requests stolen from it
+
+	Shard(ClientInfoFunc client_info_f, bool allow_limit_break) :
+	  queue(client_info_f, allow_limit_break),
+	  steal_count(0),
+	  stolen_count(0)
+	{
+	  // empty
+	}
+      };
+
+      std::vector<std::unique_ptr<Shard>> shards;
+      const size_t max_probe;
+
+    public:
+
+      // max_probe of 0 lets a worker look at every sibling
+      PullQueueGroup(size_t shard_count,
+		     ClientInfoFunc client_info_f,
+		     bool allow_limit_break = false,
+		     size_t _max_probe = 0) :
+	max_probe(0 == _max_probe ? shard_count - 1 :
+		  std::min(_max_probe, shard_count - 1))
+      {
+	assert(shard_count > 0);
+	for (size_t i = 0; i < shard_count; ++i) {
+	  shards.emplace_back(new Shard(client_info_f, allow_limit_break));
+	}
+      }
+
+
+      size_t shard_count() const {
+	return shards.size();
+      }
+
+
+      // requests are added to, and completions reported to, the shard
+      // the client is placed in
+      Queue& get_shard(size_t shard) {
+	return shards[shard]->queue;
+      }
+
+
+      inline PullReq pull_request(size_t shard) {
+	return pull_request(shard, get_time());
+      }
+
+
+      // called by shard's worker; if neither its shard nor any probed
+      // sibling can return a request, the result of its own shard is
+      // returned
+      PullReq pull_request(size_t shard, Time now) {
+	PullReq result = shards[shard]->queue.pull_request(now);
+	if (result.is_retn()) {
+	  return result;
+	}
+
+	// probe siblings, starting with the next, for the best request
+	const size_t count = shards.size();
+	size_t victim = count;
+	PhaseType best_phase = PhaseType::priority;
+	double best_tag = max_tag;
+	for (size_t k = 1; k <= max_probe; ++k) {
+	  const size_t j = (shard + k) % count;
+	  PhaseType phase;
+	  double tag;
+	  if (shards[j]->queue.try_peek_request(now, phase, tag) &&
+	      (count == victim ||
+	       precedes(phase, tag, best_phase, best_tag))) {
+	    victim = j;
+	    best_phase = phase;
+	    best_tag = tag;
+	  }
+	}
+
+	if (count != victim) {
+	  PullReq stolen = shards[victim]->queue.try_pull_request(now);
+	  if (stolen.is_retn()) {
+	    ++shards[shard]->steal_count;
+	    ++shards[victim]->stolen_count;
+	    return stolen;
+	  }
+	}
+
+	return result;
+      }
+
+
+      size_t get_steal_count(size_t shard) const {
+	return shards[shard]->steal_count;
+      }
+
+      size_t get_stolen_count(size_t shard) const {
+	return shards[shard]->stolen_count;
+      }
+
+    protected:
+
+      static bool precedes(PhaseType phase1, double tag1,
+			   PhaseType phase2, double tag2) {
+	if (phase1 != phase2) {
+	  return PhaseType::reservation == phase1;
+	}
+	return tag1 < tag2;
+      }
+    }; // class PullQueueGroup
+
+  } // namespace dmclock
+} // namespace crimson
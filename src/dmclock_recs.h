@@ -44,12 +44,8 @@ namespace crimson {
 	// empty
       }
 
-      ReqParams(const ReqParams& other) :
-	delta(other.delta),
-	rho(other.rho)
-      {
-	// empty
-      }
+      ReqParams(const ReqParams& other) = default;
+      ReqParams& operator=(const ReqParams& other) = default;
 
       friend std::ostream& operator<<(std::ostream& out, const ReqParams& rp) {
 	out << "ReqParams{ delta:" << rp.delta <<
@@ -57,5 +53,27 @@ namespace crimson {
 	return out;
       }
     }; // class ReqParams
+
+
+    // a summary of a client's backlog at a server, which the server
+    // may return along with the PhaseType of a response so the client
+    // can pace its requests; see ServiceTracker::set_pacing_depth
+    struct LoadHint {
+      uint32_t queue_depth; // the client's requests queued at the server
+      float    delay;       // seconds until the first of them is eligible
+
+      LoadHint(uint32_t _queue_depth = 0, float _delay = 0.0) :
+	queue_depth(_queue_depth),
+	delay(_delay)
+      {
+	// empty
+      }
+
+      friend std::ostream& operator<<(std::ostream& out, const LoadHint& lh) {
+	out << "LoadHint{ queue_depth:" << lh.queue_depth <<
+	  ", delay:" << lh.delay << " }";
+	return out;
+      }
+    }; // struct LoadHint
   }
 }
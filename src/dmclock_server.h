@@ -28,9 +28,10 @@
 
 #include <cmath>
 #include <memory>
+#include <functional>
 #include <map>
 #include <deque>
-#include <queue>
+#include <algorithm>
 #include <atomic>
 #include <mutex>
 #include <condition_variable>
@@ -41,7 +42,15 @@
 
 #include <boost/variant.hpp>
 
+#ifdef __linux__
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#endif
+
 #include "indirect_intrusive_heap.h"
+#include "numa_arena.h"
+#include "top_k.h"
 #include "run_every.h"
 #include "dmclock_util.h"
 #include "dmclock_recs.h"
@@ -67,10 +76,26 @@ namespace crimson {
       std::numeric_limits<double>::lowest();
     constexpr uint tag_modulo = 1000000;
 
+    // a reservation and limit in bytes per second, for a client
+    // scheduled by bandwidth as well as by ops; 0.0 means none
+    struct BandwidthInfo {
+      const double reservation;
+      const double limit;
+
+      BandwidthInfo(double _reservation, double _limit) :
+	reservation(_reservation),
+	limit(_limit)
+      {
+	// empty
+      }
+    }; // struct BandwidthInfo
+
+
     struct ClientInfo {
       const double reservation;  // minimum
       const double weight;       // proportional
       const double limit;        // maximum
+      const double burst;        // requests allowed above limit after a pause
 
       // multiplicative inverses of above, which we use in calculations
       // and don't want to recalculate repeatedly
@@ -78,68 +103,383 @@ namespace crimson {
       const double weight_inv;
       const double limit_inv;
 
-      // order parameters -- min, "normal", max
-      ClientInfo(double _reservation, double _weight, double _limit) :
+      // how far behind the current time limit tags may lag
+      const double limit_lag;
+
+      // bandwidth reservation and limit (bytes/sec), as inverses;
+      // both 0.0 unless given a BandwidthInfo
+      const double bw_reservation_inv;
+      const double bw_limit_inv;
+
+      // order parameters -- min, "normal", max; a client that has
+      // used less than its limit may then send up to burst requests
+      // beyond it at full speed, while its long-term rate still
+      // cannot exceed limit
+      ClientInfo(double _reservation,
+		 double _weight,
+		 double _limit,
+		 double _burst = 0.0) :
+	ClientInfo(_reservation, _weight, _limit,
+		   BandwidthInfo(0.0, 0.0), _burst)
+      {
+	// empty
+      }
+
+      // as above with a bandwidth reservation and limit as well; the
+      // client is owed its reservation while behind in either ops or
+      // bytes, and is within its limit only when within both. Bytes
+      // come from the queue's RequestBytesFunc.
+      ClientInfo(double _reservation,
+		 double _weight,
+		 double _limit,
+		 const BandwidthInfo& _bandwidth,
+		 double _burst = 0.0) :
 	reservation(_reservation),
 	weight(_weight),
 	limit(_limit),
+	burst(_burst),
 	reservation_inv(0.0 == reservation ? 0.0 : 1.0 / reservation),
 	weight_inv(     0.0 == weight      ? 0.0 : 1.0 / weight),
-	limit_inv(      0.0 == limit       ? 0.0 : 1.0 / limit)
+	limit_inv(      0.0 == limit       ? 0.0 : 1.0 / limit),
+	limit_lag(burst * limit_inv),
+	bw_reservation_inv(0.0 == _bandwidth.reservation ?
+			   0.0 : 1.0 / _bandwidth.reservation),
+	bw_limit_inv(0.0 == _bandwidth.limit ? 0.0 : 1.0 / _bandwidth.limit)
       {
 	// empty
       }
 
 
+      inline bool has_bandwidth() const {
+	return 0.0 != bw_reservation_inv || 0.0 != bw_limit_inv;
+      }
+
+
       friend std::ostream& operator<<(std::ostream& out,
 				      const ClientInfo& client) {
 	out <<
 	  "{ ClientInfo:: r:" << client.reservation <<
 	  " w:" << std::fixed << client.weight <<
 	  " l:" << std::fixed << client.limit <<
+	  " b:" << std::fixed << client.burst <<
 	  " 1/r:" << std::fixed << client.reservation_inv <<
 	  " 1/w:" << std::fixed << client.weight_inv <<
-	  " 1/l:" << std::fixed << client.limit_inv <<
-	  " }";
+	  " 1/l:" << std::fixed << client.limit_inv;
+	if (client.has_bandwidth()) {
+	  out <<
+	    " 1/bw_r:" << client.bw_reservation_inv <<
+	    " 1/bw_l:" << client.bw_limit_inv;
+	}
+	out << " }";
 	return out;
       }
     }; // class ClientInfo
 
 
+    // A cost model for requests that vary in size. Each request costs
+    // a fixed per-op device time plus its bytes over the device
+    // bandwidth, normalized so that a request of unit_bytes costs 1.0;
+    // the rates in ClientInfo are then in units of such requests.
+    struct SizeCost {
+      const double op_time;    // seconds of device time per request
+      const double bandwidth;  // bytes per second
+      const double unit_time;  // device time of a unit_bytes request
+
+      SizeCost(double _op_time, double _bandwidth, uint64_t _unit_bytes) :
+	op_time(_op_time),
+	bandwidth(_bandwidth),
+	unit_time(_op_time + _unit_bytes / _bandwidth)
+      {
+	assert(_bandwidth > 0.0 && unit_time > 0.0);
+      }
+
+      double operator()(uint64_t bytes) const {
+	return (op_time + bytes / bandwidth) / unit_time;
+      }
+    }; // struct SizeCost
+
+
+    // An adaptive limit on the number of requests a PushPriorityQueue
+    // keeps outstanding at the server, adjusted by additive increase
+    // and multiplicative decrease on completion latency. Latencies
+    // within tolerance times the lowest recently seen (the unloaded
+    // latency) while the limit was the bottleneck grow the limit by
+    // one per limit's worth of completions; a latency beyond that
+    // means requests are queueing inside the server, out of the
+    // scheduler's control, and shrinks the limit by backoff, at most
+    // once per limit's worth of completions.
+    class AimdConcurrency {
+      const double min_limit;
+      const double max_limit;
+      const double tolerance;
+      const double backoff;
+      const size_t min_window; // completions per unloaded-latency sample
+
+      double limit;
+      size_t in_flight = 0;
+      size_t since_backoff = 0;
+
+      Time   min_latency = TimeMax;
+      Time   window_min_latency = TimeMax;
+      size_t window_count = 0;
+
+    public:
+
+      AimdConcurrency(size_t _min_limit,
+		      size_t _max_limit,
+		      double _tolerance = 1.5,
+		      double _backoff = 0.9,
+		      size_t _min_window = 1000) :
+	min_limit(_min_limit),
+	max_limit(_max_limit),
+	tolerance(_tolerance),
+	backoff(_backoff),
+	min_window(_min_window),
+	limit(_min_limit)
+      {
+	assert(0 < _min_limit && _min_limit <= _max_limit);
+	assert(1.0 < _tolerance && 0.0 < _backoff && _backoff < 1.0);
+      }
+
+      bool can_dispatch() const {
+	return in_flight < size_t(limit);
+      }
+
+      void dispatched() {
+	++in_flight;
+      }
+
+      // a completion whose latency is not known; frees its slot
+      // without adjusting the limit
+      void released() {
+	if (in_flight > 0) {
+	  --in_flight;
+	}
+      }
+
+      // latency is from dispatch to completion
+      void completed(Time latency) {
+	const bool limited = in_flight >= size_t(limit);
+	if (in_flight > 0) {
+	  --in_flight;
+	}
+
+	// the unloaded latency is re-estimated every window so that it
+	// can rise if the device itself becomes slower
+	window_min_latency = std::min(window_min_latency, latency);
+	if (++window_count >= min_window || latency < min_latency) {
+	  min_latency = window_min_latency;
+	  if (window_count >= min_window) {
+	    window_min_latency = TimeMax;
+	    window_count = 0;
+	  }
+	}
+
+	++since_backoff;
+	if (latency > tolerance * min_latency) {
+	  if (since_backoff >= size_t(limit)) {
+	    limit = std::max(min_limit, limit * backoff);
+	    since_backoff = 0;
+	  }
+	} else if (limited) {
+	  limit = std::min(max_limit, limit + 1.0 / limit);
+	}
+      }
+
+      size_t get_limit() const { return size_t(limit); }
+      size_t get_in_flight() const { return in_flight; }
+    }; // class AimdConcurrency
+
+
+    // a snapshot of one client's record in a queue; see
+    // PriorityQueueBase::get_client_state
+    struct ClientState {
+      uint32_t queue_depth = 0;
+      // tags of the client's head request; max_tag when it has none
+      double   reservation = 0.0;
+      double   proportion = 0.0;
+      double   limit = 0.0;
+      bool     idle = true;
+      double   prop_delta = 0.0;
+      Counter  last_tick = 0;     // tick of the last tag calculated
+      Time     last_active = TimeZero; // last add or dispatch
+      Counter  reservation_count = 0; // dispatches by phase
+      Counter  priority_count = 0;
+
+      friend std::ostream& operator<<(std::ostream& out,
+				      const ClientState& s) {
+	out << "ClientState{ queue_depth:" << s.queue_depth <<
+	  ", r:" << s.reservation << ", p:" << s.proportion <<
+	  ", l:" << s.limit << ", idle:" << (s.idle ? "true" : "false") <<
+	  ", prop_delta:" << s.prop_delta <<
+	  ", last_tick:" << s.last_tick <<
+	  ", last_active:" << s.last_active <<
+	  ", reservation_count:" << s.reservation_count <<
+	  ", priority_count:" << s.priority_count << " }";
+	return out;
+      }
+    }; // struct ClientState
+
+
+    // Publishes a ClientState so it can be read without the queue's
+    // lock. It is a seqlock: the writer, which already holds the
+    // queue's lock, makes the sequence odd while it stores, and a
+    // reader retries if the sequence was odd or changed while it
+    // loaded, so it never sees a torn state.
+    class ClientStateCell {
+      std::atomic<uint64_t> seq;
+      std::atomic<uint32_t> queue_depth;
+      std::atomic<double>   reservation;
+      std::atomic<double>   proportion;
+      std::atomic<double>   limit;
+      std::atomic<bool>     idle;
+      std::atomic<double>   prop_delta;
+      std::atomic<Counter>  last_tick;
+      std::atomic<Time>     last_active;
+      std::atomic<Counter>  reservation_count;
+      std::atomic<Counter>  priority_count;
+
+    public:
+
+      ClientStateCell() : seq(0) {
+	store(ClientState());
+      }
+
+      // stores must not run concurrently with one another
+      void store(const ClientState& s) {
+	const auto r = std::memory_order_relaxed;
+	const uint64_t s0 = seq.load(r);
+	seq.store(s0 + 1, r);
+	std::atomic_thread_fence(std::memory_order_release);
+	queue_depth.store(s.queue_depth, r);
+	reservation.store(s.reservation, r);
+	proportion.store(s.proportion, r);
+	limit.store(s.limit, r);
+	idle.store(s.idle, r);
+	prop_delta.store(s.prop_delta, r);
+	last_tick.store(s.last_tick, r);
+	last_active.store(s.last_active, r);
+	reservation_count.store(s.reservation_count, r);
+	priority_count.store(s.priority_count, r);
+	seq.store(s0 + 2, std::memory_order_release);
+      }
+
+      ClientState load() const {
+	const auto r = std::memory_order_relaxed;
+	ClientState s;
+	while (true) {
+	  const uint64_t s0 = seq.load(std::memory_order_acquire);
+	  if (s0 & 1) {
+	    std::this_thread::yield();
+	    continue;
+	  }
+	  s.queue_depth = queue_depth.load(r);
+	  s.reservation = reservation.load(r);
+	  s.proportion = proportion.load(r);
+	  s.limit = limit.load(r);
+	  s.idle = idle.load(r);
+	  s.prop_delta = prop_delta.load(r);
+	  s.last_tick = last_tick.load(r);
+	  s.last_active = last_active.load(r);
+	  s.reservation_count = reservation_count.load(r);
+	  s.priority_count = priority_count.load(r);
+	  std::atomic_thread_fence(std::memory_order_acquire);
+	  if (seq.load(r) == s0) {
+	    return s;
+	  }
+	}
+      }
+    }; // class ClientStateCell
+
+
+    // what PriorityQueueBase::get_heavy_hitters ranks clients by
+    enum class HitterMeasure { added, dispatched, cost };
+
+
     struct RequestTag {
       double reservation;
       double proportion;
       double limit;
       bool   ready; // true when within limit
+      bool   bandwidth; // has a bandwidth dimension; see BandwidthInfo
 #ifndef DO_NOT_DELAY_TAG_CALC
       Time   arrival;
 #endif
 
+      // the per-dimension tags combined into reservation (the earlier
+      // of the two) and limit (the later); only kept with bandwidth
+      double ops_reservation;
+      double ops_limit;
+      double bw_reservation;
+      double bw_limit;
+
+      // addl_cost is added to the reservation tag alone; cost scales
+      // this request's share of all three tag increments; bytes
+      // advance the bandwidth tags, if the client has them
       RequestTag(const RequestTag& prev_tag,
 		 const ClientInfo& client,
 		 const ReqParams& req_params,
 		 const Time& time,
-		 const double cost = 0.0) :
-	reservation(cost + tag_calc(time,
-				    prev_tag.reservation,
-				    client.reservation_inv,
-				    req_params.rho,
-				    true)),
+		 const double addl_cost = 0.0,
+		 const double cost = 1.0,
+		 const double bytes = 0.0) :
 	proportion(tag_calc(time,
 			    prev_tag.proportion,
 			    client.weight_inv,
 			    req_params.delta,
+			    cost,
 			    true)),
-	limit(tag_calc(time,
-		       prev_tag.limit,
-		       client.limit_inv,
-		       req_params.delta,
-		       false)),
-	ready(false)
+	ready(false),
+	bandwidth(client.has_bandwidth())
 #ifndef DO_NOT_DELAY_TAG_CALC
 	, arrival(time)
 #endif
       {
+	if (!bandwidth) {
+	  reservation = addl_cost + tag_calc(time,
+					     prev_tag.reservation,
+					     client.reservation_inv,
+					     req_params.rho,
+					     cost,
+					     true);
+	  limit = tag_calc(time - client.limit_lag,
+			   prev_tag.limit,
+			   client.limit_inv,
+			   req_params.delta,
+			   cost,
+			   false);
+	  ops_reservation = bw_reservation = reservation;
+	  ops_limit = bw_limit = limit;
+	} else {
+	  const bool prev_bw = prev_tag.bandwidth;
+	  ops_reservation =
+	    addl_cost + tag_calc(time,
+				 prev_bw ? prev_tag.ops_reservation :
+				 prev_tag.reservation,
+				 client.reservation_inv,
+				 req_params.rho,
+				 cost,
+				 true);
+	  ops_limit = tag_calc(time - client.limit_lag,
+			       prev_bw ? prev_tag.ops_limit : prev_tag.limit,
+			       client.limit_inv,
+			       req_params.delta,
+			       cost,
+			       false);
+	  bw_reservation = bytes_tag_calc(time,
+					  prev_bw ? prev_tag.bw_reservation : 0.0,
+					  client.bw_reservation_inv,
+					  req_params.rho,
+					  bytes,
+					  true);
+	  bw_limit = bytes_tag_calc(time,
+				    prev_bw ? prev_tag.bw_limit : 0.0,
+				    client.bw_limit_inv,
+				    req_params.delta,
+				    bytes,
+				    false);
+	  combine();
+	}
 	assert(reservation < max_tag || proportion < max_tag);
       }
 
@@ -147,10 +487,15 @@ namespace crimson {
 	reservation(_res),
 	proportion(_prop),
 	limit(_lim),
-	ready(false)
+	ready(false),
+	bandwidth(false)
 #ifndef DO_NOT_DELAY_TAG_CALC
 	, arrival(_arrival)
 #endif
+	, ops_reservation(_res),
+	ops_limit(_lim),
+	bw_reservation(_res),
+	bw_limit(_lim)
       {
 	assert(reservation < max_tag || proportion < max_tag);
       }
@@ -159,14 +504,37 @@ namespace crimson {
 	reservation(other.reservation),
 	proportion(other.proportion),
 	limit(other.limit),
-	ready(other.ready)
+	ready(other.ready),
+	bandwidth(other.bandwidth)
 #ifndef DO_NOT_DELAY_TAG_CALC
 	, arrival(other.arrival)
 #endif
+	, ops_reservation(other.ops_reservation),
+	ops_limit(other.ops_limit),
+	bw_reservation(other.bw_reservation),
+	bw_limit(other.bw_limit)
       {
 	// empty
       }
 
+      RequestTag& operator=(const RequestTag& other) = default;
+
+      // moves the reservation and limit tags by resv and lim, and,
+      // with bandwidth, the bandwidth tags by bw_resv and bw_lim
+      void shift(double resv, double lim,
+		 double bw_resv = 0.0, double bw_lim = 0.0) {
+	if (!bandwidth) {
+	  reservation += resv;
+	  limit += lim;
+	} else {
+	  ops_reservation += resv;
+	  ops_limit += lim;
+	  bw_reservation += bw_resv;
+	  bw_limit += bw_lim;
+	  combine();
+	}
+      }
+
       static std::string format_tag_change(double before, double after) {
 	if (before == after) {
 	  return std::string("same");
@@ -189,16 +557,45 @@ namespace crimson {
 
     private:
 
+      // reservation is owed while either dimension is behind, and
+      // the limit is met only once both are
+      void combine() {
+	reservation = std::min(ops_reservation, bw_reservation);
+	limit = std::max(ops_limit, bw_limit);
+      }
+
+      // as tag_calc, in bytes; requests completed by other servers
+      // are taken to be the size of this one
+      static double bytes_tag_calc(const Time& time,
+				   double prev,
+				   double increment,
+				   uint32_t dist_req_val,
+				   double bytes,
+				   bool extreme_is_high) {
+	if (0.0 == increment) {
+	  return extreme_is_high ? max_tag : min_tag;
+	} else {
+	  increment *= bytes * std::max<uint32_t>(1, dist_req_val);
+	  return std::max(time, prev + increment);
+	}
+      }
+
+      // dist_req_val counts this request plus those completed by
+      // other servers since the last one here; we can't know the
+      // cost of the latter so they're charged as unit requests
       static double tag_calc(const Time& time,
 			     double prev,
 			     double increment,
 			     uint32_t dist_req_val,
+			     double cost,
 			     bool extreme_is_high) {
 	if (0.0 == increment) {
 	  return extreme_is_high ? max_tag : min_tag;
 	} else {
 	  if (0 != dist_req_val) {
-	    increment *= dist_req_val;
+	    increment *= dist_req_val - 1.0 + cost;
+	  } else {
+	    increment *= cost;
 	  }
 	  return std::max(time, prev + increment);
 	}
@@ -227,6 +624,7 @@ namespace crimson {
     template<typename C, typename R, uint B>
     class PriorityQueueBase {
       FRIEND_TEST(dmclock_server, client_idle_erase);
+      FRIEND_TEST(dmclock_server_pull, pull_deadline_served);
 
     public:
 
@@ -250,15 +648,27 @@ namespace crimson {
 	RequestTag tag;
 	C          client_id;
 	RequestRef request;
+	double     cost;     // in unit requests; see RequestCostFunc
+	Time       deadline; // TimeMax when the request never expires
+	double     bytes;    // see RequestBytesFunc
+	Counter    seq;      // the queue's tick when added
 
       public:
 
 	ClientReq(const RequestTag& _tag,
 		  const C&          _client_id,
-		  RequestRef&&      _request) :
+		  RequestRef&&      _request,
+		  const double      _cost = 1.0,
+		  const Time        _deadline = TimeMax,
+		  const double      _bytes = 0.0,
+		  const Counter     _seq = 0) :
 	  tag(_tag),
 	  client_id(_client_id),
-	  request(std::move(_request))
+	  request(std::move(_request)),
+	  cost(_cost),
+	  deadline(_deadline),
+	  bytes(_bytes),
+	  seq(_seq)
 	{
 	  // empty
 	}
@@ -281,12 +691,18 @@ namespace crimson {
 
 	C                     client;
 	RequestTag            prev_tag;
-	std::deque<ClientReq> requests;
+	std::deque<ClientReq,NumaAllocator<ClientReq>> requests;
 
 	// amount added from the proportion tag as a result of
 	// an idle client becoming unidle
 	double                prop_delta = 0.0;
 
+	// see get_client_state
+	Time                  last_active = TimeZero;
+	Counter               reservation_count = 0;
+	Counter               priority_count = 0;
+	ClientStateCell*      state = nullptr; // set once publishing
+
 	c::IndIntruHeapData   reserv_heap_data;
 	c::IndIntruHeapData   lim_heap_data;
 	c::IndIntruHeapData   ready_heap_data;
@@ -304,9 +720,11 @@ namespace crimson {
 
 	ClientRec(C _client,
 		  const ClientInfo& _info,
-		  Counter current_tick) :
+		  Counter current_tick,
+		  NumaArena* arena) :
 	  client(_client),
 	  prev_tag(0.0, 0.0, 0.0, TimeZero),
+	  requests(NumaAllocator<ClientReq>(arena)),
 	  info(_info),
 	  idle(true),
 	  last_tick(current_tick),
@@ -331,13 +749,41 @@ namespace crimson {
 	  assign_unpinned_tag(prev_tag.reservation, _prev.reservation);
 	  assign_unpinned_tag(prev_tag.limit, _prev.limit);
 	  assign_unpinned_tag(prev_tag.proportion, _prev.proportion);
+	  prev_tag.bandwidth = _prev.bandwidth;
+	  if (_prev.bandwidth) {
+	    assign_unpinned_tag(prev_tag.ops_reservation, _prev.ops_reservation);
+	    assign_unpinned_tag(prev_tag.ops_limit, _prev.ops_limit);
+	    assign_unpinned_tag(prev_tag.bw_reservation, _prev.bw_reservation);
+	    assign_unpinned_tag(prev_tag.bw_limit, _prev.bw_limit);
+	  }
 	  last_tick = _tick;
 	}
 
 	inline void add_request(const RequestTag& tag,
 				const C&          client_id,
-				RequestRef&&      request) {
-	  requests.emplace_back(ClientReq(tag, client_id, std::move(request)));
+				RequestRef&&      request,
+				const double      cost = 1.0,
+				const Time        deadline = TimeMax,
+				const double      bytes = 0.0,
+				const Counter     seq = 0) {
+	  requests.emplace_back(ClientReq(tag,
+					  client_id,
+					  std::move(request),
+					  cost,
+					  deadline,
+					  bytes,
+					  seq));
+	}
+
+	// the queued request added with seq, or nullptr once it has been
+	// dispatched or removed; requests stay in seq order, so this is
+	// a binary search
+	const ClientReq* find_request(Counter seq) const {
+	  auto i = std::lower_bound(requests.begin(), requests.end(), seq,
+				    [] (const ClientReq& r, Counter s) -> bool {
+				      return r.seq < s;
+				    });
+	  return (requests.end() == i || i->seq != seq) ? nullptr : &*i;
 	}
 
 	inline const ClientReq& next_request() const {
@@ -431,7 +877,9 @@ namespace crimson {
       enum class NextReqType { returning, future, none };
 
       // specifies which queue next request will get popped from
-      enum class HeapId { reservation, ready };
+      // run refers to the client whose run of proportional-phase
+      // dispatches is being continued
+      enum class HeapId { reservation, ready, run };
 
       // this is returned from next_req to tell the caller the situation
       struct NextReq {
@@ -440,12 +888,38 @@ namespace crimson {
 	  HeapId    heap_id;
 	  Time      when_ready;
 	};
+	// a returning request that is past its limit; see
+	// note_dispatch
+	bool        limit_break = false;
       };
 
 
       // a function that can be called to look up client information
       using ClientInfoFunc = std::function<ClientInfo(const C&)>;
 
+      // a function that is handed each request dropped because its
+      // deadline passed before it could be dispatched
+      using RequestExpiredFunc = std::function<void(const C&,RequestRef)>;
+
+      // a function giving a request's cost in unit requests, which
+      // scales how far it advances its client's reservation,
+      // proportion, and limit tags; see SizeCost for a size-based one
+      using RequestCostFunc = std::function<double(const R&)>;
+
+      // a function giving a request's size in bytes, which advances
+      // the bandwidth tags of clients that have them (see
+      // BandwidthInfo); without one requests have no size
+      using RequestBytesFunc = std::function<uint64_t(const R&)>;
+
+      // a predicate telling whether a newly added request (second
+      // parameter) may be merged into its client's tail request
+      // (first parameter), e.g., because the two are adjacent writes
+      using RequestCanMergeFunc = std::function<bool(const R&,const R&)>;
+
+      // merges a newly added request (second parameter) into its
+      // client's tail request (first parameter)
+      using RequestMergeFunc = std::function<void(R&,R&)>;
+
 
       bool empty() const {
 	DataGuard g(data_mtx);
@@ -469,6 +943,123 @@ namespace crimson {
       }
 
 
+      // the client's backlog here, for the server to return with a
+      // response to it; the delay is until the client's first queued
+      // request is eligible by reservation or within its limit
+      LoadHint get_load_hint(const C& client_id) const {
+	return get_load_hint(client_id, get_time());
+      }
+
+
+      LoadHint get_load_hint(const C& client_id, Time now) const {
+	DataGuard g(data_mtx);
+	auto it = client_map.find(client_id);
+	if (client_map.end() == it || !it->second->has_request()) {
+	  return LoadHint();
+	}
+	const ClientRec& client = *it->second;
+	const RequestTag& tag = client.next_request().tag;
+	Time when = tag.reservation;
+	if (tag.proportion < max_tag) {
+	  when = std::min(when, std::max(tag.limit, now));
+	}
+	return LoadHint(uint32_t(client.request_count()),
+			float(std::max(0.0, when - now)));
+      }
+
+
+      // a client and its estimated total; see SpaceSaving
+      using HeavyHitter = typename c::SpaceSaving<C>::Entry;
+
+
+      // With capacity > 0, keeps fixed-size sketches of the clients
+      // with the most requests added, the most dispatched, and the
+      // most cost dispatched, each tracking capacity clients at
+      // O(log capacity) per request; 0 (the default) turns them off.
+      // Counts restart whenever this is called.
+      void set_heavy_hitters(size_t capacity) {
+	DataGuard g(data_mtx);
+	if (capacity > 0) {
+	  heavy_hitters.reset(new HeavyHitters(capacity));
+	} else {
+	  heavy_hitters.reset();
+	}
+      }
+
+
+      // the k clients with the largest estimated totals by measure,
+      // largest first; any client with more than 1 / capacity of the
+      // total is among the tracked ones
+      std::vector<HeavyHitter> get_heavy_hitters(HitterMeasure measure,
+						 size_t k) const {
+	DataGuard g(data_mtx);
+	if (!heavy_hitters) {
+	  return std::vector<HeavyHitter>();
+	}
+	switch(measure) {
+	case HitterMeasure::added:
+	  return heavy_hitters->added.top(k);
+	case HitterMeasure::dispatched:
+	  return heavy_hitters->dispatched.top(k);
+	case HitterMeasure::cost:
+	default:
+	  return heavy_hitters->cost.top(k);
+	}
+      }
+
+
+      using ClientStateRef = const ClientStateCell*;
+
+      // Publishing client states for get_client_state costs a store
+      // of every field on each add and dispatch, so it is off by
+      // default. Enabling it publishes every client's current state.
+      void set_client_state_publishing(bool enabled) {
+	DataGuard g(data_mtx);
+	{
+	  std::lock_guard<std::mutex> g2(state_index_mtx);
+	  publish_client_states = enabled;
+	}
+	if (enabled) {
+	  for (auto& i : client_map) {
+	    attach_state(*i.second);
+	    publish_state(*i.second);
+	  }
+	}
+      }
+
+
+      // the client's queue depth, head tags, and dispatch counts, for
+      // debugging one client without display_queues; takes only a
+      // lock on the client index, never the lock dispatch uses, and
+      // returns false if the client has no record or publishing is
+      // off
+      bool get_client_state(const C& client_id, ClientState& state) const {
+	ClientStateRef ref = get_client_state_ref(client_id);
+	if (!ref) {
+	  return false;
+	}
+	state = ref->load();
+	return true;
+      }
+
+
+      // for polling a client repeatedly: the handle stays valid for
+      // the queue's lifetime, so it can be cached and read with
+      // ref->load(), which is O(1) and takes no lock. Once the
+      // client's record is erased, or publishing is turned off, it
+      // keeps its last state, and a client that returns publishes to
+      // it again. Null if the client has no record or publishing is
+      // off.
+      ClientStateRef get_client_state_ref(const C& client_id) const {
+	std::lock_guard<std::mutex> g(state_index_mtx);
+	if (!publish_client_states) {
+	  return nullptr;
+	}
+	auto it = state_index.find(client_id);
+	return state_index.end() == it ? nullptr : it->second.get();
+      }
+
+
       bool remove_by_req_filter(std::function<bool(const R&)> filter_accum,
 				bool visit_backwards = false) {
 	bool any_removed = false;
@@ -483,6 +1074,7 @@ namespace crimson {
 #if USE_PROP_HEAP
 	    prop_heap.adjust(*i.second);
 #endif
+	    publish_state(*i.second);
 	    any_removed = true;
 	  }
 	}
@@ -527,6 +1119,7 @@ namespace crimson {
 #if USE_PROP_HEAP
 	prop_heap.adjust(*i->second);
 #endif
+	publish_state(*i->second);
       }
 
 
@@ -535,6 +1128,153 @@ namespace crimson {
       }
 
 
+      // requests added with a deadline that pass it while queued are
+      // handed to this function rather than dispatched; without one
+      // they're simply discarded. It is called after the queue's lock
+      // is released, by whichever thread's pull (or, in push mode,
+      // add, completion, or timer) shed them, so it may call back into
+      // the queue.
+      void set_request_expired_func(RequestExpiredFunc _request_expired_f) {
+	DataGuard g(data_mtx);
+	request_expired_f = _request_expired_f;
+      }
+
+
+      size_t get_expired_count() const {
+	DataGuard g(data_mtx);
+	return expired_count;
+      }
+
+
+      // without a cost function every request costs 1.0; requests
+      // already queued keep the cost they were added with
+      void set_request_cost_func(RequestCostFunc _request_cost_f) {
+	DataGuard g(data_mtx);
+	request_cost_f = _request_cost_f;
+      }
+
+
+      // needed for clients with a bandwidth reservation or limit;
+      // requests already queued keep the size they were added with
+      void set_request_bytes_func(RequestBytesFunc _request_bytes_f) {
+	DataGuard g(data_mtx);
+	request_bytes_f = _request_bytes_f;
+      }
+
+
+      // when both are set, a request added while its client's tail
+      // request is still queued is merged into that tail if
+      // can_merge_f allows it; the merged request is charged the sum
+      // of both costs and dispatched by the earlier deadline
+      void set_request_merge_func(RequestCanMergeFunc _can_merge_f,
+				  RequestMergeFunc _merge_f) {
+	DataGuard g(data_mtx);
+	request_can_merge_f = _can_merge_f;
+	request_merge_f = _merge_f;
+      }
+
+
+      // With delayed tag calculation (the default), a client's queued
+      // requests get their tags from the delta and rho of its latest
+      // request, so the counts carried by earlier ones are lost while
+      // it is backlogged. That is harmless when a client's requests
+      // carry similar counts, but not when they carry the dispatches
+      // made elsewhere between this queue's requests (see
+      // ShardedPullQueue). When set, the excess counts are summed
+      // until a tag is calculated.
+      void set_accumulate_req_params(bool accumulate) {
+	DataGuard g(data_mtx);
+	accumulate_req_params = accumulate;
+      }
+
+
+      // a dynamic alternative to allow_limit_break: when nothing is
+      // within limit and the next request would not become eligible
+      // for more than idle seconds, requests are dispatched past
+      // their limits, and this continues until a request within
+      // limit is available again; TimeMax (the default) disables it
+      void set_limit_break_idle(Time idle) {
+	DataGuard g(data_mtx);
+	limit_break_idle = idle;
+	limit_breaking = false;
+      }
+
+
+      // requests dispatched past their limits (by allow_limit_break
+      // or set_limit_break_idle) and their total cost
+      size_t get_limit_break_sched_count() const {
+	DataGuard g(data_mtx);
+	return limit_break_sched_count;
+      }
+
+      double get_limit_break_cost() const {
+	DataGuard g(data_mtx);
+	return limit_break_cost;
+      }
+
+
+      size_t get_merged_count() const {
+	DataGuard g(data_mtx);
+	return merged_count;
+      }
+
+
+      // once a client wins a proportional-phase dispatch, up to
+      // max_requests of its queued requests, costing at most max_cost
+      // in total when max_cost is not zero, may be dispatched back to
+      // back while they remain within limit, preserving the client's
+      // access locality; reservations still take precedence. A run
+      // puts its client at most max_requests - 1 dispatches ahead of
+      // its proportional share; get_run_fairness_error reports the
+      // largest lead actually observed. 1 (the default) disables runs.
+      void set_run_limit(size_t max_requests, double max_cost = 0.0) {
+	assert(max_requests > 0);
+	DataGuard g(data_mtx);
+	run_max_requests = max_requests;
+	run_max_cost = max_cost;
+	run_client = nullptr;
+      }
+
+
+      // number of dispatches made by continuing a run
+      size_t get_run_sched_count() const {
+	DataGuard g(data_mtx);
+	return run_sched_count;
+      }
+
+
+      // largest proportion tag lead of a run dispatch over the client
+      // the ready heap would have picked instead
+      double get_run_fairness_error() const {
+	DataGuard g(data_mtx);
+	return run_fairness_error;
+      }
+
+
+      // places the queue's heaps and client records, including the
+      // per-request tags and bookkeeping they hold, on the given NUMA
+      // node, for queues whose requests are dispatched by threads on
+      // that node (see bind_thread_to_node); request payloads remain
+      // where the caller allocated them. Must be called before any
+      // request is added. Returns false, leaving placement to the
+      // allocating threads, if requests were already added, NUMA is
+      // unsupported (see numa_arena.h), or the node does not exist.
+      bool set_numa_node(int node) {
+	DataGuard g(data_mtx);
+	if (0 != tick) {
+	  return false;
+	}
+	return arena.bind(node);
+      }
+
+
+      // the node the queue is placed on, or -1 if none
+      int get_numa_node() const {
+	DataGuard g(data_mtx);
+	return arena.get_node();
+      }
+
+
       friend std::ostream& operator<<(std::ostream& out,
 				      const PriorityQueueBase& q) {
 	std::lock_guard<decltype(q.data_mtx)> guard(q.data_mtx);
@@ -644,20 +1384,47 @@ namespace crimson {
       };
 
       ClientInfoFunc       client_info_f;
+      RequestExpiredFunc   request_expired_f;
+
+      // shed with data_mtx held, for deliver_expired
+      using ExpiredList = std::vector<std::pair<C,RequestRef>>;
+      ExpiredList          expired_reqs;
+
+      RequestCostFunc      request_cost_f;
+      RequestBytesFunc     request_bytes_f;
+      RequestCanMergeFunc  request_can_merge_f;
+      RequestMergeFunc     request_merge_f;
 
       mutable std::mutex data_mtx;
       using DataGuard = std::lock_guard<decltype(data_mtx)>;
 
+      // heaps and client records are allocated from the arena, so it
+      // is declared before them to be destroyed after them; see
+      // set_numa_node
+      NumaArena arena;
+      using HeapAlloc = NumaAllocator<ClientRecRef>;
+
       // stable mapping between client ids and client queues
       std::map<C,ClientRecRef> client_map;
 
+      // the clients' published states, for get_client_state; a cell
+      // is made the first time a client is seen while publishing and
+      // kept, so handles to it never dangle. Changed only with
+      // data_mtx held, so state_index_mtx nests inside it.
+      mutable std::mutex state_index_mtx;
+      std::map<C,std::unique_ptr<ClientStateCell>> state_index;
+
+      // see set_client_state_publishing; changed with both locks held
+      bool publish_client_states = false;
+
       c::IndIntruHeap<ClientRecRef,
 		      ClientRec,
 		      &ClientRec::reserv_heap_data,
 		      ClientCompare<&RequestTag::reservation,
 				    ReadyOption::ignore,
 				    false>,
-		      B> resv_heap;
+		      B,
+		      HeapAlloc> resv_heap;
 #if USE_PROP_HEAP
       c::IndIntruHeap<ClientRecRef,
 		      ClientRec,
@@ -665,7 +1432,8 @@ namespace crimson {
 		      ClientCompare<&RequestTag::proportion,
 				    ReadyOption::ignore,
 				    true>,
-		      B> prop_heap;
+		      B,
+		      HeapAlloc> prop_heap;
 #endif
       c::IndIntruHeap<ClientRecRef,
 		      ClientRec,
@@ -673,14 +1441,16 @@ namespace crimson {
 		      ClientCompare<&RequestTag::limit,
 				    ReadyOption::lowers,
 				    false>,
-		      B> limit_heap;
+		      B,
+		      HeapAlloc> limit_heap;
       c::IndIntruHeap<ClientRecRef,
 		      ClientRec,
 		      &ClientRec::ready_heap_data,
 		      ClientCompare<&RequestTag::proportion,
 				    ReadyOption::raises,
 				    true>,
-		      B> ready_heap;
+		      B,
+		      HeapAlloc> ready_heap;
 
       // if all reservations are met and all other requestes are under
       // limit, this will allow the request next in terms of
@@ -692,10 +1462,61 @@ namespace crimson {
       // every request creates a tick
       Counter tick = 0;
 
+      // deadlines of queued requests that have one, as a min-heap;
+      // entries are left behind when their request is dispatched or
+      // removed, are skipped when they come due, and are dropped in
+      // bulk once they make up half the heap
+      struct DeadlineEntry {
+	Time    deadline;
+	C       client;
+	Counter seq; // see ClientReq
+
+	friend bool operator>(const DeadlineEntry& a, const DeadlineEntry& b) {
+	  return a.deadline > b.deadline;
+	}
+      };
+      std::vector<DeadlineEntry> deadline_heap;
+      size_t deadline_compact_at = 1024;
+
       // performance data collection
       size_t reserv_sched_count = 0;
       size_t prop_sched_count = 0;
       size_t limit_break_sched_count = 0;
+      double limit_break_cost = 0.0;
+      size_t expired_count = 0;
+      size_t run_sched_count = 0;
+      size_t merged_count = 0;
+      double run_fairness_error = 0.0;
+
+      // see set_accumulate_req_params
+      bool accumulate_req_params = false;
+
+      // see set_heavy_hitters
+      struct HeavyHitters {
+	c::SpaceSaving<C> added;
+	c::SpaceSaving<C> dispatched;
+	c::SpaceSaving<C> cost;
+
+	HeavyHitters(size_t capacity) :
+	  added(capacity),
+	  dispatched(capacity),
+	  cost(capacity)
+	{
+	  // empty
+	}
+      };
+      std::unique_ptr<HeavyHitters> heavy_hitters;
+
+      // see set_limit_break_idle
+      Time limit_break_idle = TimeMax;
+      bool limit_breaking = false;
+
+      // state of locality-preserving runs; see set_run_limit
+      size_t     run_max_requests = 1;
+      double     run_max_cost = 0.0;
+      ClientRec* run_client = nullptr;
+      size_t     run_count = 0;
+      double     run_cost = 0.0;
 
       Duration                  idle_age;
       Duration                  erase_age;
@@ -708,14 +1529,22 @@ namespace crimson {
 
 
       // COMMON constructor that others feed into; we can accept three
-      // different variations of durations
+      // different variations of durations. If executor is given, the
+      // cleaning job runs on it rather than on a thread of its own.
       template<typename Rep, typename Per>
       PriorityQueueBase(ClientInfoFunc _client_info_f,
 			std::chrono::duration<Rep,Per> _idle_age,
 			std::chrono::duration<Rep,Per> _erase_age,
 			std::chrono::duration<Rep,Per> _check_time,
-			bool _allow_limit_break) :
+			bool _allow_limit_break,
+			TimerExecutor* executor = nullptr) :
 	client_info_f(_client_info_f),
+	resv_heap(HeapAlloc(&arena)),
+#if USE_PROP_HEAP
+	prop_heap(HeapAlloc(&arena)),
+#endif
+	limit_heap(HeapAlloc(&arena)),
+	ready_heap(HeapAlloc(&arena)),
 	allow_limit_break(_allow_limit_break),
 	finishing(false),
 	idle_age(std::chrono::duration_cast<Duration>(_idle_age)),
@@ -724,10 +1553,18 @@ namespace crimson {
       {
 	assert(_erase_age >= _idle_age);
 	assert(_check_time < _idle_age);
-	cleaning_job =
-	  std::unique_ptr<RunEvery>(
-	    new RunEvery(check_time,
-			 std::bind(&PriorityQueueBase::do_clean, this)));
+	if (executor) {
+	  cleaning_job =
+	    std::unique_ptr<RunEvery>(
+	      new RunEvery(*executor,
+			   check_time,
+			   std::bind(&PriorityQueueBase::do_clean, this)));
+	} else {
+	  cleaning_job =
+	    std::unique_ptr<RunEvery>(
+	      new RunEvery(check_time,
+			   std::bind(&PriorityQueueBase::do_clean, this)));
+	}
       }
 
 
@@ -741,8 +1578,16 @@ namespace crimson {
 			  const C&         client_id,
 			  const ReqParams& req_params,
 			  const Time       time,
-			  const double     cost = 0.0) {
+			  const double     addl_cost = 0.0,
+			  const Time       deadline = TimeMax) {
 	++tick;
+	if (heavy_hitters) {
+	  heavy_hitters->added.add(client_id);
+	}
+
+	const double cost = request_cost_f ? request_cost_f(*request) : 1.0;
+	const double bytes =
+	  request_bytes_f ? double(request_bytes_f(*request)) : 0.0;
 
 	// this pointer will help us create a reference to a shared
 	// pointer, no matter which of two codepaths we take
@@ -754,7 +1599,8 @@ namespace crimson {
 	} else {
 	  ClientInfo info = client_info_f(client_id);
 	  ClientRecRef client_rec =
-	    std::make_shared<ClientRec>(client_id, info, tick);
+	    std::allocate_shared<ClientRec>(NumaAllocator<ClientRec>(&arena),
+					    client_id, info, tick, &arena);
 	  resv_heap.push(client_rec);
 #if USE_PROP_HEAP
 	  prop_heap.push(client_rec);
@@ -762,11 +1608,31 @@ namespace crimson {
 	  limit_heap.push(client_rec);
 	  ready_heap.push(client_rec);
 	  client_map[client_id] = client_rec;
+	  if (publish_client_states) {
+	    attach_state(*client_rec);
+	  }
 	  temp_client = &(*client_rec); // address of obj of shared_ptr
 	}
 
 	// for convenience, we'll create a reference to the shared pointer
 	ClientRec& client = *temp_client;
+	client.last_active = time;
+
+	if (!client.idle && client.has_request() &&
+	    request_merge_f && request_can_merge_f &&
+	    request_can_merge_f(*client.requests.back().request, *request)) {
+	  merge_request(client, *request, req_params,
+			addl_cost, cost, deadline, bytes);
+	  publish_state(client);
+	  return;
+	}
+
+	// The heaps only compare a client's head request (plus its
+	// prop_delta), so a request queued behind an existing head
+	// cannot move the client in any heap. Only when the client goes
+	// from empty to non-empty or becomes unidle do we need heap
+	// work; deep per-client queues thus enqueue without it.
+	const bool head_changed = client.idle || !client.has_request();
 
 	if (client.idle) {
 	  // We need to do an adjustment so that idle clients compete
@@ -823,22 +1689,28 @@ namespace crimson {
 
 	if (!client.has_request()) {
 	  tag = RequestTag(client.get_req_tag(), client.info,
-			   req_params, time, cost);
+			   req_params, time, addl_cost, cost, bytes);
 
 	  // copy tag to previous tag for client
 	  client.update_req_tag(tag, tick);
 	}
 #else
-	RequestTag tag(client.get_req_tag(), client.info, req_params, time, cost);
+	RequestTag tag(client.get_req_tag(), client.info,
+		       req_params, time, addl_cost, cost, bytes);
 	// copy tag to previous tag for client
 	client.update_req_tag(tag, tick);
 #endif
 
-	client.add_request(tag, client.client, std::move(request));
-	if (1 == client.requests.size()) {
-	  // NB: can the following 4 calls to adjust be changed
-	  // promote? Can adding a request ever demote a client in the
-	  // heaps?
+	const bool tag_deferred = client.has_request();
+	client.add_request(tag, client.client, std::move(request),
+			   cost, deadline, bytes, tick);
+	if (deadline < TimeMax) {
+	  push_deadline(deadline, client.client, tick);
+	}
+
+	update_cur_req_params(client, req_params, tag_deferred);
+
+	if (head_changed) {
 	  resv_heap.adjust(client);
 	  limit_heap.adjust(client);
 	  ready_heap.adjust(client);
@@ -846,61 +1718,271 @@ namespace crimson {
 	  prop_heap.adjust(client);
 #endif
 	}
+	publish_state(client);
+      } // add_request
 
-	client.cur_rho = req_params.rho;
-	client.cur_delta = req_params.delta;
 
-	resv_heap.adjust(client);
-	limit_heap.adjust(client);
-	ready_heap.adjust(client);
-#if USE_PROP_HEAP
-	prop_heap.adjust(client);
-#endif
-      } // add_request
+      // data_mtx should be held when called; gives the client the
+      // cell it had before it was erased, if any
+      void attach_state(ClientRec& client) {
+	if (client.state) {
+	  return;
+	}
+	std::lock_guard<std::mutex> g(state_index_mtx);
+	std::unique_ptr<ClientStateCell>& cell = state_index[client.client];
+	if (!cell) {
+	  cell.reset(new ClientStateCell);
+	}
+	client.state = cell.get();
+      }
 
 
-      // data_mtx should be held when called; top of heap should have
-      // a ready request
-      template<typename C1, IndIntruHeapData ClientRec::*C2, typename C3>
-      void pop_process_request(IndIntruHeap<C1, ClientRec, C2, C3, B>& heap,
-			       std::function<void(const C& client,
-						  RequestRef& request)> process) {
-	// gain access to data
-	ClientRec& top = heap.top();
-	ClientReq& first = top.next_request();
-	RequestRef request = std::move(first.request);
+      // data_mtx should be held when called; makes the client's
+      // current state visible to get_client_state
+      void publish_state(const ClientRec& client) {
+	if (!publish_client_states) {
+	  return;
+	}
+	ClientState s;
+	s.queue_depth = uint32_t(client.request_count());
+	if (client.has_request()) {
+	  const RequestTag& tag = client.next_request().tag;
+	  s.reservation = tag.reservation;
+	  s.proportion = tag.proportion;
+	  s.limit = tag.limit;
+	} else {
+	  s.reservation = s.proportion = s.limit = max_tag;
+	}
+	s.idle = client.idle;
+	s.prop_delta = client.prop_delta;
+	s.last_tick = client.last_tick;
+	s.last_active = client.last_active;
+	s.reservation_count = client.reservation_count;
+	s.priority_count = client.priority_count;
+	client.state->store(s);
+      }
 
-	// pop request and adjust heaps
-	top.pop_request();
 
+      // data_mtx should be held when called; tag_deferred tells
+      // whether the request's tag is left to be calculated when it
+      // reaches the head, using the client's current params
+      void update_cur_req_params(ClientRec&       client,
+				 const ReqParams& req_params,
+				 bool             tag_deferred) {
+	if (!accumulate_req_params) {
+	  client.cur_rho = req_params.rho;
+	  client.cur_delta = req_params.delta;
+	}
 #ifndef DO_NOT_DELAY_TAG_CALC
-	if (top.has_request()) {
-	  ClientReq& next_first = top.next_request();
-	  next_first.tag = RequestTag(first.tag, top.info,
-	                              ReqParams(top.cur_delta, top.cur_rho),
-				      next_first.tag.arrival);
-
-  	  // copy tag to previous tag for client
-	  top.update_req_tag(next_first.tag, tick);
+	else if (tag_deferred) {
+	  client.cur_rho += req_params.rho - 1;
+	  client.cur_delta += req_params.delta - 1;
 	}
 #endif
+      }
 
-	resv_heap.demote(top);
+
+      // data_mtx should be held when called; folds request into the
+      // client's tail request, extending the tail's tags by the
+      // increments request would have added had it been queued
+      // separately
+      void merge_request(ClientRec&       client,
+			 R&               request,
+			 const ReqParams& req_params,
+			 const double     addl_cost,
+			 const double     cost,
+			 const Time       deadline,
+			 const double     bytes) {
+	ClientReq& tail = client.requests.back();
+	request_merge_f(*tail.request, request);
+	tail.cost += cost;
+	tail.bytes += bytes;
+	++merged_count;
+
+	if (deadline < tail.deadline) {
+	  tail.deadline = deadline;
+	  push_deadline(deadline, client.client, tail.seq);
+	}
+
+	update_cur_req_params(client, req_params, client.requests.size() > 1);
+
+#ifndef DO_NOT_DELAY_TAG_CALC
+	// only the head's tag has been calculated; later ones will be
+	// from their (now larger) cost when they reach the head
+	if (client.requests.size() > 1) {
+	  client.last_tick = tick;
+	  return;
+	}
+#endif
+
+	tail.tag.shift(addl_cost +
+		       client.info.reservation_inv * (req_params.rho - 1 + cost),
+		       client.info.limit_inv * (req_params.delta - 1 + cost),
+		       client.info.bw_reservation_inv * bytes *
+		       std::max<uint32_t>(1, req_params.rho),
+		       client.info.bw_limit_inv * bytes *
+		       std::max<uint32_t>(1, req_params.delta));
+	tail.tag.proportion +=
+	  client.info.weight_inv * (req_params.delta - 1 + cost);
+	client.update_req_tag(tail.tag, tick);
+
+	if (client.requests.size() == 1) {
+	  resv_heap.adjust(client);
+	  limit_heap.adjust(client);
+	  ready_heap.adjust(client);
+#if USE_PROP_HEAP
+	  prop_heap.adjust(client);
+#endif
+	}
+      }
+
+
+      // given a dispatched request and the cost it was charged
+      using ProcessFunc = std::function<void(const C& client,
+					     RequestRef& request,
+					     double cost)>;
+
+
+      // data_mtx should be held when called; top of heap should have
+      // a ready request; now is the time the dispatch was decided at;
+      // returns the cost of the request processed
+      template<typename C1, IndIntruHeapData ClientRec::*C2, typename C3>
+      double pop_process_request(IndIntruHeap<C1, ClientRec, C2, C3, B,
+				 HeapAlloc>& heap,
+				 PhaseType phase,
+				 Time now,
+				 ProcessFunc process) {
+	return pop_process_request(heap.top(), phase, now, process);
+      }
+
+
+      // data_mtx should be held when called; dispatches a request in
+      // the proportional phase from either the top of the ready heap
+      // or the client whose run is being continued, and starts or
+      // extends a run; returns the cost of the request processed
+      double pop_process_prop_request(HeapId heap_id,
+				      Time now,
+				      ProcessFunc process) {
+	ClientRec& client =
+	  HeapId::run == heap_id ? *run_client : ready_heap.top();
+
+	if (HeapId::run == heap_id) {
+	  const ClientRec& top = ready_heap.top();
+	  if (&top != &client &&
+	      top.has_request() &&
+	      top.next_request().tag.ready) {
+	    const double lead =
+	      (client.next_request().tag.proportion + client.prop_delta) -
+	      (top.next_request().tag.proportion + top.prop_delta);
+	    run_fairness_error = std::max(run_fairness_error, lead);
+	  }
+	}
+
+	const double bytes = client.next_request().bytes;
+	const double cost =
+	  pop_process_request(client, PhaseType::priority, now, process);
+	reduce_reservation_tags(client, cost, bytes);
+
+	if (HeapId::run == heap_id) {
+	  ++run_count;
+	  run_cost += cost;
+	  ++run_sched_count;
+	} else if (run_max_requests > 1) {
+	  run_client = &client;
+	  run_count = 1;
+	  run_cost = cost;
+	}
+	return cost;
+      }
+
+
+      // data_mtx should be held when called; whether the current run
+      // may dispatch its client's next request
+      bool run_continues() const {
+	if (nullptr == run_client ||
+	    !run_client->has_request() ||
+	    run_count >= run_max_requests) {
+	  return false;
+	}
+	const ClientReq& next = run_client->next_request();
+	return next.tag.ready &&
+	  next.tag.proportion < max_tag &&
+	  (0.0 == run_max_cost || run_cost + next.cost <= run_max_cost);
+      }
+
+
+      // data_mtx should be held when called; client should have a
+      // request; returns the cost of the request processed
+      double pop_process_request(ClientRec& top,
+				 PhaseType phase,
+				 Time now,
+				 ProcessFunc process) {
+	// gain access to data
+	ClientReq& first = top.next_request();
+	RequestRef request = std::move(first.request);
+	const double cost = first.cost;
+#ifndef DO_NOT_DELAY_TAG_CALC
+	// first is gone once popped
+	const RequestTag first_tag = first.tag;
+#endif
+
+	// pop request and adjust heaps
+	top.pop_request();
+
+#ifndef DO_NOT_DELAY_TAG_CALC
+	if (top.has_request()) {
+	  ClientReq& next_first = top.next_request();
+	  next_first.tag = RequestTag(first_tag, top.info,
+	                              ReqParams(top.cur_delta, top.cur_rho),
+				      next_first.tag.arrival,
+				      0.0,
+				      next_first.cost,
+				      next_first.bytes);
+	  if (accumulate_req_params) {
+	    top.cur_rho = 1;
+	    top.cur_delta = 1;
+	  }
+
+  	  // copy tag to previous tag for client
+	  top.update_req_tag(next_first.tag, tick);
+	}
+#endif
+
+	resv_heap.demote(top);
 	limit_heap.adjust(top);
 #if USE_PROP_HEAP
 	prop_heap.demote(top);
 #endif
 	ready_heap.demote(top);
 
+	if (PhaseType::reservation == phase) {
+	  ++top.reservation_count;
+	} else {
+	  ++top.priority_count;
+	}
+	if (heavy_hitters) {
+	  heavy_hitters->dispatched.add(top.client);
+	  heavy_hitters->cost.add(top.client, cost);
+	}
+	top.last_active = now;
+	publish_state(top);
+
 	// process
-	process(top.client, request);
+	process(top.client, request, cost);
+
+	return cost;
       } // pop_process_request
 
 
-      // data_mtx should be held when called
-      void reduce_reservation_tags(ClientRec& client) {
+      // data_mtx should be held when called; cost and bytes are
+      // those of the request just dispatched in the proportional phase
+      void reduce_reservation_tags(ClientRec& client,
+				   double cost,
+				   double bytes = 0.0) {
+	const double reduction = client.info.reservation_inv * cost;
+	const double bw_reduction = client.info.bw_reservation_inv * bytes;
 	for (auto& r : client.requests) {
-	  r.tag.reservation -= client.info.reservation_inv;
+	  r.tag.shift(-reduction, 0.0, -bw_reduction, 0.0);
 
 #ifndef DO_NOT_DELAY_TAG_CALC
 	  // reduce only for front tag. because next tags' value are invalid
@@ -908,26 +1990,210 @@ namespace crimson {
 #endif
 	}
 	// don't forget to update previous tag
-	client.prev_tag.reservation -= client.info.reservation_inv;
+	client.prev_tag.shift(-reduction, 0.0, -bw_reduction, 0.0);
 	resv_heap.promote(client);
+	publish_state(client);
+      }
+
+
+      // data_mtx should be held when called; once a request completes
+      // and its actual cost is known, shifts the client's tags by the
+      // difference from the cost it was charged, so later requests pay
+      // for (or are refunded) the estimation error; the reservation tag
+      // only moves for requests served in the reservation phase since
+      // proportional-phase dispatches are not charged against it
+      void do_correct_cost(const C& client_id,
+			   PhaseType phase,
+			   double cost_error) {
+	auto client_it = client_map.find(client_id);
+	if (client_map.end() == client_it || 0.0 == cost_error) {
+	  return; // client was cleaned from map or nothing to correct
+	}
+
+	ClientRec& client = *client_it->second;
+	const double resv_shift = PhaseType::reservation == phase ?
+	  client.info.reservation_inv * cost_error : 0.0;
+	const double prop_shift = client.info.weight_inv * cost_error;
+	const double limit_shift = client.info.limit_inv * cost_error;
+
+	for (auto& r : client.requests) {
+	  r.tag.shift(resv_shift, limit_shift);
+	  r.tag.proportion += prop_shift;
+
+#ifndef DO_NOT_DELAY_TAG_CALC
+	  // only the front tag has been calculated
+	  break;
+#endif
+	}
+	client.prev_tag.shift(resv_shift, limit_shift);
+	client.prev_tag.proportion += prop_shift;
+
+	resv_heap.adjust(client);
+	limit_heap.adjust(client);
+	ready_heap.adjust(client);
+#if USE_PROP_HEAP
+	prop_heap.adjust(client);
+#endif
+	publish_state(client);
       }
 
 
       // data_mtx should be held when called
-      void reduce_reservation_tags(const C& client_id) {
+      void reduce_reservation_tags(const C& client_id, double cost) {
 	auto client_it = client_map.find(client_id);
 
 	// means the client was cleaned from map; should never happen
 	// as long as cleaning times are long enough
 	assert(client_map.end() != client_it);
-	reduce_reservation_tags(*client_it->second);
+	reduce_reservation_tags(*client_it->second, cost);
       }
 
 
       // data_mtx should be held when called
-      NextReq do_next_request(Time now) {
+      void push_deadline(Time deadline, const C& client_id, Counter seq) {
+	deadline_heap.push_back(DeadlineEntry{deadline, client_id, seq});
+	std::push_heap(deadline_heap.begin(), deadline_heap.end(),
+		       std::greater<DeadlineEntry>());
+	if (deadline_heap.size() >= deadline_compact_at) {
+	  compact_deadlines();
+	}
+      }
+
+
+      // data_mtx should be held when called; the queued request a
+      // deadline entry was made for, if it still is queued
+      const ClientReq* find_deadline_request(const DeadlineEntry& e) const {
+	auto client_it = client_map.find(e.client);
+	if (client_map.end() == client_it) {
+	  return nullptr; // client was erased by do_clean
+	}
+	return client_it->second->find_request(e.seq);
+      }
+
+
+      // data_mtx should be held when called; drops the entries of
+      // requests no longer queued, so the heap stays within twice
+      // the number of queued requests with deadlines
+      void compact_deadlines() {
+	auto stale = [this] (const DeadlineEntry& e) -> bool {
+	  const ClientReq* r = find_deadline_request(e);
+	  return nullptr == r || r->deadline != e.deadline;
+	};
+	deadline_heap.erase(std::remove_if(deadline_heap.begin(),
+					   deadline_heap.end(),
+					   stale),
+			    deadline_heap.end());
+	std::make_heap(deadline_heap.begin(), deadline_heap.end(),
+		       std::greater<DeadlineEntry>());
+	deadline_compact_at = std::max<size_t>(1024, 2 * deadline_heap.size());
+      }
+
+
+      // data_mtx should be held when called; entries whose request was
+      // dispatched or removed are skipped, so only a request that has
+      // actually expired makes its client's queue be swept
+      void shed_expired_requests(Time now) {
+	while (!deadline_heap.empty() &&
+	       deadline_heap.front().deadline <= now) {
+	  const DeadlineEntry e = deadline_heap.front();
+	  std::pop_heap(deadline_heap.begin(), deadline_heap.end(),
+			std::greater<DeadlineEntry>());
+	  deadline_heap.pop_back();
+
+	  if (nullptr == find_deadline_request(e)) {
+	    continue; // dispatched, removed, or shed by an earlier sweep
+	  }
+
+	  ClientRec& client = *client_map.find(e.client)->second;
+	  if (shed_expired_requests(client, now)) {
+	    resv_heap.adjust(client);
+	    limit_heap.adjust(client);
+	    ready_heap.adjust(client);
+#if USE_PROP_HEAP
+	    prop_heap.adjust(client);
+#endif
+	    publish_state(client);
+	  }
+	}
+      }
+
+
+      // data_mtx should be held when called; returns true if any of
+      // the client's requests were shed; caller must adjust the heaps
+      bool shed_expired_requests(ClientRec& client, Time now) {
+	if (!client.has_request()) {
+	  return false;
+	}
+
+	const RequestTag head_tag = client.next_request().tag;
+	const bool head_shed = client.next_request().deadline <= now;
+	bool any_shed = false;
+
+	for (auto i = client.requests.begin();
+	     i != client.requests.end();
+	     /* no inc */) {
+	  if (i->deadline <= now) {
+	    if (request_expired_f) {
+	      expired_reqs.emplace_back(client.client, std::move(i->request));
+	    }
+	    ++expired_count;
+	    any_shed = true;
+	    i = client.requests.erase(i);
+	  } else {
+	    ++i;
+	  }
+	}
+
+#ifndef DO_NOT_DELAY_TAG_CALC
+	// the new head request has no tag calculated yet; since the
+	// shed head was never served, it takes over that tag
+	if (head_shed && client.has_request()) {
+	  ClientReq& next_first = client.next_request();
+	  const Time arrival = next_first.tag.arrival;
+	  next_first.tag = head_tag;
+	  next_first.tag.arrival = arrival;
+	}
+#else
+	(void) head_tag;
+	(void) head_shed;
+#endif
+
+	return any_shed;
+      }
+
+
+      // data_mtx should be held through l when called and is released
+      // on return; requests shed while it was held are then handed to
+      // request_expired_f, which may call back into the queue
+      void deliver_expired(std::unique_lock<std::mutex>& l) {
+	if (expired_reqs.empty()) {
+	  l.unlock();
+	  return;
+	}
+	ExpiredList shed;
+	shed.swap(expired_reqs);
+	RequestExpiredFunc expired_f = request_expired_f;
+	l.unlock();
+	for (auto& e : shed) {
+	  expired_f(e.first, std::move(e.second));
+	}
+      }
+
+
+      // data_mtx should be held when called; decides only, so a
+      // caller that dispatches the request must call note_dispatch
+      // first. With peek set nothing is shed either, leaving only the
+      // time-driven moves of requests into the ready heap.
+      NextReq do_next_request(Time now, bool peek = false) {
 	NextReq result;
 
+	// testing the earliest deadline is O(1), so this costs nothing
+	// unless some request has actually expired
+	if (!peek &&
+	    !deadline_heap.empty() && deadline_heap.front().deadline <= now) {
+	  shed_expired_requests(now);
+	}
+
 	// if reservation queue is empty, all are empty (i.e., no active clients)
 	if(resv_heap.empty()) {
 	  result.type = NextReqType::none;
@@ -960,6 +2226,12 @@ namespace crimson {
 	  limits = &limit_heap.top();
 	}
 
+	if (run_continues()) {
+	  result.type = NextReqType::returning;
+	  result.heap_id = HeapId::run;
+	  return result;
+	}
+
 	auto& readys = ready_heap.top();
 	if (readys.has_request() &&
 	    readys.next_request().tag.ready &&
@@ -969,24 +2241,6 @@ namespace crimson {
 	  return result;
 	}
 
-	// if nothing is schedulable by reservation or
-	// proportion/weight, and if we allow limit break, try to
-	// schedule something with the lowest proportion tag or
-	// alternatively lowest reservation tag.
-	if (allow_limit_break) {
-	  if (readys.has_request() &&
-	      readys.next_request().tag.proportion < max_tag) {
-	    result.type = NextReqType::returning;
-	    result.heap_id = HeapId::ready;
-	    return result;
-	  } else if (reserv.has_request() &&
-		     reserv.next_request().tag.reservation < max_tag) {
-	    result.type = NextReqType::returning;
-	    result.heap_id = HeapId::reservation;
-	    return result;
-	  }
-	}
-
 	// nothing scheduled; make sure we re-run when next
 	// reservation item or next limited item comes up
 
@@ -1001,6 +2255,34 @@ namespace crimson {
 	  assert(!next.tag.ready || max_tag == next.tag.proportion);
 	  next_call = min_not_0_time(next_call, next.tag.limit);
 	}
+
+	// if nothing is schedulable by reservation or
+	// proportion/weight, and if we allow limit break, try to
+	// schedule something with the lowest proportion tag or
+	// alternatively lowest reservation tag. In the dynamic mode
+	// (see set_limit_break_idle) we allow it once the dispatch
+	// stream would otherwise stall for longer than the threshold,
+	// and keep allowing it until in-limit work turns up again.
+	if (allow_limit_break ||
+	    limit_breaking ||
+	    next_call - now > limit_break_idle) {
+	  bool broken = false;
+	  if (readys.has_request() &&
+	      readys.next_request().tag.proportion < max_tag) {
+	    result.heap_id = HeapId::ready;
+	    broken = true;
+	  } else if (reserv.has_request() &&
+		     reserv.next_request().tag.reservation < max_tag) {
+	    result.heap_id = HeapId::reservation;
+	    broken = true;
+	  }
+	  if (broken) {
+	    result.type = NextReqType::returning;
+	    result.limit_break = true;
+	    return result;
+	  }
+	}
+
 	if (next_call < TimeMax) {
 	  result.type = NextReqType::future;
 	  result.when_ready = next_call;
@@ -1012,8 +2294,56 @@ namespace crimson {
       } // do_next_request
 
 
+      // data_mtx should be held when called; does the bookkeeping for
+      // a returning next whose request is about to be dispatched
+      void note_dispatch(const NextReq& next) {
+	assert(NextReqType::returning == next.type);
+	if (next.limit_break) {
+	  // entering (or staying in) the dynamic limit-break mode
+	  limit_breaking = !allow_limit_break;
+	  ++limit_break_sched_count;
+	  const ClientRec& broken = HeapId::reservation == next.heap_id ?
+	    resv_heap.top() : ready_heap.top();
+	  limit_break_cost += broken.next_request().cost;
+	} else {
+	  limit_breaking = false;
+	}
+      }
+
+
+      // data_mtx should be held when called; for a returning next,
+      // the tag its request is scheduled by (its reservation tag for
+      // the reservation heap, else its adjusted proportion tag), so
+      // requests of different queues sharing a clock can be compared
+      double next_request_tag(const NextReq& next) const {
+	assert(NextReqType::returning == next.type);
+	switch(next.heap_id) {
+	case HeapId::reservation:
+	  return resv_heap.top().next_request().tag.reservation;
+	case HeapId::ready:
+	  return ready_heap.top().next_request().tag.proportion +
+	    ready_heap.top().prop_delta;
+	case HeapId::run:
+	  return run_client->next_request().tag.proportion +
+	    run_client->prop_delta;
+	default:
+	  assert(false);
+	  return max_tag;
+	}
+      }
+
+
       // if possible is not zero and less than current then return it;
       // otherwise return current; the idea is we're trying to find
+      // converts a time on the queue's clock to the executor's
+      static TimerExecutor::TimePoint executor_time(Time when, Time now) {
+	using Seconds = std::chrono::duration<double>;
+	return TimerExecutor::Clock::now() +
+	  std::chrono::duration_cast<TimerExecutor::Clock::duration>(
+	    Seconds(std::max(0.0, when - now)) + std::chrono::microseconds(1));
+      }
+
+
       // the minimal time but ignoring zero
       static inline const Time& min_not_0_time(const Time& current,
 					       const Time& possible) {
@@ -1061,6 +2391,7 @@ namespace crimson {
 	      client_map.erase(i2);
 	    } else if (idle_point && i2->second->last_tick <= idle_point) {
 	      i2->second->idle = true;
+	      publish_state(*i2->second);
 	    }
 	  } // for
 	} // if
@@ -1070,7 +2401,8 @@ namespace crimson {
       // data_mtx must be held by caller
       template<IndIntruHeapData ClientRec::*C1,typename C2>
       void delete_from_heap(ClientRecRef& client,
-			    c::IndIntruHeap<ClientRecRef,ClientRec,C1,C2,B>& heap) {
+			    c::IndIntruHeap<ClientRecRef,ClientRec,C1,C2,B,
+			    HeapAlloc>& heap) {
 	auto i = heap.rfind(client);
 	heap.remove(i);
       }
@@ -1078,6 +2410,9 @@ namespace crimson {
 
       // data_mtx must be held by caller
       void delete_from_heaps(ClientRecRef& client) {
+	if (run_client == client.get()) {
+	  run_client = nullptr;
+	}
 	delete_from_heap(client, resv_heap);
 #if USE_PROP_HEAP
 	delete_from_heap(client, prop_heap);
@@ -1092,6 +2427,15 @@ namespace crimson {
     class PullPriorityQueue : public PriorityQueueBase<C,R,B> {
       using super = PriorityQueueBase<C,R,B>;
 
+      // wakes wait_pull callers when a request is added
+      std::condition_variable pull_cv;
+
+#ifdef __linux__
+      // see get_ready_fd
+      int  ready_fd = -1;
+      bool ready_fd_immediate = false;
+#endif
+
     public:
 
       // When a request is pulled, this is the return type.
@@ -1100,6 +2444,7 @@ namespace crimson {
 	  C                           client;
 	  typename super::RequestRef  request;
 	  PhaseType                   phase;
+	  double                      cost; // charged; see request_completed
 	};
 
 	typename super::NextReqType   type;
@@ -1149,6 +2494,47 @@ namespace crimson {
       }
 
 
+      // these versions start no thread; the cleaning job runs on the
+      // executor, which must outlive the queue
+      template<typename Rep, typename Per>
+      PullPriorityQueue(typename super::ClientInfoFunc _client_info_f,
+			TimerExecutor& _executor,
+			std::chrono::duration<Rep,Per> _idle_age,
+			std::chrono::duration<Rep,Per> _erase_age,
+			std::chrono::duration<Rep,Per> _check_time,
+			bool _allow_limit_break = false) :
+	super(_client_info_f,
+	      _idle_age, _erase_age, _check_time,
+	      _allow_limit_break,
+	      &_executor)
+      {
+	// empty
+      }
+
+
+      PullPriorityQueue(typename super::ClientInfoFunc _client_info_f,
+			TimerExecutor& _executor,
+			bool _allow_limit_break = false) :
+	PullPriorityQueue(_client_info_f,
+			  _executor,
+			  std::chrono::minutes(10),
+			  std::chrono::minutes(15),
+			  std::chrono::minutes(6),
+			  _allow_limit_break)
+      {
+	// empty
+      }
+
+
+      ~PullPriorityQueue() {
+#ifdef __linux__
+	if (ready_fd >= 0) {
+	  ::close(ready_fd);
+	}
+#endif
+      }
+
+
       inline void add_request(const R& request,
 			      const C& client_id,
 			      const ReqParams& req_params,
@@ -1187,6 +2573,21 @@ namespace crimson {
       }
 
 
+      // request is shed rather than dispatched if still queued at deadline
+      inline void add_request_deadline(const R& request,
+				       const C& client_id,
+				       const ReqParams& req_params,
+				       const Time deadline,
+				       double addl_cost = 0.0) {
+	add_request(typename super::RequestRef(new R(request)),
+		    client_id,
+		    req_params,
+		    get_time(),
+		    addl_cost,
+		    deadline);
+      }
+
+
       inline void add_request(typename super::RequestRef&& request,
 			      const C& client_id,
 			      const ReqParams& req_params,
@@ -1208,7 +2609,8 @@ namespace crimson {
 		       const C&                     client_id,
 		       const ReqParams&             req_params,
 		       const Time                   time,
-		       double                       addl_cost = 0.0) {
+		       double                       addl_cost = 0.0,
+		       const Time                   deadline = TimeMax) {
 	typename super::DataGuard g(this->data_mtx);
 #ifdef PROFILE
 	add_request_timer.start();
@@ -1217,8 +2619,15 @@ namespace crimson {
 			      client_id,
 			      req_params,
 			      time,
-			      addl_cost);
+			      addl_cost,
+			      deadline);
 	// no call to schedule_request for pull version
+	pull_cv.notify_one();
+#ifdef __linux__
+	if (ready_fd >= 0 && !ready_fd_immediate) {
+	  arm_ready_fd(TimeZero);
+	}
+#endif
 #ifdef PROFILE
 	add_request_timer.stop();
 #endif
@@ -1231,8 +2640,98 @@ namespace crimson {
 
 
       PullReq pull_request(Time now) {
-	PullReq result;
+	std::unique_lock<std::mutex> l(this->data_mtx);
+	PullReq result = do_pull_request(now);
+	super::deliver_expired(l);
+	return result;
+      }
+
+
+      // like pull_request, but returns none rather than wait if another
+      // thread is using the queue; meant for stealing work from it
+      PullReq try_pull_request(Time now) {
+	std::unique_lock<std::mutex> l(this->data_mtx, std::try_to_lock);
+	if (!l.owns_lock()) {
+	  PullReq result;
+	  result.type = super::NextReqType::none;
+	  return result;
+	}
+	PullReq result = do_pull_request(now);
+	super::deliver_expired(l);
+	return result;
+      }
+
+
+      // if the queue isn't in use by another thread and can return a
+      // request now, gives the phase and tag it would be scheduled by
+      // and returns true; never waits
+      bool try_peek_request(Time now, PhaseType& phase, double& tag) {
+	std::unique_lock<std::mutex> l(this->data_mtx, std::try_to_lock);
+	if (!l.owns_lock()) {
+	  return false;
+	}
+	typename super::NextReq next = super::do_next_request(now, true);
+	if (super::NextReqType::returning != next.type) {
+	  return false;
+	}
+	phase = super::HeapId::reservation == next.heap_id ?
+	  PhaseType::reservation : PhaseType::priority;
+	tag = super::next_request_tag(next);
+	return true;
+      }
+
+
+      // like pull_request, but if no request can be returned yet, waits
+      // for one to be added or for a queued one to become eligible;
+      // after timeout the future or none result is returned
+      template<typename Rep, typename Per>
+      PullReq wait_pull(std::chrono::duration<Rep,Per> timeout) {
+	using Seconds = std::chrono::duration<double>;
+	const Time give_up =
+	  get_time() + std::chrono::duration_cast<Seconds>(timeout).count();
+	std::unique_lock<std::mutex> l(this->data_mtx);
+	while (true) {
+	  const Time now = get_time();
+	  PullReq result = do_pull_request(now);
+	  super::deliver_expired(l);
+	  if (result.is_retn() || now >= give_up) {
+	    return result;
+	  }
+	  const Time wake = result.is_future() ?
+	    std::min(give_up, result.getTime()) : give_up;
+	  l.lock();
+	  pull_cv.wait_for(l, Seconds(wake - now));
+	}
+      }
+
+
+#ifdef __linux__
+      // Returns a descriptor for event loops (e.g., epoll) that is
+      // readable while pull_request may return a request: a request
+      // was added, a queued one became eligible, or the last pull
+      // returned a request and more are queued. Each pull re-arms it,
+      // so it need not be read. It is owned by the queue; -1 (with
+      // errno set) is returned if it can't be created.
+      int get_ready_fd() {
 	typename super::DataGuard g(this->data_mtx);
+	if (ready_fd < 0) {
+	  ready_fd = ::timerfd_create(CLOCK_REALTIME,
+				      TFD_NONBLOCK | TFD_CLOEXEC);
+	  if (ready_fd >= 0 && has_queued_request()) {
+	    arm_ready_fd(TimeZero);
+	  }
+	}
+	return ready_fd;
+      }
+#endif
+
+
+    protected:
+
+
+      // data_mtx should be held when called
+      PullReq do_pull_request(Time now) {
+	PullReq result;
 #ifdef PROFILE
 	pull_request_timer.start();
 #endif
@@ -1241,10 +2740,20 @@ namespace crimson {
 	result.type = next.type;
 	switch(next.type) {
 	case super::NextReqType::none:
+#ifdef __linux__
+	  if (ready_fd >= 0) {
+	    disarm_ready_fd();
+	  }
+#endif
 	  return result;
 	  break;
 	case super::NextReqType::future:
 	  result.data = next.when_ready;
+#ifdef __linux__
+	  if (ready_fd >= 0) {
+	    arm_ready_fd(next.when_ready);
+	  }
+#endif
 	  return result;
 	  break;
 	case super::NextReqType::returning:
@@ -1255,42 +2764,106 @@ namespace crimson {
 	}
 
 	// we'll only get here if we're returning an entry
+	super::note_dispatch(next);
 
 	auto process_f =
 	  [&] (PullReq& pull_result, PhaseType phase) ->
-	  std::function<void(const C&,
-			     typename super::RequestRef&)> {
+	  typename super::ProcessFunc {
 	  return [&pull_result, phase](const C& client,
-				       typename super::RequestRef& request) {
+				       typename super::RequestRef& request,
+				       double cost) {
 	    pull_result.data =
-	    typename PullReq::Retn{client, std::move(request), phase};
+	    typename PullReq::Retn{client, std::move(request), phase, cost};
 	  };
 	};
 
 	switch(next.heap_id) {
 	case super::HeapId::reservation:
 	  super::pop_process_request(this->resv_heap,
+				     PhaseType::reservation,
+				     now,
 				     process_f(result, PhaseType::reservation));
 	  ++this->reserv_sched_count;
 	  break;
 	case super::HeapId::ready:
-	  super::pop_process_request(this->ready_heap,
-				     process_f(result, PhaseType::priority));
-	  { // need to use retn temporarily
-	    auto& retn = boost::get<typename PullReq::Retn>(result.data);
-	    super::reduce_reservation_tags(retn.client);
-	  }
+	case super::HeapId::run:
+	  super::pop_process_prop_request(next.heap_id,
+					  now,
+					  process_f(result, PhaseType::priority));
 	  ++this->prop_sched_count;
 	  break;
 	default:
 	  assert(false);
 	}
 
+#ifdef __linux__
+	if (ready_fd >= 0) {
+	  if (has_queued_request()) {
+	    arm_ready_fd(TimeZero);
+	  } else {
+	    disarm_ready_fd();
+	  }
+	}
+#endif
+
 #ifdef PROFILE
 	pull_request_timer.stop();
 #endif
 	return result;
-      } // pull_request
+      } // do_pull_request
+
+
+      // data_mtx should be held when called
+      bool has_queued_request() const {
+	return !this->resv_heap.empty() &&
+	  this->resv_heap.top().has_request();
+      }
+
+
+#ifdef __linux__
+      // data_mtx should be held when called; makes ready_fd readable
+      // at when, or immediately if when is TimeZero
+      void arm_ready_fd(Time when) {
+	struct itimerspec spec = {};
+	int flags = 0;
+	if (TimeZero == when) {
+	  spec.it_value.tv_nsec = 1;
+	} else {
+	  spec.it_value.tv_sec = time_t(when);
+	  spec.it_value.tv_nsec = long(1e9 * (when - time_t(when)));
+	  flags = TFD_TIMER_ABSTIME;
+	}
+	int result = ::timerfd_settime(ready_fd, flags, &spec, nullptr);
+	assert(0 == result);
+	(void) result;
+	ready_fd_immediate = TimeZero == when;
+      }
+
+
+      // data_mtx should be held when called
+      void disarm_ready_fd() {
+	struct itimerspec spec = {};
+	int result = ::timerfd_settime(ready_fd, 0, &spec, nullptr);
+	assert(0 == result);
+	(void) result;
+	ready_fd_immediate = false;
+      }
+#endif
+
+
+    public:
+
+
+      // optional; reports the actual cost of a completed request that
+      // was pulled in the given phase and charged charged_cost, both
+      // as given in its Retn
+      void request_completed(const C&  client_id,
+			     PhaseType phase,
+			     double    actual_cost,
+			     double    charged_cost) {
+	typename super::DataGuard g(this->data_mtx);
+	super::do_correct_cost(client_id, phase, actual_cost - charged_cost);
+      }
 
 
     protected:
@@ -1318,19 +2891,28 @@ namespace crimson {
       // a function to see whether the server can handle another request
       using CanHandleRequestFunc = std::function<bool(void)>;
 
-      // a function to submit a request to the server; the second
-      // parameter is a callback when it's completed
+      // a function to submit a request to the server, given the phase
+      // it was scheduled in and the cost it was charged
       using HandleRequestFunc =
-	std::function<void(const C&,typename super::RequestRef,PhaseType)>;
+	std::function<void(const C&,
+			   typename super::RequestRef,
+			   PhaseType,
+			   double)>;
 
     protected:
 
       CanHandleRequestFunc can_handle_f;
       HandleRequestFunc    handle_f;
+      std::unique_ptr<AimdConcurrency> concurrency;
       // for handling timed scheduling
       std::mutex  sched_ahead_mtx;
       std::condition_variable sched_ahead_cv;
       Time sched_ahead_when = TimeZero;
+      int sched_ahead_node = -1;
+
+      // if set, timed scheduling is a job on it rather than a thread
+      TimerExecutor*       executor = nullptr;
+      TimerExecutor::JobId sched_ahead_job = 0;
 
 #ifdef PROFILE
     public:
@@ -1381,10 +2963,56 @@ namespace crimson {
       }
 
 
+      // these versions start no threads; the cleaning job and timed
+      // scheduling run on the executor, which must outlive the queue
+      template<typename Rep, typename Per>
+      PushPriorityQueue(typename super::ClientInfoFunc _client_info_f,
+			CanHandleRequestFunc _can_handle_f,
+			HandleRequestFunc _handle_f,
+			TimerExecutor& _executor,
+			std::chrono::duration<Rep,Per> _idle_age,
+			std::chrono::duration<Rep,Per> _erase_age,
+			std::chrono::duration<Rep,Per> _check_time,
+			bool _allow_limit_break = false) :
+	super(_client_info_f,
+	      _idle_age, _erase_age, _check_time,
+	      _allow_limit_break,
+	      &_executor),
+	executor(&_executor)
+      {
+	can_handle_f = _can_handle_f;
+	handle_f = _handle_f;
+	sched_ahead_job = executor->add_job(
+	  std::bind(&PushPriorityQueue::run_sched_ahead_job, this));
+      }
+
+
+      PushPriorityQueue(typename super::ClientInfoFunc _client_info_f,
+			CanHandleRequestFunc _can_handle_f,
+			HandleRequestFunc _handle_f,
+			TimerExecutor& _executor,
+			bool _allow_limit_break = false) :
+	PushPriorityQueue(_client_info_f,
+			  _can_handle_f,
+			  _handle_f,
+			  _executor,
+			  std::chrono::minutes(10),
+			  std::chrono::minutes(15),
+			  std::chrono::minutes(6),
+			  _allow_limit_break)
+      {
+	// empty
+      }
+
+
       ~PushPriorityQueue() {
 	this->finishing = true;
-	sched_ahead_cv.notify_one();
-	sched_ahead_thd.join();
+	if (executor) {
+	  executor->cancel(sched_ahead_job);
+	} else {
+	  sched_ahead_cv.notify_one();
+	  sched_ahead_thd.join();
+	}
       }
 
     public:
@@ -1422,12 +3050,28 @@ namespace crimson {
       }
 
 
+      // request is shed rather than dispatched if still queued at deadline
+      inline void add_request_deadline(const R& request,
+				       const C& client_id,
+				       const ReqParams& req_params,
+				       const Time deadline,
+				       double addl_cost = 0.0) {
+	add_request(typename super::RequestRef(new R(request)),
+		    client_id,
+		    req_params,
+		    get_time(),
+		    addl_cost,
+		    deadline);
+      }
+
+
       void add_request(typename super::RequestRef&& request,
 		       const C&         client_id,
 		       const ReqParams& req_params,
 		       const Time       time,
-		       double           addl_cost = 0.0) {
-	typename super::DataGuard g(this->data_mtx);
+		       double           addl_cost = 0.0,
+		       const Time       deadline = TimeMax) {
+	std::unique_lock<std::mutex> l(this->data_mtx);
 #ifdef PROFILE
 	add_request_timer.start();
 #endif
@@ -1435,27 +3079,98 @@ namespace crimson {
 			      client_id,
 			      req_params,
 			      time,
-			      addl_cost);
+			      addl_cost,
+			      deadline);
 	schedule_request();
 #ifdef PROFILE
 	add_request_timer.stop();
 #endif
+	super::deliver_expired(l);
       }
 
 
       void request_completed() {
+	std::unique_lock<std::mutex> l(this->data_mtx);
+	do_request_completed(-1.0);
+	super::deliver_expired(l);
+      }
+
+
+      // as above, but also reports how long the request was
+      // outstanding, for the adaptive concurrency limit
+      void request_completed(Time latency) {
+	std::unique_lock<std::mutex> l(this->data_mtx);
+	do_request_completed(latency);
+	super::deliver_expired(l);
+      }
+
+
+      // as in the base; the thread that hands off requests at their
+      // scheduled times is also moved onto the node
+      bool set_numa_node(int node) {
+	if (!super::set_numa_node(node)) {
+	  return false;
+	}
+	std::lock_guard<std::mutex> l(sched_ahead_mtx);
+	sched_ahead_node = node;
+	sched_ahead_cv.notify_one();
+	return true;
+      }
+
+
+      // once set, requests are handed off only while fewer than the
+      // limiter's limit are outstanding (and can_handle_f agrees); any
+      // request_completed frees a slot, but only those given a latency
+      // adjust the limit
+      void set_concurrency_limit(const AimdConcurrency& limiter) {
+	typename super::DataGuard g(this->data_mtx);
+	concurrency.reset(new AimdConcurrency(limiter));
+      }
+
+
+      size_t get_concurrency_limit() const {
 	typename super::DataGuard g(this->data_mtx);
+	return concurrency ? concurrency->get_limit() : 0;
+      }
+
+
+      // as above, but also reports the actual cost of the completed
+      // request, which was handed off in the given phase and charged
+      // charged_cost, both as handle_f was given them, and, when
+      // latency is not negative, how long it was outstanding
+      void request_completed(const C&  client_id,
+			     PhaseType phase,
+			     double    actual_cost,
+			     double    charged_cost,
+			     Time      latency = -1.0) {
+	std::unique_lock<std::mutex> l(this->data_mtx);
+	super::do_correct_cost(client_id, phase, actual_cost - charged_cost);
+	do_request_completed(latency);
+	super::deliver_expired(l);
+      }
+
+    protected:
+
+      // data_mtx should be held when called; every completion frees
+      // its request's slot under the concurrency limit, and a latency
+      // that is not negative also adjusts the limit
+      void do_request_completed(Time latency) {
 #ifdef PROFILE
 	request_complete_timer.start();
 #endif
+	if (concurrency) {
+	  if (latency >= 0.0) {
+	    concurrency->completed(latency);
+	  } else {
+	    concurrency->released();
+	  }
+	}
 	schedule_request();
 #ifdef PROFILE
 	request_complete_timer.stop();
 #endif
       }
 
-    protected:
-
       // data_mtx should be held when called; furthermore, the heap
       // should not be empty and the top element of the heap should
       // not be already handled
@@ -1470,34 +3185,57 @@ namespace crimson {
 	       IndIntruHeapData super::ClientRec::*C2,
 	       typename C3,
 	       uint B4>
-      C submit_top_request(IndIntruHeap<C1,typename super::ClientRec,C2,C3,B4>& heap,
-			   PhaseType phase) {
+      C submit_top_request(IndIntruHeap<C1,typename super::ClientRec,C2,C3,B4,
+			   typename super::HeapAlloc>& heap,
+			   PhaseType phase,
+			   Time now,
+			   double& cost) {
 	C client_result;
-	super::pop_process_request(heap,
-				   [this, phase, &client_result]
-				   (const C& client,
-				    typename super::RequestRef& request) {
-				     client_result = client;
-				     handle_f(client, std::move(request), phase);
-				   });
+	cost = super::pop_process_request(heap,
+					  phase,
+					  now,
+					  [this, phase, &client_result]
+					  (const C& client,
+					   typename super::RequestRef& request,
+					   double charged) {
+					    client_result = client;
+					    handle_f(client, std::move(request),
+						     phase, charged);
+					  });
 	return client_result;
       }
 
 
-      // data_mtx should be held when called
-      void submit_request(typename super::HeapId heap_id) {
-	C client;
+      // data_mtx should be held when called; now is the time the
+      // request was found ready at
+      void submit_request(typename super::HeapId heap_id, Time now) {
+	double cost;
+	if (concurrency) {
+	  concurrency->dispatched();
+	}
 	switch(heap_id) {
 	case super::HeapId::reservation:
 	  // don't need to note client
-	  (void) submit_top_request(this->resv_heap, PhaseType::reservation);
+	  (void) submit_top_request(this->resv_heap,
+				    PhaseType::reservation,
+				    now,
+				    cost);
 	  // unlike the other two cases, we do not reduce reservation
 	  // tags here
 	  ++this->reserv_sched_count;
 	  break;
 	case super::HeapId::ready:
-	  client = submit_top_request(this->ready_heap, PhaseType::priority);
-	  super::reduce_reservation_tags(client);
+	case super::HeapId::run:
+	  super::pop_process_prop_request(heap_id,
+					  now,
+					  [this] (const C& client,
+						  typename super::RequestRef& request,
+						  double charged) {
+					    handle_f(client,
+						     std::move(request),
+						     PhaseType::priority,
+						     charged);
+					  });
 	  ++this->prop_sched_count;
 	  break;
 	default:
@@ -1518,7 +3256,7 @@ namespace crimson {
       // function in base class to add check for whether a request can
       // be pushed to the server
       typename super::NextReq next_request(Time now) {
-	if (!can_handle_f()) {
+	if ((concurrency && !concurrency->can_dispatch()) || !can_handle_f()) {
 	  typename super::NextReq result;
 	  result.type = super::NextReqType::none;
 	  return result;
@@ -1530,7 +3268,8 @@ namespace crimson {
 
       // data_mtx should be held when called
       void schedule_request() {
-	typename super::NextReq next_req = next_request();
+	const Time now = get_time();
+	typename super::NextReq next_req = next_request(now);
 	switch (next_req.type) {
 	case super::NextReqType::none:
 	  return;
@@ -1538,7 +3277,8 @@ namespace crimson {
 	  sched_at(next_req.when_ready);
 	  break;
 	case super::NextReqType::returning:
-	  submit_request(next_req.heap_id);
+	  this->note_dispatch(next_req);
+	  submit_request(next_req.heap_id, now);
 	  break;
 	default:
 	  assert(false);
@@ -1550,8 +3290,13 @@ namespace crimson {
       // future times when nothing can be scheduled immediately
       void run_sched_ahead() {
 	std::unique_lock<std::mutex> l(sched_ahead_mtx);
+	int bound_node = -1;
 
 	while (!this->finishing) {
+	  if (sched_ahead_node != bound_node) {
+	    bound_node = sched_ahead_node;
+	    (void) bind_thread_to_node(bound_node);
+	  }
 	  if (TimeZero == sched_ahead_when) {
 	    sched_ahead_cv.wait(l);
 	  } else {
@@ -1566,8 +3311,9 @@ namespace crimson {
 
 	    l.unlock();
 	    if (!this->finishing) {
-	      typename super::DataGuard g(this->data_mtx);
+	      std::unique_lock<std::mutex> g(this->data_mtx);
 	      schedule_request();
+	      super::deliver_expired(g);
 	    }
 	    l.lock();
 	  }
@@ -1575,13 +3321,43 @@ namespace crimson {
       }
 
 
+      // the executor's counterpart of run_sched_ahead
+      void run_sched_ahead_job() {
+	{
+	  std::lock_guard<std::mutex> l(sched_ahead_mtx);
+	  if (TimeZero == sched_ahead_when) {
+	    return;
+	  }
+	  const Time now = get_time();
+	  if (now < sched_ahead_when) {
+	    // woken early, as the two clocks can drift
+	    executor->schedule_at(sched_ahead_job,
+				  super::executor_time(sched_ahead_when, now));
+	    return;
+	  }
+	  sched_ahead_when = TimeZero;
+	}
+	if (!this->finishing) {
+	  std::unique_lock<std::mutex> g(this->data_mtx);
+	  schedule_request();
+	  super::deliver_expired(g);
+	}
+      }
+
+
       void sched_at(Time when) {
 	std::lock_guard<std::mutex> l(sched_ahead_mtx);
 	if (TimeZero == sched_ahead_when || when < sched_ahead_when) {
 	  sched_ahead_when = when;
-	  sched_ahead_cv.notify_one();
+	  if (executor) {
+	    executor->schedule_at(sched_ahead_job,
+				  super::executor_time(when, get_time()));
+	  } else {
+	    sched_ahead_cv.notify_one();
+	  }
 	}
       }
+
     }; // class PushPriorityQueue
 
   } // namespace dmclock
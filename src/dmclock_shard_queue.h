@@ -0,0 +1,228 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#pragma once
+
+/* ShardedPullQueue splits one process's scheduling across N
+ * PullPriorityQueue shards (e.g., one per core) that share no lock,
+ * and keeps each client's reservation and weight across all of them
+ * the way distributed dmclock does across servers. Each shard plays
+ * the part of a server, and ShardTracker plays the part of the
+ * clients' ServiceTrackers: when a request is added to a shard, the
+ * tracker supplies the delta and rho counting the client's dispatches
+ * by the other shards since its previous request to this one.
+ *
+ * A client's global dispatch counters are atomics; each shard keeps
+ * its own view of its clients under a lock of its own, so shards only
+ * contend on a registry lock the first time a shard sees a client.
+ * Tracker state is kept for every client seen.
+ */
+
+#include <assert.h>
+
+#include <memory>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+#include "dmclock_server.h"
+#include "dmclock_client.h"
+
+
+namespace crimson {
+
+  namespace dmclock {
+
+    template<typename C>
+    class ShardTracker {
+
+      struct ClientCounters {
+	std::atomic<Counter> delta; // dispatches by all shards
+	std::atomic<Counter> rho;   // those in the reservation phase
+
+	ClientCounters() :
+	  delta(1),
+	  rho(1)
+	{
+	  // empty
+	}
+      };
+
+      // a shard's view of one client, as a ServiceTracker's of a server
+      struct ShardClient {
+	ClientCounters& counters;
+	ServerInfo      info;
+
+	ShardClient(ClientCounters& _counters) :
+	  counters(_counters),
+	  info(_counters.delta.load(), _counters.rho.load())
+	{
+	  // empty
+	}
+      };
+
+      struct Shard {
+	std::mutex                mtx;
+	std::map<C,ShardClient>   clients;
+      };
+
+      std::mutex registry_mtx;
+      std::map<C,std::unique_ptr<ClientCounters>> registry;
+      std::vector<std::unique_ptr<Shard>> shards;
+
+    public:
+
+      ShardTracker(size_t shard_count) {
+	for (size_t i = 0; i < shard_count; ++i) {
+	  shards.emplace_back(new Shard);
+	}
+      }
+
+
+      // the ReqParams for a request the client is adding to shard
+      ReqParams get_req_params(const C& client, size_t shard) {
+	Shard& s = *shards[shard];
+	std::lock_guard<std::mutex> g(s.mtx);
+	auto it = s.clients.find(client);
+	if (s.clients.end() == it) {
+	  s.clients.emplace(client, ShardClient(lookup(client)));
+	  return ReqParams(1, 1);
+	}
+
+	ShardClient& sc = it->second;
+	// read rho first; track_dispatch advances delta first, so
+	// rho can't get ahead of delta
+	const Counter rho_counter = sc.counters.rho.load();
+	const Counter delta_counter = sc.counters.delta.load();
+	Counter delta = 1 + delta_counter -
+	  sc.info.delta_prev_req - sc.info.my_delta;
+	Counter rho = 1 + rho_counter -
+	  sc.info.rho_prev_req - sc.info.my_rho;
+	sc.info.req_update(delta_counter, rho_counter);
+
+	delta = std::max<Counter>(1, delta);
+	rho = std::min(std::max<Counter>(1, rho), delta);
+	return ReqParams(uint32_t(delta), uint32_t(rho));
+      }
+
+
+      // records that shard dispatched one of client's requests in phase
+      void track_dispatch(const C& client, size_t shard, PhaseType phase) {
+	Shard& s = *shards[shard];
+	std::lock_guard<std::mutex> g(s.mtx);
+	auto it = s.clients.find(client);
+	if (s.clients.end() == it) {
+	  it = s.clients.emplace(client, ShardClient(lookup(client))).first;
+	}
+	ShardClient& sc = it->second;
+	sc.info.resp_update(phase);
+	++sc.counters.delta;
+	if (PhaseType::reservation == phase) {
+	  ++sc.counters.rho;
+	}
+      }
+
+    protected:
+
+      ClientCounters& lookup(const C& client) {
+	std::lock_guard<std::mutex> g(registry_mtx);
+	auto it = registry.find(client);
+	if (registry.end() == it) {
+	  it = registry.emplace(client,
+				std::unique_ptr<ClientCounters>(
+				  new ClientCounters)).first;
+	}
+	return *it->second;
+      }
+    }; // class ShardTracker
+
+
+    template<typename C, typename R, uint B=2>
+    class ShardedPullQueue {
+
+    public:
+
+      using Queue = PullPriorityQueue<C,R,B>;
+      using PullReq = typename Queue::PullReq;
+      using ClientInfoFunc = typename Queue::ClientInfoFunc;
+
+    protected:
+
+      std::vector<std::unique_ptr<Queue>> shards;
+      ShardTracker<C> tracker;
+
+    public:
+
+      ShardedPullQueue(size_t shard_count,
+		       ClientInfoFunc client_info_f,
+		       bool allow_limit_break = false) :
+	tracker(shard_count)
+      {
+	assert(shard_count > 0);
+	for (size_t i = 0; i < shard_count; ++i) {
+	  shards.emplace_back(new Queue(client_info_f, allow_limit_break));
+	  shards.back()->set_accumulate_req_params(true);
+	}
+      }
+
+
+      size_t shard_count() const {
+	return shards.size();
+      }
+
+
+      // for configuring a shard; requests added to it directly are
+      // not seen by the tracker
+      Queue& get_shard(size_t shard) {
+	return *shards[shard];
+      }
+
+
+      inline void add_request(const R& request,
+			      const C& client_id,
+			      size_t shard,
+			      double addl_cost = 0.0) {
+	add_request_time(request, client_id, shard, get_time(), addl_cost);
+      }
+
+
+      void add_request_time(const R& request,
+			    const C& client_id,
+			    size_t shard,
+			    const Time time,
+			    double addl_cost = 0.0) {
+	shards[shard]->add_request_time(request,
+					client_id,
+					tracker.get_req_params(client_id,
+							       shard),
+					time,
+					addl_cost);
+      }
+
+
+      inline PullReq pull_request(size_t shard) {
+	return pull_request(shard, get_time());
+      }
+
+
+      // called by the shard's worker
+      PullReq pull_request(size_t shard, Time now) {
+	PullReq result = shards[shard]->pull_request(now);
+	if (result.is_retn()) {
+	  tracker.track_dispatch(result.get_retn().client,
+				 shard,
+				 result.get_retn().phase);
+	}
+	return result;
+      }
+    }; // class ShardedPullQueue
+
+  } // namespace dmclock
+} // namespace crimson
@@ -0,0 +1,586 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#pragma once
+
+/* A dmclock queue that several processes submit to. The dispatching
+ * (device) process creates a SharedPullQueue, which places a bounded
+ * submission ring in a named POSIX shared-memory segment; front-end
+ * processes attach to it with ShmSubmitter and write their request
+ * descriptors directly into the ring's slots. The dispatcher moves
+ * submitted requests into its own PullPriorityQueue as it pulls, so
+ * one set of client records and heaps, touched only by the
+ * dispatcher, enforces dmclock across all submitting processes.
+ *
+ * The ring is a lock-free multi-producer, single-consumer queue, so a
+ * submitter never waits on the dispatcher or on other submitters; a
+ * submission is refused when the ring is full. C and R must be
+ * trivially copyable, so a request descriptor should refer to its
+ * payload (e.g., by an offset into a shared buffer) rather than hold
+ * it. A submitter that dies between claiming and publishing a slot
+ * stalls the ring. Creating a ring fails with EEXIST if its segment
+ * already exists, unless replacing it is asked for explicitly.
+ *
+ * The dispatcher copies each descriptor once, from its slot into a
+ * PooledRequest, whose storage is recycled rather than taken from and
+ * returned to the heap for every request.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+
+#include "dmclock_server.h"
+
+
+namespace crimson {
+
+  namespace dmclock {
+
+    template<typename C, typename R>
+    class ShmRequestRing {
+
+      static_assert(std::is_trivially_copyable<C>::value,
+		    "client ids must be trivially copyable to be shared");
+      static_assert(std::is_trivially_copyable<R>::value,
+		    "requests must be trivially copyable to be shared");
+      static_assert(2 == ATOMIC_LLONG_LOCK_FREE,
+		    "ring needs address-free (lock-free) 64-bit atomics");
+
+      static const uint64_t ring_magic = 0x646d636c6f636b31; // "dmclock1"
+
+    public:
+
+      struct Entry {
+	C        client;
+	R        request;
+	uint32_t delta;
+	uint32_t rho;
+	double   addl_cost;
+	Time     time;
+      };
+
+    protected:
+
+      struct Slot {
+	std::atomic<uint64_t> seq;
+	Entry                 entry;
+      };
+
+      struct Header {
+	std::atomic<uint64_t> magic;
+	uint32_t              client_size;
+	uint32_t              request_size;
+	uint64_t              capacity;
+	std::atomic<uint64_t> full_count;
+	pthread_mutex_t       wait_mtx;
+	pthread_cond_t        wait_cv;
+	alignas(64) std::atomic<uint64_t> tail;    // next slot to claim
+	alignas(64) std::atomic<uint64_t> head;    // next slot to consume
+	alignas(64) std::atomic<uint32_t> consumer_waiting;
+      };
+
+      static size_t slots_offset() {
+	return (sizeof(Header) + 63) & ~size_t(63);
+      }
+
+      std::string name;
+      bool        owner;
+      size_t      map_size;
+      Header*     header;
+      Slot*       slots;
+
+    public:
+
+      // creates the named segment; capacity is rounded up to a power
+      // of two. If a segment of that name exists, e.g., left by a
+      // dispatcher that crashed, this throws EEXIST unless replace is
+      // set, in which case the existing one is unlinked first. The
+      // segment is unlinked when this is destroyed.
+      ShmRequestRing(const std::string& _name,
+		     size_t capacity,
+		     bool replace = false) :
+	name(_name),
+	owner(true)
+      {
+	size_t cap = 1;
+	while (cap < capacity) {
+	  cap <<= 1;
+	}
+	map_size = slots_offset() + cap * sizeof(Slot);
+
+	if (replace) {
+	  (void) shm_unlink(name.c_str());
+	}
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0) {
+	  throw std::system_error(errno, std::system_category(), "shm_open");
+	}
+	if (ftruncate(fd, map_size) < 0) {
+	  int err = errno;
+	  close(fd);
+	  (void) shm_unlink(name.c_str());
+	  throw std::system_error(err, std::system_category(), "ftruncate");
+	}
+	map(fd);
+
+	header = new (header) Header;
+	header->client_size = sizeof(C);
+	header->request_size = sizeof(R);
+	header->capacity = cap;
+	header->full_count = 0;
+	header->tail = 0;
+	header->head = 0;
+	header->consumer_waiting = 0;
+
+	pthread_mutexattr_t mattr;
+	pthread_mutexattr_init(&mattr);
+	pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&header->wait_mtx, &mattr);
+	pthread_mutexattr_destroy(&mattr);
+
+	pthread_condattr_t cattr;
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&header->wait_cv, &cattr);
+	pthread_condattr_destroy(&cattr);
+
+	for (uint64_t i = 0; i < cap; ++i) {
+	  new (&slots[i]) Slot;
+	  slots[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	header->magic.store(ring_magic, std::memory_order_release);
+      }
+
+
+      // attaches to a segment created by another process; throws if
+      // it does not exist or was created for different C or R
+      ShmRequestRing(const std::string& _name) :
+	name(_name),
+	owner(false)
+      {
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if (fd < 0) {
+	  throw std::system_error(errno, std::system_category(), "shm_open");
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0 || size_t(st.st_size) < slots_offset()) {
+	  close(fd);
+	  throw std::runtime_error("shared request ring " + name +
+				   " is not initialized");
+	}
+	map_size = st.st_size;
+	map(fd);
+
+	if (ring_magic != header->magic.load(std::memory_order_acquire) ||
+	    sizeof(C) != header->client_size ||
+	    sizeof(R) != header->request_size ||
+	    map_size != slots_offset() + header->capacity * sizeof(Slot)) {
+	  munmap(header, map_size);
+	  throw std::runtime_error("shared request ring " + name +
+				   " does not match this client and"
+				   " request type");
+	}
+      }
+
+
+      ShmRequestRing(const ShmRequestRing&) = delete;
+      ShmRequestRing& operator=(const ShmRequestRing&) = delete;
+
+
+      ~ShmRequestRing() {
+	if (owner) {
+	  pthread_cond_destroy(&header->wait_cv);
+	  pthread_mutex_destroy(&header->wait_mtx);
+	}
+	munmap(header, map_size);
+	if (owner) {
+	  (void) shm_unlink(name.c_str());
+	}
+      }
+
+
+      size_t capacity() const {
+	return header->capacity;
+      }
+
+
+      // submissions refused because the ring was full
+      uint64_t get_full_count() const {
+	return header->full_count.load(std::memory_order_relaxed);
+      }
+
+
+      // any number of threads in any attached process may push
+      bool push(const Entry& entry) {
+	const uint64_t mask = header->capacity - 1;
+	uint64_t pos = header->tail.load(std::memory_order_relaxed);
+	Slot* slot;
+	while (true) {
+	  slot = &slots[pos & mask];
+	  const uint64_t seq = slot->seq.load(std::memory_order_acquire);
+	  const int64_t diff = int64_t(seq) - int64_t(pos);
+	  if (0 == diff) {
+	    if (header->tail.compare_exchange_weak(pos, pos + 1,
+						   std::memory_order_relaxed)) {
+	      break;
+	    }
+	  } else if (diff < 0) {
+	    header->full_count.fetch_add(1, std::memory_order_relaxed);
+	    return false;
+	  } else {
+	    pos = header->tail.load(std::memory_order_relaxed);
+	  }
+	}
+
+	slot->entry = entry;
+	slot->seq.store(pos + 1, std::memory_order_release);
+
+	// pairs with the fence in wait_for so that either the consumer
+	// sees this entry or we see it waiting
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (header->consumer_waiting.load(std::memory_order_relaxed)) {
+	  lock_wait_mtx();
+	  pthread_cond_signal(&header->wait_cv);
+	  pthread_mutex_unlock(&header->wait_mtx);
+	}
+	return true;
+      }
+
+
+      // only the creating process's dispatcher may pop; f is given
+      // the entry in its slot, which is freed once f returns
+      template<typename F>
+      bool pop(F&& f) {
+	const uint64_t pos = header->head.load(std::memory_order_relaxed);
+	Slot& slot = slots[pos & (header->capacity - 1)];
+	if (slot.seq.load(std::memory_order_acquire) != pos + 1) {
+	  return false;
+	}
+	const Entry& entry = slot.entry;
+	f(entry);
+	slot.seq.store(pos + header->capacity, std::memory_order_release);
+	header->head.store(pos + 1, std::memory_order_relaxed);
+	return true;
+      }
+
+
+      // consumer side; waits up to timeout seconds for an entry to be
+      // pushed, returning whether one is available
+      bool wait_for(double timeout) {
+	lock_wait_mtx();
+	header->consumer_waiting.store(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	const double secs = std::max(0.0, timeout);
+	deadline.tv_sec += time_t(secs);
+	deadline.tv_nsec += long((secs - double(time_t(secs))) * 1e9);
+	if (deadline.tv_nsec >= 1000000000) {
+	  deadline.tv_sec += 1;
+	  deadline.tv_nsec -= 1000000000;
+	}
+
+	bool ready;
+	while (!(ready = has_entry())) {
+	  int r = pthread_cond_timedwait(&header->wait_cv,
+					 &header->wait_mtx,
+					 &deadline);
+	  if (EOWNERDEAD == r) {
+	    pthread_mutex_consistent(&header->wait_mtx);
+	  } else if (ETIMEDOUT == r) {
+	    ready = has_entry();
+	    break;
+	  }
+	}
+
+	header->consumer_waiting.store(0, std::memory_order_relaxed);
+	pthread_mutex_unlock(&header->wait_mtx);
+	return ready;
+      }
+
+    protected:
+
+      void map(int fd) {
+	void* addr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED, fd, 0);
+	int err = errno;
+	close(fd);
+	if (MAP_FAILED == addr) {
+	  if (owner) {
+	    (void) shm_unlink(name.c_str());
+	  }
+	  throw std::system_error(err, std::system_category(), "mmap");
+	}
+	header = static_cast<Header*>(addr);
+	slots = reinterpret_cast<Slot*>(static_cast<char*>(addr) +
+					slots_offset());
+      }
+
+      bool has_entry() const {
+	const uint64_t pos = header->head.load(std::memory_order_relaxed);
+	const Slot& slot = slots[pos & (header->capacity - 1)];
+	return slot.seq.load(std::memory_order_acquire) == pos + 1;
+      }
+
+      // a submitter that died holding the mutex leaves it
+      // inconsistent, not locked forever
+      void lock_wait_mtx() {
+	if (EOWNERDEAD == pthread_mutex_lock(&header->wait_mtx)) {
+	  pthread_mutex_consistent(&header->wait_mtx);
+	}
+      }
+    }; // class ShmRequestRing
+
+
+    // used by front-end processes to submit to a SharedPullQueue
+    template<typename C, typename R>
+    class ShmSubmitter {
+
+      using Ring = ShmRequestRing<C,R>;
+
+      Ring ring;
+
+    public:
+
+      ShmSubmitter(const std::string& name) :
+	ring(name)
+      {
+	// empty
+      }
+
+
+      // returns false, and the request is not queued, if the ring is
+      // full
+      inline bool add_request(const R& request,
+			      const C& client_id,
+			      const ReqParams& req_params,
+			      double addl_cost = 0.0) {
+	return add_request_time(request, client_id, req_params,
+				get_time(), addl_cost);
+      }
+
+
+      bool add_request_time(const R& request,
+			    const C& client_id,
+			    const ReqParams& req_params,
+			    const Time time,
+			    double addl_cost = 0.0) {
+	typename Ring::Entry entry;
+	entry.client = client_id;
+	entry.request = request;
+	entry.delta = req_params.delta;
+	entry.rho = req_params.rho;
+	entry.addl_cost = addl_cost;
+	entry.time = time;
+	return ring.push(entry);
+      }
+
+
+      uint64_t get_full_count() const {
+	return ring.get_full_count();
+      }
+    }; // class ShmSubmitter
+
+
+    // A request as a SharedPullQueue holds and returns it. Freed
+    // storage goes onto a list shared by all threads, pushed without
+    // locks; a thread allocating takes the whole list at once into
+    // its own cache, so there is no lock-free pop and thus no ABA
+    // problem. The pool only grows, to the most requests of this type
+    // outstanding at once. Free one through its own type, as the
+    // unique_ptr the queue returns does; converting that to a
+    // std::unique_ptr<R> would bypass the pool.
+    template<typename R>
+    struct PooledRequest final : public R {
+
+      static_assert(std::is_class<R>::value,
+		    "pooled requests must be of class type");
+
+      PooledRequest(const R& r) : R(r) {}
+
+      static void* operator new(size_t size) {
+	assert(sizeof(PooledRequest) == size);
+	Cache& c = cache();
+	if (nullptr == c.head) {
+	  c.head = freed().exchange(nullptr, std::memory_order_acquire);
+	  if (nullptr == c.head) {
+	    return ::operator new(std::max(size, sizeof(Node)));
+	  }
+	}
+	Node* n = c.head;
+	c.head = n->next;
+	return n;
+      }
+
+      static void operator delete(void* p) {
+	push(static_cast<Node*>(p), static_cast<Node*>(p));
+      }
+
+    private:
+
+      struct Node {
+	Node* next;
+      };
+
+      // a thread's allocations; given back to the shared list when
+      // the thread exits
+      struct Cache {
+	Node* head = nullptr;
+
+	~Cache() {
+	  if (nullptr != head) {
+	    Node* last = head;
+	    while (nullptr != last->next) {
+	      last = last->next;
+	    }
+	    push(head, last);
+	  }
+	}
+      };
+
+      static std::atomic<Node*>& freed() {
+	static std::atomic<Node*> list(nullptr);
+	return list;
+      }
+
+      static Cache& cache() {
+	static thread_local Cache c;
+	return c;
+      }
+
+      // pushes the chain from first to last onto the shared list
+      static void push(Node* first, Node* last) {
+	std::atomic<Node*>& list = freed();
+	Node* head = list.load(std::memory_order_relaxed);
+	do {
+	  last->next = head;
+	} while (!list.compare_exchange_weak(head, first,
+					     std::memory_order_release,
+					     std::memory_order_relaxed));
+      }
+    }; // struct PooledRequest
+
+
+    // the dispatching side; requests may also be added to it directly
+    // with the usual PullPriorityQueue calls, and are returned as
+    // PooledRequest<R>, which derives from R
+    template<typename C, typename R, uint B=2>
+    class SharedPullQueue : public PullPriorityQueue<C,PooledRequest<R>,B> {
+
+      using super = PullPriorityQueue<C,PooledRequest<R>,B>;
+      using Ring = ShmRequestRing<C,R>;
+
+      Ring       ring;
+      std::mutex drain_mtx; // the ring has a single consumer
+
+    public:
+
+      using Request = PooledRequest<R>;
+      using PullReq = typename super::PullReq;
+
+      // creates the shared-memory segment name (e.g., "/dmclock-sdb")
+      // with room for capacity submitted but not yet pulled requests;
+      // replace_ring allows an existing segment of that name to be
+      // replaced rather than failing with EEXIST
+      SharedPullQueue(const std::string& name,
+		      size_t capacity,
+		      typename super::ClientInfoFunc client_info_f,
+		      bool allow_limit_break = false,
+		      bool replace_ring = false) :
+	super(client_info_f, allow_limit_break),
+	ring(name, capacity, replace_ring)
+      {
+	// empty
+      }
+
+
+      // moves submitted requests into the queue, returning how many
+      size_t drain() {
+	std::lock_guard<std::mutex> g(drain_mtx);
+	size_t count = 0;
+	// the request is copied once, from its slot into pooled storage
+	auto add = [this] (const typename Ring::Entry& entry) {
+	  super::add_request(typename super::RequestRef(
+			       new Request(entry.request)),
+			     entry.client,
+			     ReqParams(entry.delta, entry.rho),
+			     entry.time,
+			     entry.addl_cost);
+	};
+	while (ring.pop(add)) {
+	  ++count;
+	}
+	return count;
+      }
+
+
+      inline PullReq pull_request() {
+	return pull_request(get_time());
+      }
+
+
+      PullReq pull_request(Time now) {
+	drain();
+	return super::pull_request(now);
+      }
+
+
+      // as PullPriorityQueue::wait_pull, but woken by submissions
+      // through the ring rather than by direct add_request calls
+      template<typename Rep, typename Per>
+      PullReq wait_pull(std::chrono::duration<Rep,Per> timeout) {
+	using Seconds = std::chrono::duration<double>;
+	const Time give_up =
+	  get_time() + std::chrono::duration_cast<Seconds>(timeout).count();
+	while (true) {
+	  const Time now = get_time();
+	  PullReq result = pull_request(now);
+	  if (result.is_retn() || now >= give_up) {
+	    return result;
+	  }
+	  const Time wake = result.is_future() ?
+	    std::min(give_up, result.getTime()) : give_up;
+	  (void) ring.wait_for(wake - now);
+	}
+      }
+
+
+      size_t ring_capacity() const {
+	return ring.capacity();
+      }
+
+
+      uint64_t get_ring_full_count() const {
+	return ring.get_full_count();
+      }
+    }; // class SharedPullQueue
+
+  } // namespace dmclock
+} // namespace crimson
@@ -0,0 +1,179 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#pragma once
+
+/* PullTenantQueue schedules requests in two levels, like
+ * PullClassQueue, for when there are many groups rather than a few.
+ * Each client (e.g., a volume) belongs to a tenant. Tenants are
+ * scheduled against one another with dmclock using a tenant-level
+ * reservation, weight, and limit, and within a tenant the per-client
+ * dmclock of a PullPriorityQueue picks the request.
+ *
+ * Tenants are kept in heaps by TwoLevelPullQueue, so a dispatch costs
+ * O(log tenants) plus the tenant queue's O(log clients in the
+ * tenant). With allow_limit_break, tenant limits may be broken but
+ * client limits within a tenant are not.
+ */
+
+#include <functional>
+#include <chrono>
+
+#include "dmclock_server.h"
+#include "dmclock_two_level_queue.h"
+
+
+namespace crimson {
+
+  namespace dmclock {
+
+    // T is the tenant type, C the client type, R the request type
+    template<typename T, typename C, typename R, uint B=2>
+    class PullTenantQueue : public TwoLevelPullQueue<T,C,R,B> {
+      using super = TwoLevelPullQueue<T,C,R,B>;
+
+    public:
+
+      using RequestRef = typename super::RequestRef;
+      using ClientInfoFunc = typename super::ClientInfoFunc;
+      using TenantInfoFunc = std::function<ClientInfo(const T&)>;
+      using NextReqType = typename super::NextReqType;
+
+      struct Retn {
+	C          client;
+	T          tenant;
+	RequestRef request;
+	PhaseType  phase;        // per-client phase, for the client tracker
+	PhaseType  tenant_phase; // phase the tenant was scheduled in
+      };
+
+      // When a request is pulled, this is the return type.
+      using PullReq = typename super::template PullReqOf<Retn>;
+
+    protected:
+
+      using GroupRec = typename super::GroupRec;
+      using DataGuard = typename super::DataGuard;
+
+      TenantInfoFunc tenant_info_f;
+
+    public:
+
+      PullTenantQueue(TenantInfoFunc _tenant_info_f,
+		      ClientInfoFunc _client_info_f,
+		      bool _allow_limit_break = false) :
+	super(_client_info_f,
+	      nullptr,
+	      std::chrono::minutes(10),
+	      std::chrono::minutes(15),
+	      std::chrono::minutes(6),
+	      _allow_limit_break,
+	      false),
+	tenant_info_f(_tenant_info_f)
+      {
+	// empty
+      }
+
+
+      // these versions start no thread; the cleaning jobs run on the
+      // executor, which must outlive the queue. The ages apply to
+      // both the tenants and the clients within them.
+      template<typename Rep, typename Per>
+      PullTenantQueue(TenantInfoFunc _tenant_info_f,
+		      ClientInfoFunc _client_info_f,
+		      TimerExecutor& _executor,
+		      std::chrono::duration<Rep,Per> _idle_age,
+		      std::chrono::duration<Rep,Per> _erase_age,
+		      std::chrono::duration<Rep,Per> _check_time,
+		      bool _allow_limit_break = false) :
+	super(_client_info_f,
+	      &_executor,
+	      _idle_age, _erase_age, _check_time,
+	      _allow_limit_break,
+	      false),
+	tenant_info_f(_tenant_info_f)
+      {
+	// empty
+      }
+
+
+      PullTenantQueue(TenantInfoFunc _tenant_info_f,
+		      ClientInfoFunc _client_info_f,
+		      TimerExecutor& _executor,
+		      bool _allow_limit_break = false) :
+	PullTenantQueue(_tenant_info_f,
+			_client_info_f,
+			_executor,
+			std::chrono::minutes(10),
+			std::chrono::minutes(15),
+			std::chrono::minutes(6),
+			_allow_limit_break)
+      {
+	// empty
+      }
+
+
+      inline void add_request(const R& request,
+			      const T& tenant,
+			      const C& client_id,
+			      const ReqParams& req_params,
+			      double addl_cost = 0.0) {
+	add_request(RequestRef(new R(request)),
+		    tenant, client_id, req_params, get_time(), addl_cost);
+      }
+
+
+      inline void add_request_time(const R& request,
+				   const T& tenant,
+				   const C& client_id,
+				   const ReqParams& req_params,
+				   const Time time,
+				   double addl_cost = 0.0) {
+	add_request(RequestRef(new R(request)),
+		    tenant, client_id, req_params, time, addl_cost);
+      }
+
+
+      // this does the work; the versions above provide alternate
+      // interfaces. A client must always be added under the same
+      // tenant.
+      void add_request(RequestRef&&     request,
+		       const T&         tenant,
+		       const C&         client_id,
+		       const ReqParams& req_params,
+		       const Time       time,
+		       double           addl_cost = 0.0) {
+	DataGuard g(this->data_mtx);
+	GroupRec* ten = this->find_group(tenant);
+	if (nullptr == ten) {
+	  ten = &this->add_group(tenant, tenant_info_f(tenant));
+	}
+	this->do_add_request(*ten, std::move(request),
+			     client_id, req_params, time, addl_cost);
+      }
+
+
+      inline PullReq pull_request() {
+	return pull_request(get_time());
+      }
+
+
+      PullReq pull_request(Time now) {
+	DataGuard g(this->data_mtx);
+	return this->template do_pull_request<Retn>(now);
+      }
+
+
+      size_t tenant_count() const {
+	DataGuard g(this->data_mtx);
+	return this->group_map.size();
+      }
+    }; // class PullTenantQueue
+
+  } // namespace dmclock
+} // namespace crimson
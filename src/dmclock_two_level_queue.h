@@ -0,0 +1,545 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#pragma once
+
+/* TwoLevelPullQueue is the base of the two-level schedulers
+ * PullClassQueue and PullTenantQueue. Each client's requests belong
+ * to a group (e.g., an op class or a tenant). Groups are scheduled
+ * against one another with dmclock using a group-level reservation,
+ * weight, and limit, and within a group the per-client dmclock of a
+ * PullPriorityQueue picks the request.
+ *
+ * Groups are kept in heaps as clients are in PriorityQueueBase, so a
+ * dispatch costs O(log groups) plus the group queue's O(log clients
+ * in the group). A group whose clients are all held back by their own
+ * limits is set aside until the earliest of them is due.
+ *
+ * Group-level tags count each request once (delta and rho of 1); the
+ * request's ReqParams apply to the client's tags within the group.
+ * Group records without requests are erased once unused for erase_age,
+ * as client records are. The group queues and the group cleaning run
+ * on one TimerExecutor, either the caller's or one the queue starts.
+ */
+
+#include <assert.h>
+
+#include <memory>
+#include <functional>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+
+#include <boost/variant.hpp>
+
+#include "dmclock_server.h"
+#include "indirect_intrusive_heap.h"
+#include "timer_executor.h"
+#include "run_every.h"
+
+
+namespace crimson {
+
+  namespace dmclock {
+
+    // G is the group type, C the client type, R the request type
+    template<typename G, typename C, typename R, uint B=2>
+    class TwoLevelPullQueue {
+
+    public:
+
+      using Queue = PullPriorityQueue<C,R,B>;
+      using RequestRef = typename Queue::RequestRef;
+      using ClientInfoFunc = typename Queue::ClientInfoFunc;
+      using NextReqType = typename Queue::NextReqType;
+
+      // When a request is pulled, this is the return type; Rt is the
+      // queue's Retn, which starts with the client, group, request,
+      // per-client phase, and group phase, in that order.
+      template<typename Rt>
+      struct PullReqOf {
+	using Retn = Rt;
+
+	NextReqType               type;
+	boost::variant<Retn,Time> data;
+
+	bool is_none() const { return type == NextReqType::none; }
+
+	bool is_retn() const { return type == NextReqType::returning; }
+	Retn& get_retn() {
+	  return boost::get<Retn>(data);
+	}
+
+	bool is_future() const { return type == NextReqType::future; }
+	Time getTime() const { return boost::get<Time>(data); }
+      };
+
+    protected:
+
+      struct GroupRec {
+	const G          group;
+	const ClientInfo info;
+	std::unique_ptr<Queue> queue;   // per-client dmclock
+	RequestTag       prev_tag;      // tags of the last dispatch
+	RequestTag       tag;           // tags of the next dispatch
+	std::deque<Time> arrivals;      // of the queued requests
+	bool             ready = false; // within its limit
+	Time             held_until = TimeZero; // clients all limited
+	Counter          last_tick = 0; // tick of the last request added
+
+	IndIntruHeapData resv_heap_data;
+	IndIntruHeapData limit_heap_data;
+	IndIntruHeapData ready_heap_data;
+	IndIntruHeapData prop_heap_data;
+
+	GroupRec(const G& _group,
+		 const ClientInfo& _info,
+		 Queue* _queue) :
+	  group(_group),
+	  info(_info),
+	  queue(_queue),
+	  prev_tag(0.0, 0.0, 0.0, TimeZero),
+	  tag(0.0, 0.0, 0.0, TimeZero)
+	{
+	  // empty
+	}
+
+	inline bool has_request() const {
+	  return !arrivals.empty();
+	}
+
+	inline bool held() const {
+	  return TimeZero != held_until;
+	}
+
+	// when the group may next be scheduled by reservation, or by
+	// weight once within its limit
+	inline Time resv_when() const {
+	  return std::max(tag.reservation, held_until);
+	}
+
+	inline Time limit_when() const {
+	  return std::max(tag.limit, held_until);
+	}
+      }; // struct GroupRec
+
+      using GroupRecRef = std::shared_ptr<GroupRec>;
+      using TimePoint = std::chrono::steady_clock::time_point;
+      using Duration = std::chrono::milliseconds;
+      using MarkPoint = std::pair<TimePoint,Counter>;
+
+      // Groups without requests sort last in every heap. Within the
+      // ready heap, groups within their limits come first, then those
+      // beyond them, then those set aside; within the limit heap,
+      // those not yet within their limits.
+      struct ResvCompare {
+	bool operator()(const GroupRec& n1, const GroupRec& n2) const {
+	  if (n1.has_request() != n2.has_request()) {
+	    return n1.has_request();
+	  }
+	  return n1.resv_when() < n2.resv_when();
+	}
+      };
+
+      struct LimitCompare {
+	bool operator()(const GroupRec& n1, const GroupRec& n2) const {
+	  const bool w1 = n1.has_request() && !n1.ready;
+	  const bool w2 = n2.has_request() && !n2.ready;
+	  if (w1 != w2) {
+	    return w1;
+	  }
+	  return n1.limit_when() < n2.limit_when();
+	}
+      };
+
+      struct ReadyCompare {
+	bool operator()(const GroupRec& n1, const GroupRec& n2) const {
+	  if (n1.has_request() != n2.has_request()) {
+	    return n1.has_request();
+	  }
+	  if (n1.ready != n2.ready) {
+	    return n1.ready;
+	  }
+	  if (n1.held() != n2.held()) {
+	    return n2.held();
+	  }
+	  if (n1.held()) {
+	    return n1.held_until < n2.held_until;
+	  }
+	  return n1.tag.proportion < n2.tag.proportion;
+	}
+      };
+
+      struct PropCompare {
+	bool operator()(const GroupRec& n1, const GroupRec& n2) const {
+	  if (n1.has_request() != n2.has_request()) {
+	    return n1.has_request();
+	  }
+	  return n1.tag.proportion < n2.tag.proportion;
+	}
+      };
+
+      ClientInfoFunc client_info_f;
+      bool           allow_limit_break;
+      bool           break_client_limits;
+
+      mutable std::mutex data_mtx;
+      using DataGuard = std::lock_guard<decltype(data_mtx)>;
+
+      // set if no executor was given; declared before the group
+      // records so it outlives them
+      std::unique_ptr<TimerExecutor> own_executor;
+      TimerExecutor&                 executor;
+
+      std::map<G,GroupRecRef> group_map;
+      size_t request_total = 0;
+      Counter tick = 0;
+
+      IndIntruHeap<GroupRecRef,
+		   GroupRec,
+		   &GroupRec::resv_heap_data,
+		   ResvCompare,
+		   B> resv_heap;
+      IndIntruHeap<GroupRecRef,
+		   GroupRec,
+		   &GroupRec::limit_heap_data,
+		   LimitCompare,
+		   B> limit_heap;
+      IndIntruHeap<GroupRecRef,
+		   GroupRec,
+		   &GroupRec::ready_heap_data,
+		   ReadyCompare,
+		   B> ready_heap;
+      IndIntruHeap<GroupRecRef,
+		   GroupRec,
+		   &GroupRec::prop_heap_data,
+		   PropCompare,
+		   B> prop_heap;
+
+      // performance data collection
+      size_t reserv_sched_count = 0;
+      size_t prop_sched_count = 0;
+      size_t limit_break_sched_count = 0;
+
+      // the group queues use the same ages for their clients
+      Duration              idle_age;
+      Duration              erase_age;
+      Duration              check_time;
+      std::deque<MarkPoint> clean_mark_points;
+
+      // NB: declared last, so destructed first
+
+      std::unique_ptr<RunEvery> cleaning_job;
+
+      // with allow_limit_break, group limits may be broken, and so
+      // may client limits within a group if break_client_limits. If
+      // no executor is given, the queue starts one of its own.
+      template<typename Rep, typename Per>
+      TwoLevelPullQueue(ClientInfoFunc _client_info_f,
+			TimerExecutor* _executor,
+			std::chrono::duration<Rep,Per> _idle_age,
+			std::chrono::duration<Rep,Per> _erase_age,
+			std::chrono::duration<Rep,Per> _check_time,
+			bool _allow_limit_break,
+			bool _break_client_limits) :
+	client_info_f(_client_info_f),
+	allow_limit_break(_allow_limit_break),
+	break_client_limits(_allow_limit_break && _break_client_limits),
+	own_executor(_executor ? nullptr : new TimerExecutor),
+	executor(_executor ? *_executor : *own_executor),
+	idle_age(std::chrono::duration_cast<Duration>(_idle_age)),
+	erase_age(std::chrono::duration_cast<Duration>(_erase_age)),
+	check_time(std::chrono::duration_cast<Duration>(_check_time))
+      {
+	assert(_erase_age >= _idle_age);
+	assert(_check_time < _idle_age);
+	cleaning_job =
+	  std::unique_ptr<RunEvery>(
+	    new RunEvery(executor,
+			 check_time,
+			 std::bind(&TwoLevelPullQueue::do_clean, this)));
+      }
+
+    public:
+
+      bool empty() const {
+	DataGuard g(data_mtx);
+	return 0 == request_total;
+      }
+
+
+      size_t request_count() const {
+	DataGuard g(data_mtx);
+	return request_total;
+      }
+
+    protected:
+
+      // data_mtx must be held by caller; nullptr if the group has not
+      // been seen
+      GroupRec* find_group(const G& group) {
+	auto it = group_map.find(group);
+	return group_map.end() == it ? nullptr : it->second.get();
+      }
+
+
+      // data_mtx must be held by caller; scheduled groups get a
+      // client queue and are entered in the heaps, others are only
+      // recorded (see PullClassQueue's strict lane)
+      GroupRec& add_group(const G& group,
+			  const ClientInfo& info,
+			  bool scheduled = true) {
+	Queue* queue = scheduled ?
+	  new Queue(client_info_f, executor,
+		    idle_age, erase_age, check_time,
+		    break_client_limits) :
+	  nullptr;
+	GroupRecRef rec = std::make_shared<GroupRec>(group, info, queue);
+	group_map.emplace(group, rec);
+	if (scheduled) {
+	  resv_heap.push(rec);
+	  limit_heap.push(rec);
+	  ready_heap.push(rec);
+	  prop_heap.push(rec);
+	}
+	return *rec;
+      }
+
+
+      // data_mtx must be held by caller; rec must be scheduled
+      void do_add_request(GroupRec&        rec,
+			  RequestRef&&     request,
+			  const C&         client_id,
+			  const ReqParams& req_params,
+			  const Time       time,
+			  double           addl_cost) {
+	rec.queue->add_request(std::move(request),
+			       client_id,
+			       req_params,
+			       time,
+			       addl_cost);
+	if (!rec.has_request()) {
+	  activate(rec, time);
+	}
+	rec.last_tick = ++tick;
+	rec.arrivals.push_back(time);
+	// the new request's client may not be limited
+	rec.held_until = TimeZero;
+	++request_total;
+	adjust_heaps(rec);
+      }
+
+
+      // data_mtx must be held by caller
+      template<typename Retn>
+      PullReqOf<Retn> do_pull_request(Time now) {
+	PullReqOf<Retn> result;
+
+	// try constraint (reservation) based scheduling; a group whose
+	// clients are all limited is set aside and the next one tried
+	while (!resv_heap.empty() &&
+	       resv_heap.top().has_request() &&
+	       resv_heap.top().resv_when() <= now) {
+	  if (try_group(resv_heap.top(), PhaseType::reservation,
+			now, result)) {
+	    ++reserv_sched_count;
+	    return result;
+	  }
+	}
+
+	while (true) {
+	  // groups that have come within their limits become ready
+	  while (!limit_heap.empty()) {
+	    GroupRec& top = limit_heap.top();
+	    if (!top.has_request() || top.ready || top.limit_when() > now) {
+	      break;
+	    }
+	    top.ready = true;
+	    top.held_until = TimeZero;
+	    adjust_heaps(top);
+	  }
+
+	  // try weight-based scheduling among groups within their limits
+	  if (ready_heap.empty()) break;
+	  GroupRec& top = ready_heap.top();
+	  if (!top.has_request() ||
+	      !top.ready ||
+	      top.tag.proportion >= max_tag) {
+	    break;
+	  }
+	  if (try_group(top, PhaseType::priority, now, result)) {
+	    ++prop_sched_count;
+	    return result;
+	  }
+	}
+
+	// break group limits, taking groups in proportion tag order
+	// unless set aside for their clients' limits
+	while (allow_limit_break &&
+	       !ready_heap.empty() &&
+	       ready_heap.top().has_request() &&
+	       ready_heap.top().held_until <= now) {
+	  if (try_group(ready_heap.top(), PhaseType::priority,
+			now, result)) {
+	    ++limit_break_sched_count;
+	    return result;
+	  }
+	}
+
+	// nothing can be dispatched now; when can something be?
+	Time next_when = TimeMax;
+	if (!resv_heap.empty() && resv_heap.top().has_request()) {
+	  const Time when = resv_heap.top().resv_when();
+	  if (when < max_tag) {
+	    next_when = std::min(next_when, when);
+	  }
+	}
+	if (!limit_heap.empty()) {
+	  const GroupRec& top = limit_heap.top();
+	  if (top.has_request() && !top.ready) {
+	    next_when = std::min(next_when, top.limit_when());
+	  }
+	}
+
+	if (next_when < TimeMax) {
+	  result.type = NextReqType::future;
+	  result.data = next_when;
+	} else {
+	  result.type = NextReqType::none;
+	}
+	return result;
+      } // do_pull_request
+
+
+      // data_mtx must be held by caller
+      void adjust_heaps(GroupRec& rec) {
+	resv_heap.adjust(rec);
+	limit_heap.adjust(rec);
+	ready_heap.adjust(rec);
+	prop_heap.adjust(rec);
+      }
+
+
+      // data_mtx must be held by caller; asks the group's queue for a
+      // request and fills in result if it gives one; otherwise the
+      // group is set aside until its queue can
+      template<typename Retn>
+      bool try_group(GroupRec& rec,
+		     PhaseType group_phase,
+		     Time now,
+		     PullReqOf<Retn>& result) {
+	typename Queue::PullReq pr = rec.queue->pull_request(now);
+	if (pr.is_retn()) {
+	  auto& r = pr.get_retn();
+	  result.type = NextReqType::returning;
+	  result.data = Retn{r.client,
+			     rec.group,
+			     std::move(r.request),
+			     r.phase,
+			     group_phase};
+	  rec.held_until = TimeZero;
+	  charge(rec, group_phase);
+	  return true;
+	}
+
+	// the group's requests were all added through do_add_request,
+	// so its queue only comes up empty-handed if they are limited
+	assert(pr.is_future());
+	rec.held_until = pr.getTime();
+	rec.ready = false;
+	adjust_heaps(rec);
+	return false;
+      }
+
+
+      // data_mtx must be held by caller; an idle group that becomes
+      // active starts no earlier than the lowest proportion tag among
+      // the active groups, so it can't claim the time it sat idle
+      void activate(GroupRec& rec, const Time time) {
+	rec.tag = RequestTag(rec.prev_tag, rec.info, ReqParams(), time);
+	rec.ready = false;
+
+	if (!prop_heap.empty() && prop_heap.top().has_request()) {
+	  const double lowest_prop_tag = prop_heap.top().tag.proportion;
+	  if (lowest_prop_tag < max_tag && rec.tag.proportion < max_tag) {
+	    rec.tag.proportion = std::max(rec.tag.proportion,
+					  lowest_prop_tag);
+	  }
+	}
+      }
+
+
+      // data_mtx must be held by caller; a dispatch in the weight
+      // phase gives back the reservation it would have used, as the
+      // per-client scheduler does
+      void charge(GroupRec& rec, PhaseType group_phase) {
+	rec.prev_tag = rec.tag;
+	if (PhaseType::priority == group_phase) {
+	  rec.prev_tag.shift(-rec.info.reservation_inv, 0.0);
+	}
+	rec.arrivals.pop_front();
+	--request_total;
+	if (rec.has_request()) {
+	  rec.tag = RequestTag(rec.prev_tag,
+			       rec.info,
+			       ReqParams(),
+			       rec.arrivals.front());
+	}
+	rec.ready = false;
+	adjust_heaps(rec);
+      }
+
+
+      // data_mtx must be held by caller
+      template<typename Heap>
+      static void delete_from_heap(GroupRecRef& rec, Heap& heap) {
+	auto i = heap.rfind(rec);
+	heap.remove(i);
+      }
+
+
+      // Run by cleaning_job; marks points in time as do_clean in
+      // PriorityQueueBase does, and erases the groups that have no
+      // requests and have had none added since the mark erase_age
+      // ago. A group's tags are started afresh whenever it becomes
+      // active (see activate), so no idle marking is needed.
+      void do_clean() {
+	TimePoint now = std::chrono::steady_clock::now();
+	DataGuard g(data_mtx);
+	clean_mark_points.emplace_back(MarkPoint(now, tick));
+
+	Counter erase_point = 0;
+	auto point = clean_mark_points.front();
+	while (point.first <= now - erase_age) {
+	  erase_point = point.second;
+	  clean_mark_points.pop_front();
+	  point = clean_mark_points.front();
+	}
+
+	if (erase_point > 0) {
+	  for (auto i = group_map.begin(); i != group_map.end(); /* empty */) {
+	    auto i2 = i++;
+	    GroupRecRef& rec = i2->second;
+	    if (rec->last_tick <= erase_point && !rec->has_request()) {
+	      if (rec->queue) {
+		delete_from_heap(rec, resv_heap);
+		delete_from_heap(rec, limit_heap);
+		delete_from_heap(rec, ready_heap);
+		delete_from_heap(rec, prop_heap);
+	      }
+	      group_map.erase(i2);
+	    }
+	  } // for
+	} // if
+      } // do_clean
+    }; // class TwoLevelPullQueue
+
+  } // namespace dmclock
+} // namespace crimson
@@ -36,12 +36,15 @@ namespace crimson {
    * is stored.
    *
    * K is the branching factor of the heap, default is 2 (binary heap).
+   *
+   * A is the allocator for the heap's array of I.
    */
   template<typename I,
 	   typename T,
 	   IndIntruHeapData T::*heap_info,
 	   typename C,
-	   uint K = 2>
+	   uint K = 2,
+	   typename A = std::allocator<I>>
   class IndIntruHeap {
 
     // shorthand
@@ -59,12 +62,12 @@ namespace crimson {
     static_assert(K >= 2, "K (degree of branching) must be at least 2");
 
     class Iterator {
-      friend IndIntruHeap<I, T, heap_info, C, K>;
+      friend IndIntruHeap<I, T, heap_info, C, K, A>;
 
-      IndIntruHeap<I, T, heap_info, C, K>& heap;
+      IndIntruHeap<I, T, heap_info, C, K, A>& heap;
       HeapIndex                            index;
 
-      Iterator(IndIntruHeap<I, T, heap_info, C, K>& _heap, HeapIndex _index) :
+      Iterator(IndIntruHeap<I, T, heap_info, C, K, A>& _heap, HeapIndex _index) :
 	heap(_heap),
 	index(_index)
       {
@@ -131,12 +134,12 @@ namespace crimson {
 
 
     class ConstIterator {
-      friend IndIntruHeap<I, T, heap_info, C, K>;
+      friend IndIntruHeap<I, T, heap_info, C, K, A>;
 
-      const IndIntruHeap<I, T, heap_info, C, K>& heap;
+      const IndIntruHeap<I, T, heap_info, C, K, A>& heap;
       HeapIndex                                  index;
 
-      ConstIterator(const IndIntruHeap<I, T, heap_info, C, K>& _heap,
+      ConstIterator(const IndIntruHeap<I, T, heap_info, C, K, A>& _heap,
 		    HeapIndex _index) :
 	heap(_heap),
 	index(_index)
@@ -198,9 +201,9 @@ namespace crimson {
 
   protected:
 
-    std::vector<I> data;
-    HeapIndex      count;
-    C              comparator;
+    std::vector<I,A> data;
+    HeapIndex        count;
+    C                comparator;
 
   public:
 
@@ -210,7 +213,15 @@ namespace crimson {
       // empty
     }
 
-    IndIntruHeap(const IndIntruHeap<I,T,heap_info,C,K>& other) :
+    IndIntruHeap(const A& alloc) :
+      data(alloc),
+      count(0)
+    {
+      // empty
+    }
+
+    IndIntruHeap(const IndIntruHeap<I,T,heap_info,C,K,A>& other) :
+      data(other.data.get_allocator()),
       count(other.count)
     {
       for (HeapIndex i = 0; i < other.count; ++i) {
@@ -388,7 +399,7 @@ namespace crimson {
       auto compare = [this] (const I first, const I second) -> bool {
 	return this->comparator(*first, *second);
       };
-      std::vector<I> copy(data);
+      std::vector<I> copy(data.begin(), data.end());
       std::sort(copy.begin(), copy.end(), compare);
 
       bool first = true;
@@ -0,0 +1,266 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#pragma once
+
+/* NumaArena places memory on one NUMA node, so that structures a
+ * thread on that node walks repeatedly (e.g., a scheduler's heaps and
+ * client records) stay local to it no matter which thread allocated
+ * them. Small blocks are carved from node-placed chunks in
+ * power-of-two size classes and recycled through per-class free
+ * lists; larger blocks are placed on the node individually. Chunks
+ * are returned to the system only when the arena is destroyed, so it
+ * must outlive everything allocated from it.
+ *
+ * Placement requires libnuma and compiling with HAVE_NUMA (cmake
+ * -DNUMA=yes). An arena that is not bound to a node passes all
+ * allocations through to operator new.
+ *
+ * NumaAllocator adapts an arena to the standard allocator interface.
+ */
+
+#include <assert.h>
+
+#include <cstddef>
+#include <new>
+#include <mutex>
+#include <vector>
+#include <utility>
+
+#ifdef HAVE_NUMA
+#include <numa.h>
+#endif
+
+
+namespace crimson {
+
+  class NumaArena {
+
+    static constexpr size_t min_block = 16;
+    static constexpr size_t class_count = 9; // 16 through 4096 bytes
+    static constexpr size_t max_block = min_block << (class_count - 1);
+    static constexpr size_t chunk_size = 64 * 1024;
+
+    struct FreeBlock {
+      FreeBlock* next;
+    };
+
+    int        node;
+    size_t     node_bytes; // bytes currently handed out while bound
+
+    std::mutex mtx;
+    FreeBlock* free_lists[class_count];
+    char*      chunk_next;
+    char*      chunk_end;
+    std::vector<void*> chunks;
+
+  public:
+
+    NumaArena() :
+      node(-1),
+      node_bytes(0),
+      chunk_next(nullptr),
+      chunk_end(nullptr)
+    {
+      for (size_t i = 0; i < class_count; ++i) {
+	free_lists[i] = nullptr;
+      }
+    }
+
+    NumaArena(const NumaArena&) = delete;
+    NumaArena& operator=(const NumaArena&) = delete;
+
+    ~NumaArena() {
+      for (void* chunk : chunks) {
+	free_on_node(chunk, chunk_size);
+      }
+    }
+
+
+    // binds the arena to a node; must be called before anything is
+    // allocated from it. Returns false, leaving the arena unbound, if
+    // NUMA is unsupported or the node does not exist.
+    bool bind(int _node) {
+      assert(-1 == node && chunks.empty());
+#ifdef HAVE_NUMA
+      if (numa_available() < 0 || _node < 0 || _node > numa_max_node()) {
+	return false;
+      }
+      node = _node;
+      return true;
+#else
+      (void) _node;
+      return false;
+#endif
+    }
+
+
+    // the bound node, or -1 if unbound
+    int get_node() const {
+      return node;
+    }
+
+
+    size_t get_node_bytes() {
+      std::lock_guard<std::mutex> g(mtx);
+      return node_bytes;
+    }
+
+
+    void* allocate(size_t size) {
+      if (node < 0) {
+	return ::operator new(size);
+      }
+
+      if (size > max_block) {
+	void* p = alloc_on_node(size);
+	std::lock_guard<std::mutex> g(mtx);
+	node_bytes += size;
+	return p;
+      }
+
+      const size_t k = size_class(size);
+      const size_t block = min_block << k;
+      std::lock_guard<std::mutex> g(mtx);
+      node_bytes += block;
+      if (free_lists[k]) {
+	FreeBlock* b = free_lists[k];
+	free_lists[k] = b->next;
+	return b;
+      }
+      if (chunk_end - chunk_next < std::ptrdiff_t(block)) {
+	// the remainder of the old chunk is abandoned
+	chunk_next = static_cast<char*>(alloc_on_node(chunk_size));
+	chunk_end = chunk_next + chunk_size;
+	chunks.push_back(chunk_next);
+      }
+      void* p = chunk_next;
+      chunk_next += block;
+      return p;
+    }
+
+
+    void deallocate(void* p, size_t size) {
+      if (node < 0) {
+	::operator delete(p);
+	return;
+      }
+
+      if (size > max_block) {
+	free_on_node(p, size);
+	std::lock_guard<std::mutex> g(mtx);
+	node_bytes -= size;
+	return;
+      }
+
+      const size_t k = size_class(size);
+      FreeBlock* b = static_cast<FreeBlock*>(p);
+      std::lock_guard<std::mutex> g(mtx);
+      node_bytes -= min_block << k;
+      b->next = free_lists[k];
+      free_lists[k] = b;
+    }
+
+  protected:
+
+    static size_t size_class(size_t size) {
+      size_t k = 0;
+      while ((min_block << k) < size) {
+	++k;
+      }
+      return k;
+    }
+
+    void* alloc_on_node(size_t size) {
+#ifdef HAVE_NUMA
+      void* p = numa_alloc_onnode(size, node);
+      if (!p) {
+	throw std::bad_alloc();
+      }
+      return p;
+#else
+      return ::operator new(size);
+#endif
+    }
+
+    void free_on_node(void* p, size_t size) {
+#ifdef HAVE_NUMA
+      numa_free(p, size);
+#else
+      (void) size;
+      ::operator delete(p);
+#endif
+    }
+  }; // class NumaArena
+
+
+  template<typename T>
+  class NumaAllocator {
+
+    template<typename U>
+    friend class NumaAllocator;
+
+    NumaArena* arena;
+
+  public:
+
+    using value_type = T;
+
+    NumaAllocator(NumaArena* _arena) :
+      arena(_arena)
+    {
+      // empty
+    }
+
+    template<typename U>
+    NumaAllocator(const NumaAllocator<U>& other) :
+      arena(other.arena)
+    {
+      // empty
+    }
+
+    T* allocate(size_t n) {
+      return static_cast<T*>(arena->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) {
+      arena->deallocate(p, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const NumaAllocator<U>& other) const {
+      return arena == other.arena;
+    }
+
+    template<typename U>
+    bool operator!=(const NumaAllocator<U>& other) const {
+      return arena != other.arena;
+    }
+  }; // class NumaAllocator
+
+
+  // runs the calling thread on the CPUs of node and prefers that
+  // node for its own allocations; returns false if NUMA is
+  // unsupported or the node does not exist
+  inline bool bind_thread_to_node(int node) {
+#ifdef HAVE_NUMA
+    if (numa_available() < 0 || node < 0 || node > numa_max_node()) {
+      return false;
+    }
+    if (numa_run_on_node(node) < 0) {
+      return false;
+    }
+    numa_set_preferred(node);
+    return true;
+#else
+    (void) node;
+    return false;
+#endif
+  }
+
+} // namespace crimson
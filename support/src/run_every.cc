@@ -53,6 +53,10 @@ crimson::RunEvery& crimson::RunEvery::operator=(crimson::RunEvery&& other)
 
 
 crimson::RunEvery::~RunEvery() {
+  if (executor) {
+    executor->cancel(job_id);
+    return;
+  }
   finishing = true;
   cv.notify_all();
   thd.join();
@@ -8,18 +8,21 @@
 #pragma once
 
 #include <chrono>
+#include <functional>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
 
+#include "timer_executor.h"
+
 
 namespace crimson {
   using std::chrono::duration_cast;
   using std::chrono::milliseconds;
 
   // runs a given simple function object waiting wait_period
-  // milliseconds between; the destructor stops the other thread
-  // immediately
+  // milliseconds between, on a thread of its own or as a job of a
+  // shared TimerExecutor; the destructor stops it immediately
   class RunEvery {
     using Lock      = std::unique_lock<std::mutex>;
     using Guard     = std::lock_guard<std::mutex>;
@@ -31,6 +34,9 @@ namespace crimson {
     std::mutex                mtx;
     std::condition_variable   cv;
 
+    TimerExecutor*            executor = nullptr;
+    TimerExecutor::JobId      job_id = 0;
+
     // put threads last so all other variables are initialized first
 
     std::thread               thd;
@@ -50,6 +56,17 @@ namespace crimson {
       thd = std::thread(&RunEvery::run, this);
     }
 
+    template<typename D>
+    RunEvery(TimerExecutor&        _executor,
+	     D                     _wait_period,
+	     std::function<void()> _body) :
+      wait_period(duration_cast<milliseconds>(_wait_period)),
+      body(_body),
+      executor(&_executor)
+    {
+      job_id = executor->add_periodic(wait_period, body);
+    }
+
     RunEvery(const RunEvery& other) = delete;
     RunEvery& operator=(const RunEvery& other) = delete;
     RunEvery(RunEvery&& other) = delete;
@@ -0,0 +1,150 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#include <assert.h>
+
+#include "timer_executor.h"
+
+
+crimson::TimerExecutor::TimerExecutor(size_t thread_count) {
+  assert(thread_count > 0);
+  for (size_t i = 0; i < thread_count; ++i) {
+    threads.emplace_back(&TimerExecutor::run, this);
+  }
+}
+
+
+crimson::TimerExecutor::~TimerExecutor() {
+  {
+    Guard g(mtx);
+    finishing = true;
+  }
+  cv.notify_all();
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+
+crimson::TimerExecutor::JobId
+crimson::TimerExecutor::add_job(std::function<void()> body) {
+  Guard g(mtx);
+  JobId id = next_id++;
+  jobs.emplace(id, Job(body, std::chrono::milliseconds(0)));
+  return id;
+}
+
+
+void crimson::TimerExecutor::schedule_at(JobId id, TimePoint when) {
+  Guard g(mtx);
+  do_schedule_at(id, when);
+}
+
+
+void crimson::TimerExecutor::do_schedule_at(JobId id, TimePoint when) {
+  auto it = jobs.find(id);
+  assert(jobs.end() != it);
+  Job& job = it->second;
+  if (job.cancelled || job.when <= when) {
+    return;
+  }
+  if (TimePoint::max() != job.when) {
+    due.erase(std::make_pair(job.when, id));
+  }
+  job.when = when;
+  due.emplace(when, id);
+  if (due.begin()->second == id) {
+    cv.notify_one();
+  }
+}
+
+
+void crimson::TimerExecutor::cancel(JobId id) {
+  Lock l(mtx);
+  auto it = jobs.find(id);
+  if (jobs.end() == it) {
+    return;
+  }
+  Job& job = it->second;
+  job.cancelled = true;
+  if (TimePoint::max() != job.when) {
+    due.erase(std::make_pair(job.when, id));
+    job.when = TimePoint::max();
+  }
+  if (job.running) {
+    if (std::this_thread::get_id() == job.runner) {
+      // the worker removes it once the body returns
+      job.erase_after_run = true;
+      return;
+    }
+    done_cv.wait(l, [this, id] {
+	auto i = jobs.find(id);
+	return jobs.end() == i || !i->second.running;
+      });
+  }
+  jobs.erase(id);
+}
+
+
+size_t crimson::TimerExecutor::job_count() {
+  Guard g(mtx);
+  return jobs.size();
+}
+
+
+void crimson::TimerExecutor::run() {
+  Lock l(mtx);
+  while (!finishing) {
+    if (due.empty()) {
+      cv.wait(l);
+      continue;
+    }
+
+    const auto first = *due.begin();
+    if (Clock::now() < first.first) {
+      cv.wait_until(l, first.first);
+      continue;
+    }
+    due.erase(due.begin());
+
+    Job& job = jobs.at(first.second);
+    job.when = TimePoint::max();
+    if (job.running) {
+      job.rerun = true;
+      continue;
+    }
+
+    // more may be due; let another worker look
+    if (!due.empty()) {
+      cv.notify_one();
+    }
+
+    job.running = true;
+    job.runner = std::this_thread::get_id();
+    l.unlock();
+    job.body();
+    l.lock();
+    job.running = false;
+
+    if (job.cancelled) {
+      // cancel erases it, unless called from the body itself
+      if (job.erase_after_run) {
+	jobs.erase(first.second);
+      }
+      done_cv.notify_all();
+      continue;
+    }
+
+    if (job.period.count() > 0) {
+      do_schedule_at(first.second, Clock::now() + job.period);
+    }
+    if (job.rerun) {
+      job.rerun = false;
+      do_schedule_at(first.second, Clock::now());
+    }
+  }
+}
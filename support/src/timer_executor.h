@@ -0,0 +1,123 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <map>
+#include <set>
+
+
+namespace crimson {
+
+  // runs timed jobs for many owners on a small, fixed pool of
+  // threads, so that owners (e.g., one queue per PG) need no threads
+  // of their own. A job is either periodic, running each period after
+  // its previous run finishes, or runs once each time it is
+  // scheduled. A job never runs on two threads at once; one that
+  // comes due while running runs again when it finishes.
+  class TimerExecutor {
+
+  public:
+
+    using JobId     = uint64_t;
+    using Clock     = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+
+  protected:
+
+    using Lock  = std::unique_lock<std::mutex>;
+    using Guard = std::lock_guard<std::mutex>;
+
+    struct Job {
+      std::function<void()>     body;
+      std::chrono::milliseconds period;   // zero if not periodic
+      TimePoint                 when;     // TimePoint::max() if not due
+      bool                      running = false;
+      bool                      rerun = false;
+      bool                      cancelled = false;
+      bool                      erase_after_run = false;
+      std::thread::id           runner;
+
+      Job(std::function<void()> _body, std::chrono::milliseconds _period) :
+	body(_body),
+	period(_period),
+	when(TimePoint::max())
+      {
+	// empty
+      }
+    };
+
+    bool                               finishing = false;
+    JobId                              next_id = 1;
+    std::map<JobId,Job>                jobs;
+    std::set<std::pair<TimePoint,JobId>> due;
+    std::mutex                         mtx;
+    std::condition_variable            cv;      // wakes workers
+    std::condition_variable            done_cv; // wakes cancel
+
+    // put threads last so all other variables are initialized first
+
+    std::vector<std::thread>           threads;
+
+  public:
+
+    TimerExecutor(size_t thread_count = 1);
+
+    TimerExecutor(const TimerExecutor& other) = delete;
+    TimerExecutor& operator=(const TimerExecutor& other) = delete;
+
+    // jobs not yet cancelled are dropped without running
+    ~TimerExecutor();
+
+
+    // adds a job that runs body every period, the first time one
+    // period from now
+    template<typename D>
+    JobId add_periodic(D period, std::function<void()> body) {
+      auto p = std::chrono::duration_cast<std::chrono::milliseconds>(period);
+      Guard g(mtx);
+      JobId id = next_id++;
+      jobs.emplace(id, Job(body, p));
+      do_schedule_at(id, Clock::now() + p);
+      return id;
+    }
+
+
+    // adds a job that runs only when scheduled with schedule_at
+    JobId add_job(std::function<void()> body);
+
+
+    // schedules the job to run at when, unless it is already due to
+    // run no later than that
+    void schedule_at(JobId id, TimePoint when);
+
+
+    // removes the job; once this returns its body is not running and
+    // will not run again, except that a job cancelling itself from
+    // its own body finishes that run
+    void cancel(JobId id);
+
+
+    size_t job_count();
+
+  protected:
+
+    // mtx must be held by caller
+    void do_schedule_at(JobId id, TimePoint when);
+
+    void run();
+  }; // class TimerExecutor
+
+} // namespace crimson
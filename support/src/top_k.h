@@ -0,0 +1,158 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#pragma once
+
+/* SpaceSaving estimates the items with the largest total weight in a
+ * stream using a fixed number of counters (Metwally et al., "Efficient
+ * Computation of Frequent and Top-k Elements in Data Streams"). An
+ * item not being counted takes over the counter with the smallest
+ * count, inheriting that count as its possible overestimate. Every
+ * item whose true weight exceeds total() / capacity is counted, and
+ * each count exceeds the true weight by at most its error.
+ *
+ * Items only need to be ordered, not hashable. The counters form a
+ * min-heap and are found through an ordered map, so each add is
+ * O(log capacity).
+ */
+
+#include <assert.h>
+
+#include <map>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+
+
+namespace crimson {
+
+  template<typename T, typename Compare = std::less<T>>
+  class SpaceSaving {
+
+    using Index = std::map<T,size_t,Compare>;
+
+    struct Counter {
+      typename Index::iterator it;
+      double count;
+      double error;
+    };
+
+    size_t               capacity;
+    double               total_weight = 0.0;
+    Index                index;
+    std::vector<Counter> counters; // min-heap on count
+
+  public:
+
+    struct Entry {
+      T      item;
+      double count; // estimated weight, never below the true weight
+      double error; // count minus error is never above it
+    };
+
+    explicit SpaceSaving(size_t _capacity) :
+      capacity(_capacity)
+    {
+      assert(capacity > 0);
+      counters.reserve(capacity);
+    }
+
+    // counters refer into index
+    SpaceSaving(const SpaceSaving&) = delete;
+    SpaceSaving& operator=(const SpaceSaving&) = delete;
+
+    void add(const T& item, double weight = 1.0) {
+      total_weight += weight;
+
+      auto found = index.find(item);
+      if (index.end() != found) {
+	counters[found->second].count += weight;
+	sift_down(found->second);
+      } else if (counters.size() < capacity) {
+	auto it = index.emplace(item, counters.size()).first;
+	counters.push_back(Counter{it, weight, 0.0});
+	sift_up(counters.size() - 1);
+      } else {
+	Counter& min = counters.front();
+	index.erase(min.it);
+	min.it = index.emplace(item, 0).first;
+	min.error = min.count;
+	min.count += weight;
+	sift_down(0);
+      }
+    }
+
+    // the k items with the largest counts, largest first
+    std::vector<Entry> top(size_t k) const {
+      std::vector<Entry> result;
+      result.reserve(counters.size());
+      for (const auto& c : counters) {
+	result.push_back(Entry{c.it->first, c.count, c.error});
+      }
+      auto larger = [] (const Entry& a, const Entry& b) -> bool {
+	return a.count > b.count;
+      };
+      k = std::min(k, result.size());
+      std::partial_sort(result.begin(), result.begin() + k, result.end(),
+			larger);
+      result.resize(k);
+      return result;
+    }
+
+    double total() const { return total_weight; }
+    size_t size() const { return counters.size(); }
+    size_t get_capacity() const { return capacity; }
+
+    void clear() {
+      counters.clear();
+      index.clear();
+      total_weight = 0.0;
+    }
+
+  protected:
+
+    void swap_counters(size_t i, size_t j) {
+      std::swap(counters[i], counters[j]);
+      counters[i].it->second = i;
+      counters[j].it->second = j;
+    }
+
+    void sift_up(size_t i) {
+      while (i > 0) {
+	const size_t parent = (i - 1) / 2;
+	if (counters[parent].count <= counters[i].count) {
+	  break;
+	}
+	swap_counters(i, parent);
+	i = parent;
+      }
+    }
+
+    void sift_down(size_t i) {
+      const size_t n = counters.size();
+      while (true) {
+	size_t least = i;
+	const size_t left = 2 * i + 1;
+	const size_t right = left + 1;
+	if (left < n && counters[left].count < counters[least].count) {
+	  least = left;
+	}
+	if (right < n && counters[right].count < counters[least].count) {
+	  least = right;
+	}
+	if (least == i) {
+	  break;
+	}
+	swap_counters(i, least);
+	i = least;
+      }
+    }
+  }; // class SpaceSaving
+
+} // namespace crimson
@@ -0,0 +1,113 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+#include <memory>
+#include <vector>
+
+#ifdef HAVE_NUMA
+#include <numaif.h>
+#endif
+
+#include "gtest/gtest.h"
+
+#include "numa_arena.h"
+#include "indirect_intrusive_heap.h"
+
+
+namespace {
+  struct Elem {
+    int data;
+
+    crimson::IndIntruHeapData heap_data;
+
+    Elem(int _data) : data(_data) { }
+  };
+
+
+  struct ElemCompare {
+    bool operator()(const Elem& d1, const Elem& d2) const {
+      return d1.data < d2.data;
+    }
+  };
+}
+
+
+TEST(numa_arena, unbound) {
+  crimson::NumaArena arena;
+  EXPECT_EQ(-1, arena.get_node());
+
+  std::vector<int,crimson::NumaAllocator<int>>
+    v{crimson::NumaAllocator<int>(&arena)};
+  for (int i = 0; i < 1000; ++i) {
+    v.push_back(i);
+  }
+  EXPECT_EQ(999, v.back());
+  EXPECT_EQ(0u, arena.get_node_bytes()) << "unbound arenas pass through";
+}
+
+
+TEST(numa_arena, bound) {
+  crimson::NumaArena arena;
+  if (!arena.bind(0)) {
+    GTEST_SKIP() << "NUMA unsupported in this build or system";
+  }
+  EXPECT_EQ(0, arena.get_node());
+
+  // small blocks are rounded to their size class and recycled
+  void* p1 = arena.allocate(24);
+  EXPECT_EQ(32u, arena.get_node_bytes());
+  arena.deallocate(p1, 24);
+  EXPECT_EQ(0u, arena.get_node_bytes());
+  void* p2 = arena.allocate(32);
+  EXPECT_EQ(p1, p2);
+
+  void* big = arena.allocate(100000);
+  EXPECT_EQ(100032u, arena.get_node_bytes());
+
+#ifdef HAVE_NUMA
+  *static_cast<char*>(p2) = 1;
+  *static_cast<char*>(big) = 1;
+  int node = -1;
+  ASSERT_EQ(0, get_mempolicy(&node, nullptr, 0, p2,
+			     MPOL_F_NODE | MPOL_F_ADDR));
+  EXPECT_EQ(0, node);
+  ASSERT_EQ(0, get_mempolicy(&node, nullptr, 0, big,
+			     MPOL_F_NODE | MPOL_F_ADDR));
+  EXPECT_EQ(0, node);
+#endif
+
+  arena.deallocate(big, 100000);
+  arena.deallocate(p2, 32);
+  EXPECT_EQ(0u, arena.get_node_bytes());
+}
+
+
+TEST(numa_arena, heap) {
+  crimson::NumaArena arena;
+  (void) arena.bind(0);
+
+  using Alloc = crimson::NumaAllocator<std::shared_ptr<Elem>>;
+  crimson::IndIntruHeap<std::shared_ptr<Elem>,
+			Elem,
+			&Elem::heap_data,
+			ElemCompare,
+			2,
+			Alloc> heap{Alloc(&arena)};
+
+  const std::vector<int> values{7, -3, 12, 0, 5, 99, -8, 3};
+  for (int v : values) {
+    heap.push(std::allocate_shared<Elem>(crimson::NumaAllocator<Elem>(&arena),
+					 v));
+  }
+
+  std::vector<int> popped;
+  while (!heap.empty()) {
+    popped.push_back(heap.top().data);
+    heap.pop();
+  }
+  EXPECT_EQ((std::vector<int>{-8, -3, 0, 3, 5, 7, 12, 99}), popped);
+}
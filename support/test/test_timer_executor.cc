@@ -0,0 +1,123 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "timer_executor.h"
+#include "run_every.h"
+
+
+using namespace std::chrono;
+
+
+TEST(timer_executor, periodic) {
+  crimson::TimerExecutor executor;
+  std::atomic_int a(0), b(0);
+
+  auto ja = executor.add_periodic(milliseconds(20), [&a] { ++a; });
+  auto jb = executor.add_periodic(milliseconds(50), [&b] { ++b; });
+  EXPECT_EQ(2u, executor.job_count());
+
+  std::this_thread::sleep_for(milliseconds(230));
+  executor.cancel(ja);
+  executor.cancel(jb);
+  EXPECT_EQ(0u, executor.job_count());
+
+  EXPECT_NEAR(10, a.load(), 4);
+  EXPECT_NEAR(4, b.load(), 2);
+
+  const int a_after = a;
+  std::this_thread::sleep_for(milliseconds(60));
+  EXPECT_EQ(a_after, a.load()) << "cancelled jobs do not run";
+}
+
+
+TEST(timer_executor, schedule_at) {
+  crimson::TimerExecutor executor;
+  std::atomic_int runs(0);
+
+  auto j = executor.add_job([&runs] { ++runs; });
+  std::this_thread::sleep_for(milliseconds(30));
+  EXPECT_EQ(0, runs.load()) << "not run until scheduled";
+
+  const auto now = crimson::TimerExecutor::Clock::now();
+  executor.schedule_at(j, now + milliseconds(200));
+  // the earlier time wins
+  executor.schedule_at(j, now + milliseconds(20));
+  std::this_thread::sleep_for(milliseconds(80));
+  EXPECT_EQ(1, runs.load());
+
+  std::this_thread::sleep_for(milliseconds(200));
+  EXPECT_EQ(1, runs.load()) << "each schedule_at runs it once";
+
+  executor.schedule_at(j, crimson::TimerExecutor::Clock::now());
+  std::this_thread::sleep_for(milliseconds(30));
+  EXPECT_EQ(2, runs.load());
+  executor.cancel(j);
+}
+
+
+TEST(timer_executor, cancel_waits) {
+  crimson::TimerExecutor executor(2);
+  std::atomic_bool in_body(false);
+  std::atomic_bool finished(false);
+
+  auto j = executor.add_job([&] {
+      in_body = true;
+      std::this_thread::sleep_for(milliseconds(100));
+      finished = true;
+    });
+  executor.schedule_at(j, crimson::TimerExecutor::Clock::now());
+  while (!in_body) {
+    std::this_thread::sleep_for(milliseconds(1));
+  }
+  executor.cancel(j);
+  EXPECT_TRUE(finished.load()) << "cancel waits for a running body";
+  EXPECT_EQ(0u, executor.job_count());
+}
+
+
+TEST(timer_executor, cancel_self) {
+  crimson::TimerExecutor executor;
+  std::atomic_int runs(0);
+  crimson::TimerExecutor::JobId j = 0;
+  std::mutex mtx;
+
+  {
+    std::lock_guard<std::mutex> g(mtx);
+    j = executor.add_periodic(milliseconds(10), [&] {
+	std::lock_guard<std::mutex> g(mtx);
+	if (++runs == 3) {
+	  executor.cancel(j);
+	}
+      });
+  }
+
+  std::this_thread::sleep_for(milliseconds(100));
+  EXPECT_EQ(3, runs.load());
+  EXPECT_EQ(0u, executor.job_count());
+}
+
+
+TEST(timer_executor, run_every) {
+  crimson::TimerExecutor executor;
+  std::atomic_int runs(0);
+
+  {
+    crimson::RunEvery r1(executor, milliseconds(20), [&runs] { ++runs; });
+    crimson::RunEvery r2(executor, milliseconds(20), [&runs] { ++runs; });
+    EXPECT_EQ(2u, executor.job_count());
+    std::this_thread::sleep_for(milliseconds(110));
+  }
+
+  EXPECT_EQ(0u, executor.job_count()) << "RunEvery cancels on destruction";
+  EXPECT_NEAR(10, runs.load(), 4);
+}
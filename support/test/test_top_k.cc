@@ -0,0 +1,83 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+#include <map>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "top_k.h"
+
+
+TEST(top_k, exact_under_capacity) {
+  crimson::SpaceSaving<int> ss(4);
+  ss.add(1, 5.0);
+  ss.add(2);
+  ss.add(3, 2.5);
+  ss.add(2);
+
+  auto top = ss.top(10);
+  ASSERT_EQ(3u, top.size());
+  EXPECT_EQ(1, top[0].item);
+  EXPECT_EQ(5.0, top[0].count);
+  EXPECT_EQ(3, top[1].item);
+  EXPECT_EQ(2, top[2].item);
+  EXPECT_EQ(2.0, top[2].count);
+  for (const auto& e : top) {
+    EXPECT_EQ(0.0, e.error) << "nothing was evicted";
+  }
+  EXPECT_EQ(9.5, ss.total());
+  EXPECT_EQ(1u, ss.top(1).size());
+}
+
+
+TEST(top_k, eviction_inherits_count) {
+  crimson::SpaceSaving<int> ss(2);
+  ss.add(1, 3.0);
+  ss.add(2, 1.0);
+  ss.add(3, 1.0); // takes over 2's counter
+
+  auto top = ss.top(2);
+  ASSERT_EQ(2u, ss.size());
+  EXPECT_EQ(1, top[0].item);
+  EXPECT_EQ(3, top[1].item);
+  EXPECT_EQ(2.0, top[1].count);
+  EXPECT_EQ(1.0, top[1].error);
+
+  ss.clear();
+  EXPECT_EQ(0u, ss.size());
+  EXPECT_EQ(0.0, ss.total());
+}
+
+
+// a few heavy items among many light ones are all found, and every
+// count brackets the item's true weight
+TEST(top_k, skewed_stream) {
+  crimson::SpaceSaving<int> ss(20);
+  std::map<int,double> truth;
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> light(100, 10099);
+
+  for (int i = 0; i < 100000; ++i) {
+    const int item = 0 == i % 2 ? i % 10 / 2 : light(gen);
+    ss.add(item);
+    truth[item] += 1.0;
+  }
+
+  auto top = ss.top(5);
+  ASSERT_EQ(5u, top.size());
+  std::vector<int> items;
+  for (const auto& e : top) {
+    items.push_back(e.item);
+    EXPECT_GE(e.count, truth[e.item]);
+    EXPECT_LE(e.count - e.error, truth[e.item]);
+  }
+  std::sort(items.begin(), items.end());
+  EXPECT_EQ((std::vector<int>{0, 1, 2, 3, 4}), items);
+}
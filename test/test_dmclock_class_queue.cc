@@ -0,0 +1,189 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#include <memory>
+#include <iostream>
+#include <map>
+
+#include "dmclock_class_queue.h"
+#include "dmclock_util.h"
+#include "gtest/gtest.h"
+
+
+namespace dmc = crimson::dmclock;
+
+
+namespace {
+  // requests carry a sequence number so tests can check order
+  struct SeqRequest {
+    int seq;
+  };
+
+  enum class OpClass { client, recovery, heartbeat };
+}
+
+
+namespace crimson {
+  namespace dmclock {
+
+    TEST(dmclock_class_queue, strict_lane_first) {
+      using ClientId = int;
+      using Queue = dmc::PullClassQueue<OpClass,ClientId,SeqRequest>;
+
+      auto class_info_f = [] (OpClass k) -> dmc::ClassInfo {
+	if (OpClass::heartbeat == k) return dmc::ClassInfo::strict_lane();
+	return dmc::ClassInfo(0.0, 1.0, 0.0);
+      };
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+
+      Queue pq(class_info_f, client_info_f);
+      ReqParams req_params(1,1);
+      Time t = get_time();
+
+      pq.add_request_time(SeqRequest{0}, OpClass::client, 1, req_params, t);
+      pq.add_request_time(SeqRequest{1}, OpClass::client, 2, req_params, t);
+      pq.add_request_time(SeqRequest{2}, OpClass::heartbeat, 3, req_params, t);
+      pq.add_request_time(SeqRequest{3}, OpClass::heartbeat, 4, req_params, t);
+
+      EXPECT_EQ(4u, pq.request_count());
+      EXPECT_EQ(2u, pq.class_count());
+
+      Queue::PullReq pr = pq.pull_request(t);
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_EQ(OpClass::heartbeat, pr.get_retn().op_class);
+      EXPECT_EQ(2, pr.get_retn().request->seq);
+      EXPECT_EQ(3, pr.get_retn().client);
+
+      pr = pq.pull_request(t);
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_EQ(OpClass::heartbeat, pr.get_retn().op_class);
+      EXPECT_EQ(3, pr.get_retn().request->seq);
+
+      for (int i = 0; i < 2; ++i) {
+	pr = pq.pull_request(t);
+	ASSERT_TRUE(pr.is_retn());
+	EXPECT_EQ(OpClass::client, pr.get_retn().op_class);
+      }
+
+      EXPECT_TRUE(pq.empty());
+      EXPECT_TRUE(pq.pull_request(t).is_none());
+    } // TEST
+
+
+    TEST(dmclock_class_queue, class_weight) {
+      using ClientId = int;
+      using Queue = dmc::PullClassQueue<OpClass,ClientId,SeqRequest>;
+
+      auto class_info_f = [] (OpClass k) -> dmc::ClassInfo {
+	if (OpClass::client == k) return dmc::ClassInfo(0.0, 3.0, 0.0);
+	return dmc::ClassInfo(0.0, 1.0, 0.0);
+      };
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+
+      Queue pq(class_info_f, client_info_f);
+      ReqParams req_params(1,1);
+      Time t = get_time();
+
+      // the recovery class has many more clients, which must not
+      // earn it a larger share
+      for (int i = 0; i < 40; ++i) {
+	pq.add_request_time(SeqRequest{i}, OpClass::client, 1, req_params, t);
+	pq.add_request_time(SeqRequest{i}, OpClass::recovery,
+			    100 + i % 10, req_params, t);
+      }
+
+      std::map<OpClass,int> counts;
+      for (int i = 0; i < 40; ++i) {
+	Queue::PullReq pr = pq.pull_request(t);
+	ASSERT_TRUE(pr.is_retn());
+	EXPECT_EQ(PhaseType::priority, pr.get_retn().class_phase);
+	++counts[pr.get_retn().op_class];
+      }
+
+      EXPECT_NEAR(30, counts[OpClass::client], 1);
+      EXPECT_NEAR(10, counts[OpClass::recovery], 1);
+    } // TEST
+
+
+    TEST(dmclock_class_queue, class_reservation) {
+      using ClientId = int;
+      using Queue = dmc::PullClassQueue<OpClass,ClientId,SeqRequest>;
+
+      auto class_info_f = [] (OpClass k) -> dmc::ClassInfo {
+	if (OpClass::client == k) return dmc::ClassInfo(0.0, 100.0, 0.0);
+	return dmc::ClassInfo(10.0, 1.0, 0.0);
+      };
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+
+      Queue pq(class_info_f, client_info_f);
+      ReqParams req_params(1,1);
+      Time t = get_time();
+
+      for (int i = 0; i < 100; ++i) {
+	pq.add_request_time(SeqRequest{i}, OpClass::client, 1, req_params, t);
+	pq.add_request_time(SeqRequest{i}, OpClass::recovery, 2, req_params, t);
+      }
+
+      // one second's worth of reservations, at t through t + 1.0
+      for (int i = 0; i < 11; ++i) {
+	Queue::PullReq pr = pq.pull_request(t + 1.0);
+	ASSERT_TRUE(pr.is_retn());
+	EXPECT_EQ(OpClass::recovery, pr.get_retn().op_class);
+	EXPECT_EQ(PhaseType::reservation, pr.get_retn().class_phase);
+      }
+
+      int client_count = 0;
+      for (int i = 0; i < 20; ++i) {
+	Queue::PullReq pr = pq.pull_request(t + 1.0);
+	ASSERT_TRUE(pr.is_retn());
+	EXPECT_EQ(PhaseType::priority, pr.get_retn().class_phase);
+	if (OpClass::client == pr.get_retn().op_class) ++client_count;
+      }
+      EXPECT_LE(19, client_count);
+    } // TEST
+
+
+    TEST(dmclock_class_queue, class_limit) {
+      using ClientId = int;
+      using Queue = dmc::PullClassQueue<OpClass,ClientId,SeqRequest>;
+
+      auto class_info_f = [] (OpClass k) -> dmc::ClassInfo {
+	return dmc::ClassInfo(0.0, 1.0, 2.0);
+      };
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+
+      Queue pq(class_info_f, client_info_f);
+      ReqParams req_params(1,1);
+      Time t = get_time();
+
+      for (int i = 0; i < 5; ++i) {
+	pq.add_request_time(SeqRequest{i}, OpClass::recovery,
+			    1 + i, req_params, t);
+      }
+
+      Queue::PullReq pr = pq.pull_request(t);
+      ASSERT_TRUE(pr.is_retn());
+
+      pr = pq.pull_request(t);
+      ASSERT_TRUE(pr.is_future());
+      EXPECT_DOUBLE_EQ(t + 0.5, pr.getTime());
+
+      pr = pq.pull_request(t + 0.5);
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_EQ(3u, pq.request_count());
+    } // TEST
+
+  } // namespace dmclock
+} // namespace crimson
@@ -97,6 +97,30 @@ namespace crimson {
     } // TEST
 
 
+    // as above, with cleaning on a shared executor
+    TEST(dmclock_client, server_erase_executor) {
+      using ServerId = int;
+
+      crimson::TimerExecutor executor;
+      dmc::ServiceTracker<ServerId> st(executor,
+				       std::chrono::milliseconds(500),
+				       std::chrono::milliseconds(1000));
+      EXPECT_EQ(1u, executor.job_count());
+
+      (void) st.get_req_params(101);
+      {
+	std::lock_guard<std::mutex> g(st.data_mtx);
+	EXPECT_EQ(1u, st.server_map.size());
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+      {
+	std::lock_guard<std::mutex> g(st.data_mtx);
+	EXPECT_EQ(0u, st.server_map.size()) << "erased by the executor";
+      }
+    } // TEST
+
+
     TEST(dmclock_client, delta_rho_values) {
       using ServerId = int;
       // using ClientId = int;
@@ -215,5 +239,66 @@ namespace crimson {
 	"rho should be 1 with no intervening reservation responses by " <<
 	"another server";
     } // TEST
+
+
+    TEST(dmclock_client, load_pacing) {
+      using ServerId = int;
+
+      dmc::ServiceTracker<ServerId> st(std::chrono::seconds(2),
+				       std::chrono::seconds(3));
+      for (int i = 0; i < 3; ++i) {
+	(void) st.get_req_params(101);
+      }
+
+      st.track_resp(101, dmc::PhaseType::priority, dmc::LoadHint(3, 0.05));
+      EXPECT_EQ(dmc::TimeZero, st.get_send_after(101)) <<
+	"no pacing unless a depth is set";
+
+      st.set_pacing_depth(2);
+      const dmc::Time when = st.get_send_after(101);
+      EXPECT_NEAR(dmc::get_time() + 0.05, when, 0.01) <<
+	"wait for the head request to be eligible";
+      EXPECT_EQ(dmc::TimeZero, st.get_send_after(7)) << "unknown server";
+      EXPECT_EQ(when, st.get_send_after(101, when - 0.01)) <<
+	"asking again changes nothing";
+      EXPECT_EQ(dmc::TimeMax, st.get_send_after(101, when)) <<
+	"one of three dispatched leaves two; wait for a response";
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(60));
+      EXPECT_EQ(dmc::TimeMax, st.get_send_after(101));
+      EXPECT_EQ(dmc::TimeMax, st.get_send_after(101));
+
+      st.track_resp(101, dmc::PhaseType::priority, dmc::LoadHint(1, 0.0));
+      EXPECT_EQ(dmc::TimeZero, st.get_send_after(101));
+      (void) st.get_req_params(101);
+      EXPECT_EQ(dmc::TimeMax, st.get_send_after(101)) <<
+	"requests sent since the hint count toward the depth";
+    } // TEST
+
+
+    TEST(dmclock_client, limit_pacing) {
+      using ServerId = int;
+
+      dmc::ServiceTracker<ServerId> st(std::chrono::seconds(2),
+				       std::chrono::seconds(3));
+      st.set_limit_pacing(10.0, 0.15);
+
+      const dmc::Time start = dmc::get_time();
+      (void) st.get_req_params(1);
+      EXPECT_EQ(dmc::TimeZero, st.get_send_after(1)) <<
+	"second request is within the lookahead";
+
+      (void) st.get_req_params(1);
+      EXPECT_NEAR(start + 0.05, st.get_send_after(1), 0.01) <<
+	"third request's limit tag is 0.2 sec out";
+
+      st.track_resp(2, dmc::PhaseType::priority);
+      st.track_resp(2, dmc::PhaseType::priority);
+      EXPECT_NEAR(start + 0.25, st.get_send_after(1), 0.01) <<
+	"two completions at another server raise the delta to 3";
+
+      st.set_limit_pacing(0.0, 0.0);
+      EXPECT_EQ(dmc::TimeZero, st.get_send_after(1));
+    } // TEST
   } // namespace dmclock
 } // namespace crimson
@@ -0,0 +1,192 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#include <coroutine>
+#include <exception>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+#include "dmclock_coroutine.h"
+#include "dmclock_util.h"
+#include "gtest/gtest.h"
+
+
+namespace dmc = crimson::dmclock;
+
+
+namespace {
+  struct SeqRequest {
+    int seq;
+  };
+
+  // a coroutine that starts at once and is never awaited itself
+  struct Detached {
+    struct promise_type {
+      Detached get_return_object() { return {}; }
+      std::suspend_never initial_suspend() noexcept { return {}; }
+      std::suspend_never final_suspend() noexcept { return {}; }
+      void return_void() {}
+      void unhandled_exception() { std::terminate(); }
+    };
+  };
+
+  using ClientId = int;
+  using Queue = dmc::CoroutinePullQueue<ClientId,SeqRequest>;
+
+  Detached consume(Queue& pq, std::vector<int>& seqs, int count) {
+    for (int i = 0; i < count; ++i) {
+      Queue::Retn retn = co_await pq.next();
+      seqs.push_back(retn.request->seq);
+    }
+  }
+
+  // what consume_signalled saw, for a coroutine resumed elsewhere
+  struct Consumed {
+    std::mutex              mtx;
+    std::condition_variable cv;
+    std::vector<int>        seqs;
+    std::thread::id         resumed_on;
+  };
+
+  Detached consume_signalled(Queue& pq, Consumed& consumed, int count) {
+    for (int i = 0; i < count; ++i) {
+      Queue::Retn retn = co_await pq.next();
+      std::lock_guard<std::mutex> g(consumed.mtx);
+      consumed.seqs.push_back(retn.request->seq);
+      consumed.resumed_on = std::this_thread::get_id();
+      consumed.cv.notify_all();
+    }
+  }
+}
+
+
+namespace crimson {
+  namespace dmclock {
+
+    TEST(dmclock_coroutine, resume_on_add) {
+      dmc::ClientInfo info(0.0, 1.0, 0.0);
+      Queue pq([&] (ClientId c) -> dmc::ClientInfo { return info; });
+      ReqParams req_params(1,1);
+
+      pq.add_request(SeqRequest{0}, 1, req_params);
+
+      std::vector<int> seqs;
+      consume(pq, seqs, 3);
+
+      // the first was queued already, so it didn't suspend for it
+      ASSERT_EQ(1u, seqs.size());
+      EXPECT_EQ(0, seqs[0]);
+      EXPECT_EQ(1u, pq.waiter_count());
+
+      // each add resumes the waiter directly on this thread
+      pq.add_request(SeqRequest{1}, 1, req_params);
+      ASSERT_EQ(2u, seqs.size());
+      EXPECT_EQ(1, seqs[1]);
+
+      pq.add_request(SeqRequest{2}, 1, req_params);
+      ASSERT_EQ(3u, seqs.size());
+      EXPECT_EQ(2, seqs[2]);
+
+      EXPECT_EQ(0u, pq.waiter_count());
+    } // TEST
+
+
+    TEST(dmclock_coroutine, resume_on_add_deadline) {
+      dmc::ClientInfo info(0.0, 1.0, 0.0);
+      Queue pq([&] (ClientId c) -> dmc::ClientInfo { return info; });
+      ReqParams req_params(1,1);
+
+      std::vector<int> seqs;
+      consume(pq, seqs, 2);
+      EXPECT_EQ(1u, pq.waiter_count());
+
+      pq.add_request_deadline(SeqRequest{3}, 1, req_params,
+			      dmc::get_time() + 60.0);
+      ASSERT_EQ(1u, seqs.size());
+      EXPECT_EQ(3, seqs[0]);
+
+      pq.add_request_time(SeqRequest{4}, 1, req_params, dmc::get_time());
+      ASSERT_EQ(2u, seqs.size());
+      EXPECT_EQ(4, seqs[1]);
+    } // TEST
+
+
+    TEST(dmclock_coroutine, resume_waiters_fifo) {
+      dmc::ClientInfo info(0.0, 1.0, 0.0);
+      Queue pq([&] (ClientId c) -> dmc::ClientInfo { return info; });
+      ReqParams req_params(1,1);
+
+      std::vector<int> seqs1;
+      std::vector<int> seqs2;
+      consume(pq, seqs1, 1);
+      consume(pq, seqs2, 1);
+      EXPECT_EQ(2u, pq.waiter_count());
+
+      pq.add_request(SeqRequest{7}, 1, req_params);
+      ASSERT_EQ(1u, seqs1.size()) << "the first to wait is resumed first";
+      EXPECT_EQ(7, seqs1[0]);
+      EXPECT_EQ(0u, seqs2.size());
+      EXPECT_EQ(1u, pq.waiter_count());
+
+      pq.add_request(SeqRequest{8}, 1, req_params);
+      ASSERT_EQ(1u, seqs2.size());
+      EXPECT_EQ(8, seqs2[0]);
+    } // TEST
+
+
+    TEST(dmclock_coroutine, resume_at_limit) {
+      // ten requests per second
+      dmc::ClientInfo info(0.0, 1.0, 10.0);
+      Queue pq([&] (ClientId c) -> dmc::ClientInfo { return info; });
+      ReqParams req_params(1,1);
+
+      pq.add_request(SeqRequest{0}, 1, req_params);
+      pq.add_request(SeqRequest{1}, 1, req_params);
+
+      std::vector<int> seqs;
+      consume(pq, seqs, 2);
+      ASSERT_EQ(1u, seqs.size());
+      EXPECT_EQ(1u, pq.waiter_count()) << "second request is limited";
+
+      // an event loop would call this when get_ready_fd is readable
+      std::this_thread::sleep_for(std::chrono::milliseconds(150));
+      pq.resume_waiters();
+      ASSERT_EQ(2u, seqs.size());
+      EXPECT_EQ(1, seqs[1]);
+    } // TEST
+
+
+    // with an executor, nothing need call resume_waiters; the waiter
+    // is resumed on the executor's thread once the limit allows
+    TEST(dmclock_coroutine, resume_at_limit_on_executor) {
+      dmc::ClientInfo info(0.0, 1.0, 10.0);
+      TimerExecutor executor;
+      Queue pq([&] (ClientId c) -> dmc::ClientInfo { return info; },
+	       executor);
+      ReqParams req_params(1,1);
+
+      pq.add_request(SeqRequest{0}, 1, req_params);
+      pq.add_request(SeqRequest{1}, 1, req_params);
+
+      Consumed consumed;
+      consume_signalled(pq, consumed, 2);
+
+      std::unique_lock<std::mutex> l(consumed.mtx);
+      ASSERT_TRUE(consumed.cv.wait_for(l, std::chrono::seconds(5), [&] {
+	    return 2u == consumed.seqs.size();
+	  }));
+      EXPECT_EQ(1, consumed.seqs[1]);
+      EXPECT_NE(std::this_thread::get_id(), consumed.resumed_on);
+      l.unlock();
+      EXPECT_EQ(0u, pq.waiter_count());
+    } // TEST
+
+  } // namespace dmclock
+} // namespace crimson
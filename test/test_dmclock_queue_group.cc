@@ -0,0 +1,142 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#include <memory>
+#include <iostream>
+
+#include "dmclock_queue_group.h"
+#include "dmclock_util.h"
+#include "gtest/gtest.h"
+
+
+namespace dmc = crimson::dmclock;
+
+
+namespace {
+  struct GroupRequest {
+    int seq;
+  };
+}
+
+
+namespace crimson {
+  namespace dmclock {
+
+    TEST(dmclock_queue_group, steal_from_backlogged_shard) {
+      using ClientId = int;
+      using Group = dmc::PullQueueGroup<ClientId,GroupRequest>;
+
+      dmc::ClientInfo info(0.0, 1.0, 0.0);
+      Group group(2, [&] (ClientId c) -> dmc::ClientInfo { return info; });
+      ReqParams req_params(1,1);
+      Time t = get_time();
+
+      // every client is placed on shard 0
+      for (int i = 0; i < 20; ++i) {
+	group.get_shard(0).add_request_time(GroupRequest{i},
+					    i % 4, req_params, t);
+      }
+
+      int served = 0;
+      for (int round = 0; round < 10; ++round) {
+	for (size_t worker = 0; worker < 2; ++worker) {
+	  if (group.pull_request(worker, t).is_retn()) {
+	    ++served;
+	  }
+	}
+      }
+
+      EXPECT_EQ(20, served) << "the idle worker should take half the work";
+      EXPECT_EQ(0u, group.get_steal_count(0));
+      EXPECT_EQ(10u, group.get_steal_count(1));
+      EXPECT_EQ(10u, group.get_stolen_count(0));
+      EXPECT_EQ(0u, group.get_stolen_count(1));
+      EXPECT_TRUE(group.pull_request(1, t).is_none());
+    } // TEST
+
+
+    TEST(dmclock_queue_group, own_shard_first) {
+      using ClientId = int;
+      using Group = dmc::PullQueueGroup<ClientId,GroupRequest>;
+
+      dmc::ClientInfo info(0.0, 1.0, 0.0);
+      Group group(2, [&] (ClientId c) -> dmc::ClientInfo { return info; });
+      ReqParams req_params(1,1);
+      Time t = get_time();
+
+      group.get_shard(0).add_request_time(GroupRequest{0}, 1, req_params, t);
+      group.get_shard(1).add_request_time(GroupRequest{1}, 2, req_params, t);
+
+      Group::PullReq pr = group.pull_request(1, t);
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_EQ(2, pr.get_retn().client);
+      EXPECT_EQ(0u, group.get_steal_count(1));
+    } // TEST
+
+
+    TEST(dmclock_queue_group, steal_in_dmclock_order) {
+      using ClientId = int;
+      using Group = dmc::PullQueueGroup<ClientId,GroupRequest>;
+
+      ClientId reserved = 1;
+      ClientId weighted = 2;
+
+      dmc::ClientInfo reserved_info(10.0, 1.0, 0.0);
+      dmc::ClientInfo weighted_info(0.0, 1.0, 0.0);
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return reserved == c ? reserved_info : weighted_info;
+      };
+
+      Group group(3, client_info_f);
+      ReqParams req_params(1,1);
+      Time t = get_time();
+
+      // the weight-phase request is probed first, but the reservation
+      // is due and takes precedence
+      for (int i = 0; i < 2; ++i) {
+	group.get_shard(1).add_request_time(GroupRequest{i},
+					    weighted, req_params, t);
+	group.get_shard(2).add_request_time(GroupRequest{i},
+					    reserved, req_params, t);
+      }
+
+      Group::PullReq pr = group.pull_request(0, t);
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_EQ(reserved, pr.get_retn().client);
+      EXPECT_EQ(PhaseType::reservation, pr.get_retn().phase);
+
+      // now both are in the weight phase, and the reserved client's
+      // proportion tag has advanced past the other's
+      pr = group.pull_request(0, t);
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_EQ(weighted, pr.get_retn().client);
+
+      EXPECT_EQ(2u, group.get_steal_count(0));
+      EXPECT_EQ(1u, group.get_stolen_count(1));
+      EXPECT_EQ(1u, group.get_stolen_count(2));
+    } // TEST
+
+
+    TEST(dmclock_queue_group, bounded_probe) {
+      using ClientId = int;
+      using Group = dmc::PullQueueGroup<ClientId,GroupRequest>;
+
+      dmc::ClientInfo info(0.0, 1.0, 0.0);
+      Group group(3, [&] (ClientId c) -> dmc::ClientInfo { return info; },
+		  false, 1);
+      ReqParams req_params(1,1);
+      Time t = get_time();
+
+      group.get_shard(2).add_request_time(GroupRequest{0}, 1, req_params, t);
+
+      EXPECT_TRUE(group.pull_request(0, t).is_none()) <<
+	"shard 2 is beyond worker 0's probe";
+      EXPECT_TRUE(group.pull_request(1, t).is_retn());
+    } // TEST
+
+  } // namespace dmclock
+} // namespace crimson
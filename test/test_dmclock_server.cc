@@ -10,6 +10,13 @@
 #include <iostream>
 #include <list>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#endif
 
 
 #include "dmclock_server.h"
@@ -90,7 +97,8 @@ namespace crimson {
       auto server_ready_f = [] () -> bool { return true; };
       auto submit_req_f = [] (const ClientId& c,
 			      std::unique_ptr<Request> req,
-			      dmc::PhaseType phase) {
+			      dmc::PhaseType phase,
+			      double cost) {
 	// empty; do nothing
       };
 
@@ -185,7 +193,8 @@ namespace crimson {
       auto server_ready_f = [] () -> bool { return true; };
       auto submit_req_f = [&] (const ClientId& c,
 			       std::unique_ptr<Request> req,
-			       dmc::PhaseType phase) {
+			       dmc::PhaseType phase,
+			       double cost) {
 	{
 	  Guard g(times_mtx);
 	  times.emplace_back(dmc::get_time());
@@ -524,6 +533,116 @@ namespace crimson {
     } // TEST
 
 
+    TEST(dmclock_server_pull, pull_deadline_expired) {
+      struct MyReq {
+	int id;
+
+	MyReq(int _id) :
+	  id(_id)
+	{
+	  // empty
+	}
+      }; // MyReq
+
+      using ClientId = int;
+      using Queue = dmc::PullPriorityQueue<ClientId,MyReq>;
+
+      ClientId client1 = 17;
+      ClientId client2 = 98;
+
+      dmc::ClientInfo info(0.0, 1.0, 0.0);
+
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return info;
+      };
+
+      Queue pq(client_info_f, false);
+
+      // the function runs outside the queue's lock, so it may call
+      // back into the queue
+      std::vector<int> expired;
+      std::vector<size_t> depths;
+      pq.set_request_expired_func(
+	[&expired, &depths, &pq] (const ClientId& c,
+				  std::unique_ptr<MyReq> r) {
+	  expired.push_back(r->id);
+	  depths.push_back(pq.request_count());
+	});
+
+      ReqParams req_params(1,1);
+      auto now = dmc::get_time();
+
+      // client1's head and a request deep in its queue expire; client2
+      // has a deadline that is never reached
+      pq.add_request_deadline(MyReq(1), client1, req_params, now + 1.0);
+      pq.add_request(MyReq(2), client1, req_params);
+      pq.add_request_deadline(MyReq(3), client1, req_params, now + 2.0);
+      pq.add_request(MyReq(4), client1, req_params);
+      pq.add_request_deadline(MyReq(5), client2, req_params, now + 100.0);
+
+      EXPECT_EQ(5u, pq.request_count());
+
+      Queue::PullReq pr = pq.pull_request(now + 10.0);
+      EXPECT_TRUE(pr.is_retn());
+
+      EXPECT_EQ(2u, pq.request_count()) <<
+	"one request dispatched and two shed";
+      EXPECT_EQ(2u, pq.get_expired_count());
+      ASSERT_EQ(2u, expired.size());
+      EXPECT_EQ(1, expired[0]);
+      EXPECT_EQ(3, expired[1]);
+      EXPECT_EQ((std::vector<size_t>{2, 2}), depths);
+
+      std::vector<int> pulled;
+      pulled.push_back(pr.get_retn().request->id);
+      for (int i = 0; i < 2; ++i) {
+	pr = pq.pull_request(now + 10.0);
+	ASSERT_TRUE(pr.is_retn());
+	pulled.push_back(pr.get_retn().request->id);
+      }
+      pr = pq.pull_request(now + 10.0);
+      EXPECT_TRUE(pr.is_none());
+
+      std::sort(pulled.begin(), pulled.end());
+      EXPECT_EQ((std::vector<int>{2, 4, 5}), pulled) <<
+	"only unexpired requests are dispatched";
+    } // dmclock_server_pull.pull_deadline_expired
+
+
+    // requests served before their deadlines leave entries behind
+    // that neither sweep a queue nor accumulate
+    TEST(dmclock_server_pull, pull_deadline_served) {
+      using ClientId = int;
+      using Queue = dmc::PullPriorityQueue<ClientId,Request>;
+
+      dmc::ClientInfo info(0.0, 1.0, 0.0);
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return info;
+      };
+
+      Queue pq(client_info_f, false);
+      size_t expired = 0;
+      pq.set_request_expired_func(
+	[&expired] (const ClientId& c, std::unique_ptr<Request> r) {
+	  ++expired;
+	});
+
+      ReqParams req_params(1,1);
+      const Time now = dmc::get_time();
+
+      for (int i = 0; i < 5000; ++i) {
+	pq.add_request_deadline(Request{}, 1, req_params, now + 1.0);
+	ASSERT_TRUE(pq.pull_request(now).is_retn());
+      }
+      EXPECT_GT(1024u, pq.deadline_heap.size());
+
+      pq.add_request_deadline(Request{}, 1, req_params, now + 3.0);
+      EXPECT_TRUE(pq.pull_request(now + 2.0).is_retn());
+      EXPECT_EQ(0u, expired);
+      EXPECT_EQ(0u, pq.get_expired_count());
+    } // dmclock_server_pull.pull_deadline_served
+
+
     TEST(dmclock_server_pull, pull_weight) {
       using ClientId = int;
       using Queue = dmc::PullPriorityQueue<ClientId,Request>;
@@ -580,6 +699,686 @@ namespace crimson {
     }
 
 
+    TEST(dmclock_server, aimd_concurrency) {
+      dmc::AimdConcurrency aimd(2, 8);
+
+      auto fill = [&aimd] () {
+	while (aimd.can_dispatch()) aimd.dispatched();
+      };
+
+      // completions at the unloaded latency while the limit is the
+      // bottleneck grow the limit
+      fill();
+      EXPECT_EQ(2u, aimd.get_in_flight());
+      for (int i = 0; i < 100; ++i) {
+	aimd.completed(0.010);
+	fill();
+      }
+      EXPECT_EQ(8u, aimd.get_limit()) << "should grow to the maximum";
+
+      // latencies well beyond the unloaded latency shrink it
+      for (int i = 0; i < 200; ++i) {
+	aimd.completed(0.050);
+	fill();
+      }
+      EXPECT_EQ(2u, aimd.get_limit()) << "should shrink to the minimum";
+    }
+
+
+    TEST(dmclock_server, push_concurrency_limit) {
+      using ClientId = int;
+      using Queue = dmc::PushPriorityQueue<ClientId,Request>;
+
+      dmc::ClientInfo info(0.0, 1.0, 0.0);
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return info;
+      };
+
+      std::atomic_int handled(0);
+      Queue pq(client_info_f,
+	       [] () -> bool { return true; },
+	       [&handled] (const ClientId& c,
+			   std::unique_ptr<Request> req,
+			   dmc::PhaseType phase,
+			   double cost) { ++handled; });
+      pq.set_concurrency_limit(dmc::AimdConcurrency(3, 16));
+
+      ReqParams req_params(1,1);
+      for (int i = 0; i < 10; ++i) {
+	pq.add_request(Request{}, 1, req_params);
+      }
+      EXPECT_EQ(3, handled) << "only the initial limit should be outstanding";
+
+      pq.request_completed(0.010);
+      EXPECT_EQ(4, handled) << "each completion frees a slot";
+      EXPECT_EQ(3u, pq.get_concurrency_limit());
+
+      // so do completions without a latency, and one reporting both
+      // the actual cost and the latency
+      pq.request_completed();
+      EXPECT_EQ(5, handled);
+      pq.request_completed(1, dmc::PhaseType::priority, 1.0, 1.0, 0.010);
+      EXPECT_EQ(6, handled);
+    }
+
+
+    // queues sharing an executor start no threads of their own, yet
+    // still clean idle clients and dispatch limited requests later
+    TEST(dmclock_server, shared_executor) {
+      using ClientId = int;
+      using PullQueue = dmc::PullPriorityQueue<ClientId,Request>;
+      using PushQueue = dmc::PushPriorityQueue<ClientId,Request>;
+
+      crimson::TimerExecutor executor;
+
+      dmc::ClientInfo limited(0.0, 1.0, 10.0);
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return limited;
+      };
+
+      std::atomic_int handled(0);
+      PushQueue push(client_info_f,
+		     [] () -> bool { return true; },
+		     [&handled] (const ClientId& c,
+				 std::unique_ptr<Request> req,
+				 dmc::PhaseType phase,
+				 double cost) { ++handled; },
+		     executor);
+      PullQueue pull(client_info_f,
+		     executor,
+		     std::chrono::milliseconds(1000),
+		     std::chrono::milliseconds(2000),
+		     std::chrono::milliseconds(500));
+      EXPECT_EQ(3u, executor.job_count()) <<
+	"two cleaning jobs and the push queue's timer";
+
+      ReqParams req_params(1,1);
+      for (int i = 0; i < 5; ++i) {
+	push.add_request(Request{}, 1, req_params);
+      }
+      EXPECT_EQ(1, handled.load()) << "the rest are over the limit";
+      // complete each request at once; the next is over the limit
+      // until the executor's timer job dispatches it
+      int completed = 0;
+      const auto until =
+	std::chrono::steady_clock::now() + std::chrono::milliseconds(550);
+      while (std::chrono::steady_clock::now() < until) {
+	for (; completed < handled.load(); ++completed) {
+	  push.request_completed();
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      }
+      EXPECT_EQ(5, handled.load()) << "dispatched by the executor at 10/s";
+
+      pull.set_client_state_publishing(true);
+      pull.add_request(Request{}, 1, req_params);
+      EXPECT_TRUE(pull.pull_request().is_retn());
+      EXPECT_EQ(1u, pull.client_count());
+      PullQueue::ClientStateRef ref = pull.get_client_state_ref(1);
+      ASSERT_TRUE(bool(ref));
+      std::this_thread::sleep_for(std::chrono::milliseconds(3500));
+      EXPECT_EQ(0u, pull.client_count()) << "erased by the executor";
+
+      // the cached handle outlives the record and is used again
+      const dmc::ClientState last = ref->load();
+      EXPECT_EQ(1u, last.reservation_count + last.priority_count);
+      pull.add_request(Request{}, 1, req_params);
+      EXPECT_EQ(ref, pull.get_client_state_ref(1));
+      EXPECT_EQ(1u, ref->load().queue_depth);
+    }
+
+
+    // Requests queued behind a client's head request do not trigger
+    // heap adjustments; make sure deep per-client queues are still
+    // served in proportion to weight.
+    TEST(dmclock_server_pull, pull_deep_queues) {
+      using ClientId = int;
+      using Queue = dmc::PullPriorityQueue<ClientId,Request>;
+      using QueueRef = std::unique_ptr<Queue>;
+
+      ClientId client1 = 17;
+      ClientId client2 = 98;
+
+      dmc::ClientInfo info1(0.0, 1.0, 0.0);
+      dmc::ClientInfo info2(0.0, 3.0, 0.0);
+
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	if (client1 == c) return info1;
+	else if (client2 == c) return info2;
+	else {
+	  ADD_FAILURE() << "client info looked up for non-existant client";
+	  return info1;
+	}
+      };
+
+      QueueRef pq(new Queue(client_info_f, false));
+
+      Request req;
+      ReqParams req_params(1,1);
+
+      for (int i = 0; i < 100; ++i) {
+	pq->add_request(req, client1, req_params);
+      }
+      for (int i = 0; i < 100; ++i) {
+	pq->add_request(req, client2, req_params);
+      }
+
+      EXPECT_EQ(200u, pq->request_count());
+
+      int c1_count = 0;
+      int c2_count = 0;
+      for (int i = 0; i < 80; ++i) {
+	Queue::PullReq pr = pq->pull_request();
+	EXPECT_EQ(Queue::NextReqType::returning, pr.type);
+	auto& retn = boost::get<Queue::PullReq::Retn>(pr.data);
+
+	if (client1 == retn.client) ++c1_count;
+	else if (client2 == retn.client) ++c2_count;
+	else ADD_FAILURE() << "got request from neither of two clients";
+      }
+
+      EXPECT_EQ(20, c1_count) <<
+	"one-quarter of requests should have come from first client";
+      EXPECT_EQ(60, c2_count) <<
+	"three-quarters of requests should have come from second client";
+    } // dmclock_server_pull.pull_deep_queues
+
+
+    TEST(dmclock_server_pull, pull_weight_cost) {
+      struct MyReq {
+	uint64_t size;
+
+	MyReq(uint64_t _size) :
+	  size(_size)
+	{
+	  // empty
+	}
+      }; // MyReq
+
+      using ClientId = int;
+      using Queue = dmc::PullPriorityQueue<ClientId,MyReq>;
+
+      ClientId client1 = 17;
+      ClientId client2 = 98;
+
+      dmc::ClientInfo info(0.0, 1.0, 0.0);
+
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return info;
+      };
+
+      // 1ms per op at 1MiB/s; a 4KiB request is the unit request
+      dmc::SizeCost size_cost(0.001, 1024.0 * 1024.0, 4096);
+      EXPECT_DOUBLE_EQ(1.0, size_cost(4096));
+      EXPECT_DOUBLE_EQ((0.001 + 0.015625) / (0.001 + 0.00390625),
+		       size_cost(16384));
+
+      Queue pq(client_info_f, false);
+      pq.set_request_cost_func([&size_cost] (const MyReq& r) -> double {
+	  return size_cost(r.size);
+	});
+
+      ReqParams req_params(1,1);
+
+      for (int i = 0; i < 50; ++i) {
+	pq.add_request(MyReq(4096), client1, req_params);
+	pq.add_request(MyReq(65536 - 4096), client2, req_params);
+      }
+
+      int c1_count = 0;
+      int c2_count = 0;
+      for (int i = 0; i < 40; ++i) {
+	Queue::PullReq pr = pq.pull_request();
+	EXPECT_EQ(Queue::NextReqType::returning, pr.type);
+	auto& retn = pr.get_retn();
+	EXPECT_DOUBLE_EQ(size_cost(retn.request->size), retn.cost) <<
+	  "the cost charged is handed back for request_completed";
+
+	if (client1 == retn.client) ++c1_count;
+	else if (client2 == retn.client) ++c2_count;
+	else ADD_FAILURE() << "got request from neither of two clients";
+      }
+
+      // the large requests cost about 12 times as much, so the client
+      // issuing them should get about one-twelfth as many dispatches
+      EXPECT_LE(36, c1_count) <<
+	"small requests should be dispatched far more often";
+      EXPECT_GE(4, c2_count) <<
+	"large requests should be dispatched far less often";
+      EXPECT_LE(1, c2_count) <<
+	"large requests should not be starved";
+    } // dmclock_server_pull.pull_weight_cost
+
+
+    TEST(dmclock_server_pull, pull_cost_correction) {
+      using ClientId = int;
+      using Queue = dmc::PullPriorityQueue<ClientId,Request>;
+
+      ClientId client1 = 17;
+      ClientId client2 = 98;
+
+      dmc::ClientInfo info(0.0, 1.0, 0.0);
+
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return info;
+      };
+
+      Queue pq(client_info_f, false);
+
+      Request req;
+      ReqParams req_params(1,1);
+
+      for (int i = 0; i < 50; ++i) {
+	pq.add_request(req, client1, req_params);
+	pq.add_request(req, client2, req_params);
+      }
+
+      // every request is charged 1.0 up front, but client1's requests
+      // turn out to cost 3.0 each
+      int c1_count = 0;
+      int c2_count = 0;
+      for (int i = 0; i < 40; ++i) {
+	Queue::PullReq pr = pq.pull_request();
+	ASSERT_TRUE(pr.is_retn());
+	auto& retn = pr.get_retn();
+	EXPECT_EQ(1.0, retn.cost);
+
+	if (client1 == retn.client) {
+	  ++c1_count;
+	  pq.request_completed(retn.client, retn.phase, 3.0, retn.cost);
+	} else if (client2 == retn.client) {
+	  ++c2_count;
+	  pq.request_completed(retn.client, retn.phase, 1.0, retn.cost);
+	} else {
+	  ADD_FAILURE() << "got request from neither of two clients";
+	}
+      }
+
+      EXPECT_NEAR(10, c1_count, 1) <<
+	"about one-quarter of dispatches should go to the first client";
+      EXPECT_NEAR(30, c2_count, 1) <<
+	"about three-quarters of dispatches should go to the second client";
+    } // dmclock_server_pull.pull_cost_correction
+
+
+    TEST(dmclock_server_pull, pull_run) {
+      using ClientId = int;
+      using Queue = dmc::PullPriorityQueue<ClientId,Request>;
+
+      dmc::ClientInfo info(0.0, 1.0, 0.0);
+
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return info;
+      };
+
+      Queue pq(client_info_f, false);
+      pq.set_run_limit(4);
+
+      Request req;
+      ReqParams req_params(1,1);
+
+      for (int i = 0; i < 10; ++i) {
+	for (ClientId c = 1; c <= 3; ++c) {
+	  pq.add_request(req, c, req_params);
+	}
+      }
+
+      // each client that wins a slot keeps it for a run of four
+      for (int run = 0; run < 3; ++run) {
+	Queue::PullReq pr = pq.pull_request();
+	ASSERT_TRUE(pr.is_retn());
+	const ClientId first = pr.get_retn().client;
+	for (int i = 1; i < 4; ++i) {
+	  pr = pq.pull_request();
+	  ASSERT_TRUE(pr.is_retn());
+	  EXPECT_EQ(first, pr.get_retn().client) << "run was interrupted";
+	  EXPECT_EQ(PhaseType::priority, pr.get_retn().phase);
+	}
+      }
+
+      EXPECT_EQ(9u, pq.get_run_sched_count());
+      // a run of four leads by at most three requests' proportion tags
+      EXPECT_LT(0.0, pq.get_run_fairness_error());
+      EXPECT_GE(3.0 * info.weight_inv, pq.get_run_fairness_error());
+    } // dmclock_server_pull.pull_run
+
+
+    TEST(dmclock_server_pull, pull_run_cost_limit) {
+      using ClientId = int;
+      using Queue = dmc::PullPriorityQueue<ClientId,Request>;
+
+      dmc::ClientInfo info(0.0, 1.0, 0.0);
+
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return info;
+      };
+
+      Queue pq(client_info_f, false);
+      pq.set_run_limit(100, 2.0);
+
+      Request req;
+      ReqParams req_params(1,1);
+
+      for (int i = 0; i < 10; ++i) {
+	pq.add_request(req, 1, req_params);
+	pq.add_request(req, 2, req_params);
+      }
+
+      // the cost budget rather than the request count ends each run
+      ClientId prev = 0;
+      int same_in_a_row = 0;
+      for (int i = 0; i < 12; ++i) {
+	Queue::PullReq pr = pq.pull_request();
+	ASSERT_TRUE(pr.is_retn());
+	if (prev == pr.get_retn().client) {
+	  ++same_in_a_row;
+	} else {
+	  same_in_a_row = 1;
+	}
+	EXPECT_GE(2, same_in_a_row);
+	prev = pr.get_retn().client;
+      }
+
+      EXPECT_EQ(6u, pq.get_run_sched_count());
+    } // dmclock_server_pull.pull_run_cost_limit
+
+
+    TEST(dmclock_server_pull, pull_merge) {
+      using ClientId = int;
+      struct IoRequest {
+	uint64_t offset;
+	uint64_t length;
+      };
+      using Queue = dmc::PullPriorityQueue<ClientId,IoRequest>;
+
+      ClientId client1 = 17;
+      ClientId client2 = 98;
+
+      dmc::ClientInfo info(0.0, 1.0, 0.0);
+
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return info;
+      };
+
+      Queue pq(client_info_f, false);
+      pq.set_request_merge_func(
+	[] (const IoRequest& tail, const IoRequest& req) -> bool {
+	  return tail.offset + tail.length == req.offset;
+	},
+	[] (IoRequest& tail, IoRequest& req) {
+	  tail.length += req.length;
+	});
+
+      ReqParams req_params(1,1);
+
+      // client1 writes ten runs of three adjacent blocks; client2's
+      // blocks are never adjacent
+      for (uint64_t i = 0; i < 30; ++i) {
+	pq.add_request(IoRequest{4096 * (i + i / 3), 4096}, client1, req_params);
+	pq.add_request(IoRequest{8192 * i, 4096}, client2, req_params);
+      }
+
+      EXPECT_EQ(20u, pq.get_merged_count());
+      EXPECT_EQ(40u, pq.request_count());
+
+      // merged requests are charged for all three blocks, so client1
+      // gets a quarter of the dispatches for half of the blocks
+      int c1_count = 0;
+      int c2_count = 0;
+      for (int i = 0; i < 20; ++i) {
+	Queue::PullReq pr = pq.pull_request();
+	ASSERT_TRUE(pr.is_retn());
+	auto& retn = pr.get_retn();
+
+	if (client1 == retn.client) {
+	  ++c1_count;
+	  EXPECT_EQ(3u * 4096, retn.request->length);
+	  EXPECT_EQ(0u, retn.request->offset % (4 * 4096));
+	} else if (client2 == retn.client) {
+	  ++c2_count;
+	  EXPECT_EQ(4096u, retn.request->length);
+	} else {
+	  ADD_FAILURE() << "got request from neither of two clients";
+	}
+      }
+
+      EXPECT_NEAR(5, c1_count, 1);
+      EXPECT_NEAR(15, c2_count, 1);
+    } // dmclock_server_pull.pull_merge
+
+
+    TEST(dmclock_server_pull, pull_limit_break_idle) {
+      using ClientId = int;
+      using Queue = dmc::PullPriorityQueue<ClientId,Request>;
+
+      ClientId client1 = 17;
+      ClientId client2 = 98;
+
+      dmc::ClientInfo info1(0.0, 1.0, 1.0);
+      dmc::ClientInfo info2(0.0, 1.0, 0.0);
+
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return client1 == c ? info1 : info2;
+      };
+
+      Queue pq(client_info_f, false);
+      pq.set_limit_break_idle(0.5);
+
+      Request req;
+      ReqParams req_params(1,1);
+      Time t = dmc::get_time();
+
+      for (int i = 0; i < 5; ++i) {
+	pq.add_request_time(req, client1, req_params, t);
+      }
+
+      Queue::PullReq pr = pq.pull_request(t);
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_EQ(0u, pq.get_limit_break_sched_count()) << "within limit";
+
+      // peeking takes nothing, so it neither counts a break nor
+      // starts breaking
+      dmc::PhaseType phase;
+      double tag;
+      EXPECT_TRUE(pq.try_peek_request(t, phase, tag));
+      EXPECT_EQ(0u, pq.get_limit_break_sched_count());
+      EXPECT_FALSE(pq.try_peek_request(t + 0.6, phase, tag));
+
+      // the next request is a full second from its limit
+      pr = pq.pull_request(t);
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_EQ(1u, pq.get_limit_break_sched_count());
+
+      // once breaking, a shorter wait does not stop it
+      pr = pq.pull_request(t + 1.6);
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_EQ(client1, pr.get_retn().client);
+      EXPECT_EQ(2u, pq.get_limit_break_sched_count());
+
+      // but in-limit work does
+      pq.add_request_time(req, client2, req_params, t + 1.6);
+      pr = pq.pull_request(t + 1.6);
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_EQ(client2, pr.get_retn().client);
+
+      pr = pq.pull_request(t + 2.6);
+      ASSERT_TRUE(pr.is_future());
+      EXPECT_DOUBLE_EQ(t + 3.0, pr.getTime());
+
+      EXPECT_EQ(2u, pq.get_limit_break_sched_count());
+      EXPECT_DOUBLE_EQ(2.0, pq.get_limit_break_cost());
+    } // dmclock_server_pull.pull_limit_break_idle
+
+
+    TEST(dmclock_server_pull, pull_limit_burst) {
+      using ClientId = int;
+      using Queue = dmc::PullPriorityQueue<ClientId,Request>;
+
+      ClientId client1 = 17;
+
+      // 2 requests/sec with a burst of 4
+      dmc::ClientInfo info(0.0, 1.0, 2.0, 4.0);
+
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return info;
+      };
+
+      Queue pq(client_info_f, false);
+
+      Request req;
+      ReqParams req_params(1,1);
+      Time t = dmc::get_time();
+
+      for (int i = 0; i < 20; ++i) {
+	pq.add_request_time(req, client1, req_params, t);
+      }
+
+      // the burst plus the request due now go out at once
+      for (int i = 0; i < 5; ++i) {
+	Queue::PullReq pr = pq.pull_request(t);
+	ASSERT_TRUE(pr.is_retn()) << "request " << i << " should be in burst";
+      }
+
+      // after which the limit applies
+      Queue::PullReq pr = pq.pull_request(t);
+      ASSERT_TRUE(pr.is_future());
+      EXPECT_DOUBLE_EQ(t + 0.5, pr.getTime());
+
+      int count = 0;
+      for (Time now = t + 0.5; now < t + 5.0; now += 0.5) {
+	pr = pq.pull_request(now);
+	ASSERT_TRUE(pr.is_retn());
+	++count;
+	EXPECT_TRUE(pq.pull_request(now).is_future()) <<
+	  "a client kept busy gets no further burst";
+      }
+      EXPECT_EQ(9, count);
+    } // dmclock_server_pull.pull_limit_burst
+
+
+    TEST(dmclock_server_pull, wait_pull) {
+      using ClientId = int;
+      using Queue = dmc::PullPriorityQueue<ClientId,Request>;
+
+      ClientId client1 = 17;
+
+      dmc::ClientInfo info(0.0, 1.0, 10.0);
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return info;
+      };
+
+      Queue pq(client_info_f, false);
+      ReqParams req_params(1,1);
+
+      // nothing arrives
+      Time start = dmc::get_time();
+      Queue::PullReq pr = pq.wait_pull(std::chrono::milliseconds(50));
+      EXPECT_TRUE(pr.is_none());
+      EXPECT_LE(start + 0.05, dmc::get_time());
+
+      // a request added by another thread wakes the waiter
+      std::thread adder([&] () {
+	  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	  pq.add_request(Request{}, client1, req_params);
+	  pq.add_request(Request{}, client1, req_params);
+	});
+      start = dmc::get_time();
+      pr = pq.wait_pull(std::chrono::seconds(10));
+      adder.join();
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_GT(start + 5.0, dmc::get_time());
+
+      // the second request is limited to a tenth of a second later
+      pr = pq.wait_pull(std::chrono::seconds(10));
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_GT(start + 5.0, dmc::get_time());
+    } // dmclock_server_pull.wait_pull
+
+
+#ifdef __linux__
+    TEST(dmclock_server_pull, ready_fd) {
+      using ClientId = int;
+      using Queue = dmc::PullPriorityQueue<ClientId,Request>;
+
+      ClientId client1 = 17;
+
+      dmc::ClientInfo info(0.0, 1.0, 10.0);
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return info;
+      };
+
+      Queue pq(client_info_f, false);
+      ReqParams req_params(1,1);
+
+      int fd = pq.get_ready_fd();
+      ASSERT_LE(0, fd);
+
+      auto readable = [fd] (int timeout_ms) -> bool {
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	return 1 == poll(&pfd, 1, timeout_ms);
+      };
+
+      EXPECT_FALSE(readable(0)) << "nothing queued";
+
+      pq.add_request(Request{}, client1, req_params);
+      pq.add_request(Request{}, client1, req_params);
+      EXPECT_TRUE(readable(1000));
+
+      Queue::PullReq pr = pq.pull_request();
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_TRUE(readable(1000)) << "one more queued";
+
+      pr = pq.pull_request();
+      if (pr.is_future()) {
+	// limited for up to a tenth of a second
+	EXPECT_FALSE(readable(0));
+	EXPECT_TRUE(readable(1000)) << "should become readable when eligible";
+	pr = pq.pull_request();
+      }
+      ASSERT_TRUE(pr.is_retn());
+
+      EXPECT_TRUE(pq.pull_request().is_none());
+      EXPECT_FALSE(readable(0)) << "nothing queued";
+    } // dmclock_server_pull.ready_fd
+#endif
+
+
+    TEST(dmclock_server_pull, numa_node) {
+      using ClientId = int;
+      using Queue = dmc::PullPriorityQueue<ClientId,Request>;
+
+      dmc::ClientInfo info(0.0, 1.0, 0.0);
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return info;
+      };
+
+      Queue pq(client_info_f, false);
+      ReqParams req_params(1,1);
+
+      // only node 0 is certain to exist, and only if NUMA is supported
+      const bool placed = pq.set_numa_node(0);
+      EXPECT_EQ(placed ? 0 : -1, pq.get_numa_node());
+
+      Time t = dmc::get_time();
+      for (int i = 0; i < 200; ++i) {
+	pq.add_request_time(Request{}, i % 20, req_params, t);
+      }
+      EXPECT_FALSE(pq.set_numa_node(0)) << "requests were already added";
+      EXPECT_EQ(20u, pq.client_count());
+
+      std::map<ClientId,int> counts;
+      for (int i = 0; i < 200; ++i) {
+	Queue::PullReq pr = pq.pull_request(t);
+	ASSERT_TRUE(pr.is_retn());
+	++counts[pr.get_retn().client];
+      }
+      EXPECT_TRUE(pq.empty());
+      for (const auto& c : counts) {
+	EXPECT_EQ(10, c.second);
+      }
+    } // dmclock_server_pull.numa_node
+
+
     TEST(dmclock_server_pull, pull_reservation) {
       using ClientId = int;
       using Queue = dmc::PullPriorityQueue<ClientId,Request>;
@@ -636,6 +1435,262 @@ namespace crimson {
     } // dmclock_server_pull.pull_reservation
 
 
+    TEST(dmclock_server_pull, load_hint) {
+      using ClientId = int;
+      using Queue = dmc::PullPriorityQueue<ClientId,Request>;
+
+      dmc::ClientInfo limited(0.0, 1.0, 10.0);
+      dmc::ClientInfo unlimited(0.0, 1.0, 0.0);
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return 1 == c ? limited : unlimited;
+      };
+
+      Queue pq(client_info_f, false);
+      ReqParams req_params(1,1);
+      const Time t = dmc::get_time();
+
+      for (int i = 0; i < 5; ++i) {
+	pq.add_request_time(Request{}, 1, req_params, t);
+	pq.add_request_time(Request{}, 2, req_params, t);
+      }
+      for (int i = 0; i < 2; ++i) {
+	ASSERT_TRUE(pq.pull_request(t).is_retn());
+      }
+
+      LoadHint h1 = pq.get_load_hint(1, t);
+      EXPECT_EQ(4u, h1.queue_depth);
+      EXPECT_NEAR(0.1, h1.delay, 0.001) << "held back by its limit";
+
+      LoadHint h2 = pq.get_load_hint(2, t);
+      EXPECT_EQ(4u, h2.queue_depth);
+      EXPECT_EQ(0.0, h2.delay);
+
+      EXPECT_EQ(0u, pq.get_load_hint(3, t).queue_depth);
+    } // dmclock_server_pull.load_hint
+
+
+    TEST(dmclock_server_pull, client_state) {
+      using ClientId = int;
+      using Queue = dmc::PullPriorityQueue<ClientId,Request>;
+
+      dmc::ClientInfo reserved(2.0, 1.0, 0.0);
+      dmc::ClientInfo unreserved(0.0, 1.0, 0.0);
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return 1 == c ? reserved : unreserved;
+      };
+
+      Queue pq(client_info_f, false);
+      ReqParams req_params(1,1);
+      const Time t = dmc::get_time();
+      const int count = 100;
+
+      for (int i = 0; i < count; ++i) {
+	pq.add_request_time(Request{}, 1, req_params, t);
+	pq.add_request_time(Request{}, 2, req_params, t);
+      }
+
+      dmc::ClientState s;
+      EXPECT_FALSE(pq.get_client_state(1, s)) << "publishing is opt-in";
+      EXPECT_FALSE(bool(pq.get_client_state_ref(1)));
+
+      pq.set_client_state_publishing(true);
+      EXPECT_FALSE(pq.get_client_state(3, s));
+      ASSERT_TRUE(pq.get_client_state(1, s));
+      EXPECT_EQ(uint32_t(count), s.queue_depth);
+      EXPECT_FALSE(s.idle);
+      EXPECT_EQ(t, s.last_active);
+      EXPECT_EQ(t, s.reservation);
+      EXPECT_EQ(0u, s.reservation_count + s.priority_count);
+
+      // each published state is whole, so a concurrent reader always
+      // sees the dispatches and remaining depth add up
+      Queue::ClientStateRef ref = pq.get_client_state_ref(1);
+      ASSERT_TRUE(bool(ref));
+      EXPECT_EQ(ref, pq.get_client_state_ref(1)) << "the handle is stable";
+      std::atomic_bool done(false);
+      bool consistent = true;
+      std::thread poller([&] () {
+	  while (!done) {
+	    dmc::ClientState p = ref->load();
+	    if (p.queue_depth + p.reservation_count + p.priority_count !=
+		uint32_t(count)) {
+	      consistent = false;
+	    }
+	  }
+	});
+      for (int i = 0; i < 2 * count; ++i) {
+	ASSERT_TRUE(pq.pull_request(t).is_retn());
+      }
+      done = true;
+      poller.join();
+      EXPECT_TRUE(consistent);
+
+      s = ref->load();
+      EXPECT_EQ(0u, s.queue_depth);
+      EXPECT_EQ(t, s.last_active) << "the dispatch's own time";
+      EXPECT_EQ(dmc::max_tag, s.proportion);
+      EXPECT_EQ(1u, s.reservation_count) <<
+	"only the first request was due by reservation at t";
+      EXPECT_EQ(uint64_t(count - 1), s.priority_count);
+
+      ASSERT_TRUE(pq.get_client_state(2, s));
+      EXPECT_EQ(0u, s.reservation_count);
+      EXPECT_EQ(uint64_t(count), s.priority_count);
+    } // dmclock_server_pull.client_state
+
+
+    TEST(dmclock_server_pull, heavy_hitters) {
+      using ClientId = int;
+      struct CostRequest {
+	double cost;
+      };
+      using Queue = dmc::PullPriorityQueue<ClientId,CostRequest>;
+
+      dmc::ClientInfo info(0.0, 1.0, 0.0);
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return info;
+      };
+
+      Queue pq(client_info_f, false);
+      pq.set_request_cost_func([] (const CostRequest& r) -> double {
+	  return r.cost;
+	});
+      ReqParams req_params(1,1);
+      const Time t = dmc::get_time();
+
+      EXPECT_TRUE(pq.get_heavy_hitters(dmc::HitterMeasure::added, 2).empty())
+	<< "off by default";
+      pq.set_heavy_hitters(8);
+
+      // 50 light clients interleaved with a frequent one (7) and a
+      // less frequent but costlier one (9)
+      int added = 0;
+      for (int round = 0; round < 100; ++round) {
+	pq.add_request_time(CostRequest{1.0}, 7, req_params, t);
+	if (0 == round % 2) {
+	  pq.add_request_time(CostRequest{4.0}, 9, req_params, t);
+	  ++added;
+	}
+	pq.add_request_time(CostRequest{1.0}, 100 + round % 50, req_params, t);
+	added += 2;
+      }
+      for (int i = 0; i < added; ++i) {
+	ASSERT_TRUE(pq.pull_request(t).is_retn());
+      }
+
+      auto by_added = pq.get_heavy_hitters(dmc::HitterMeasure::added, 2);
+      ASSERT_EQ(2u, by_added.size());
+      EXPECT_EQ(7, by_added[0].item);
+      EXPECT_GE(by_added[0].count, 100.0);
+      EXPECT_EQ(9, by_added[1].item);
+
+      auto by_dispatched =
+	pq.get_heavy_hitters(dmc::HitterMeasure::dispatched, 2);
+      ASSERT_EQ(2u, by_dispatched.size());
+      EXPECT_EQ(7, by_dispatched[0].item);
+      EXPECT_EQ(9, by_dispatched[1].item);
+
+      auto by_cost = pq.get_heavy_hitters(dmc::HitterMeasure::cost, 2);
+      ASSERT_EQ(2u, by_cost.size());
+      EXPECT_EQ(9, by_cost[0].item);
+      EXPECT_GE(by_cost[0].count, 200.0);
+      EXPECT_EQ(7, by_cost[1].item);
+
+      pq.set_heavy_hitters(0);
+      EXPECT_TRUE(pq.get_heavy_hitters(dmc::HitterMeasure::cost, 2).empty());
+    } // dmclock_server_pull.heavy_hitters
+
+
+    // a client is within its limit only when within both its ops and
+    // bandwidth limits, so whichever is tighter for its request size
+    // applies
+    TEST(dmclock_server_pull, pull_bandwidth_limit) {
+      using ClientId = int;
+      struct SizedRequest {
+	uint64_t bytes;
+      };
+      using Queue = dmc::PullPriorityQueue<ClientId,SizedRequest>;
+
+      // 100 ops/sec and 1MB/sec
+      dmc::ClientInfo info(0.0, 1.0, 100.0,
+			   dmc::BandwidthInfo(0.0, 1000000.0));
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return info;
+      };
+
+      Queue pq(client_info_f, false);
+      pq.set_request_bytes_func([] (const SizedRequest& r) -> uint64_t {
+	  return r.bytes;
+	});
+      ReqParams req_params(1,1);
+
+      // client 1's 100KB requests are held to 10/sec by bandwidth and
+      // client 2's 1KB requests to 100/sec by ops
+      const Time start = dmc::get_time();
+      std::map<ClientId,int> counts;
+      for (int step = 0; step < 100; ++step) {
+	const Time now = start + step * 0.01;
+	pq.add_request_time(SizedRequest{100000}, 1, req_params, now);
+	pq.add_request_time(SizedRequest{1000}, 2, req_params, now);
+	pq.add_request_time(SizedRequest{1000}, 2, req_params, now);
+	for (int i = 0; i < 4; ++i) {
+	  Queue::PullReq pr = pq.pull_request(now);
+	  if (!pr.is_retn()) break;
+	  ++counts[pr.get_retn().client];
+	}
+      }
+
+      EXPECT_NEAR(10, counts[1], 1);
+      EXPECT_NEAR(100, counts[2], 1);
+    } // dmclock_server_pull.pull_bandwidth_limit
+
+
+    // a client is owed its reservation while behind in either ops or
+    // bandwidth
+    TEST(dmclock_server_pull, pull_bandwidth_reservation) {
+      using ClientId = int;
+      struct SizedRequest {
+	uint64_t bytes;
+      };
+      using Queue = dmc::PullPriorityQueue<ClientId,SizedRequest>;
+
+      // client 1 has 5 ops/sec and 1MB/sec reserved and client 2,
+      // competing by weight alone, keeps the server otherwise busy
+      dmc::ClientInfo info1(5.0, 0.0, 0.0,
+			    dmc::BandwidthInfo(1000000.0, 0.0));
+      dmc::ClientInfo info2(0.0, 1.0, 0.0);
+      auto client_info_f = [&] (ClientId c) -> dmc::ClientInfo {
+	return 1 == c ? info1 : info2;
+      };
+
+      auto run = [&] (uint64_t bytes) -> int {
+	Queue pq(client_info_f, false);
+	pq.set_request_bytes_func([] (const SizedRequest& r) -> uint64_t {
+	    return r.bytes;
+	  });
+	ReqParams req_params(1,1);
+
+	const Time start = dmc::get_time();
+	int resv = 0;
+	for (int step = 0; step < 100; ++step) {
+	  const Time now = start + step * 0.01;
+	  pq.add_request_time(SizedRequest{bytes}, 1, req_params, now);
+	  pq.add_request_time(SizedRequest{bytes}, 2, req_params, now);
+	  Queue::PullReq pr = pq.pull_request(now);
+	  EXPECT_TRUE(pr.is_retn());
+	  if (pr.is_retn() && 1 == pr.get_retn().client) {
+	    EXPECT_EQ(PhaseType::reservation, pr.get_retn().phase);
+	    ++resv;
+	  }
+	}
+	return resv;
+      };
+
+      EXPECT_NEAR(20, run(50000), 1) << "bandwidth is further behind";
+      EXPECT_NEAR(5, run(1000000), 1) << "ops are further behind";
+    } // dmclock_server_pull.pull_bandwidth_reservation
+
+
     // This test shows what happens when a request can be ready (under
     // limit) but not schedulable since proportion tag is 0. We expect
     // to get some future and none responses.
@@ -0,0 +1,150 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#include <memory>
+#include <vector>
+
+#include "dmclock_shard_queue.h"
+#include "dmclock_util.h"
+#include "gtest/gtest.h"
+
+
+namespace dmc = crimson::dmclock;
+
+
+namespace {
+  struct Request {
+    int seq;
+  };
+
+  using ClientId = int;
+}
+
+
+namespace crimson {
+  namespace dmclock {
+
+    TEST(dmclock_shard_queue, tracker_params) {
+      ShardTracker<ClientId> tracker(3);
+
+      EXPECT_EQ(1u, tracker.get_req_params(5, 0).delta);
+
+      // shard 1 and 2 dispatch three of the client's requests, one
+      // via reservation
+      tracker.track_dispatch(5, 1, PhaseType::reservation);
+      tracker.track_dispatch(5, 2, PhaseType::priority);
+      tracker.track_dispatch(5, 2, PhaseType::priority);
+
+      ReqParams p = tracker.get_req_params(5, 0);
+      EXPECT_EQ(4u, p.delta);
+      EXPECT_EQ(2u, p.rho);
+
+      // shard 0's own dispatches don't count toward its delta
+      tracker.track_dispatch(5, 0, PhaseType::reservation);
+      p = tracker.get_req_params(5, 0);
+      EXPECT_EQ(1u, p.delta);
+      EXPECT_EQ(1u, p.rho);
+
+      // other clients are independent
+      EXPECT_EQ(1u, tracker.get_req_params(6, 1).delta);
+      p = tracker.get_req_params(5, 1);
+      EXPECT_EQ(4u, p.delta) << "two by shard 2, one by shard 0";
+      EXPECT_EQ(2u, p.rho);
+    } // TEST
+
+
+    // a reservation-only client submitting round robin to two shards
+    // gets its reservation once across them, not once per shard
+    TEST(dmclock_shard_queue, reservation_across_shards) {
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	return dmc::ClientInfo(10.0, 0.0, 0.0);
+      };
+
+      auto run = [] (std::function<void(int,size_t,Time)> add,
+		     std::function<bool(size_t,Time)> pull) -> int {
+	const Time start = get_time();
+	int dispatched = 0;
+	int outstanding = 0;
+	int seq = 0;
+	// the client keeps four requests outstanding; two seconds
+	// in 10ms steps
+	for (int i = 0; i < 200; ++i) {
+	  const Time now = start + i * 0.01;
+	  for (; outstanding < 4; ++outstanding, ++seq) {
+	    add(seq, seq % 2, now);
+	  }
+	  for (size_t s = 0; s < 2; ++s) {
+	    while (pull(s, now)) {
+	      ++dispatched;
+	      --outstanding;
+	    }
+	  }
+	}
+	return dispatched;
+      };
+
+      ShardedPullQueue<ClientId,Request> sharded(2, client_info_f);
+      int coordinated = run(
+	[&] (int i, size_t s, Time t) {
+	  sharded.add_request_time(Request{i}, 1, s, t);
+	},
+	[&] (size_t s, Time t) -> bool {
+	  auto pr = sharded.pull_request(s, t);
+	  return pr.is_retn();
+	});
+
+      // the same shards without the tracker
+      std::vector<std::unique_ptr<PullPriorityQueue<ClientId,Request>>> alone;
+      for (int s = 0; s < 2; ++s) {
+	alone.emplace_back(
+	  new PullPriorityQueue<ClientId,Request>(client_info_f, false));
+      }
+      int uncoordinated = run(
+	[&] (int i, size_t s, Time t) {
+	  alone[s]->add_request_time(Request{i}, 1, ReqParams(), t);
+	},
+	[&] (size_t s, Time t) -> bool {
+	  return alone[s]->pull_request(t).is_retn();
+	});
+
+      EXPECT_NEAR(20, coordinated, 3);
+      EXPECT_NEAR(40, uncoordinated, 3);
+    } // TEST
+
+
+    TEST(dmclock_shard_queue, weight_across_shards) {
+      // client 1 is spread over both shards, client 2 uses only
+      // shard 0; with equal weights they should get equal service
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+
+      ShardedPullQueue<ClientId,Request> sharded(2, client_info_f);
+
+      const Time start = get_time();
+      int counts[3] = {0, 0, 0};
+      for (int i = 0; i < 400; ++i) {
+	const Time now = start + i * 0.001;
+	sharded.add_request_time(Request{i}, 1, i % 2, now);
+	sharded.add_request_time(Request{i}, 2, 0, now);
+	// each shard serves one request per step
+	for (size_t s = 0; s < 2; ++s) {
+	  auto pr = sharded.pull_request(s, now);
+	  if (pr.is_retn()) {
+	    ++counts[pr.get_retn().client];
+	  }
+	}
+      }
+
+      // shard 1 serves only client 1, so shard 0 should favor client
+      // 2 rather than split its service evenly (200 each)
+      EXPECT_GT(counts[2], 250);
+      EXPECT_LT(counts[1] - 200, 150) << "client 1's share of shard 0";
+    } // TEST
+
+  } // namespace dmclock
+} // namespace crimson
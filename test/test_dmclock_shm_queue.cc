@@ -0,0 +1,246 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <chrono>
+#include <string>
+#include <map>
+#include <set>
+#include <vector>
+#include <thread>
+
+#include "dmclock_shm_queue.h"
+#include "dmclock_util.h"
+#include "gtest/gtest.h"
+
+
+namespace dmc = crimson::dmclock;
+
+
+namespace {
+  // a descriptor; the payload would live in a shared buffer
+  struct IoDesc {
+    uint64_t offset;
+    uint32_t length;
+  };
+
+  using ClientId = int;
+  using Queue = dmc::SharedPullQueue<ClientId,IoDesc>;
+  using Submitter = dmc::ShmSubmitter<ClientId,IoDesc>;
+
+  std::string ring_name(const char* test) {
+    return std::string("/dmclock-test-") + test + "-" +
+      std::to_string(getpid());
+  }
+
+  // runs f in a child process, which exits with f's result
+  template<typename F>
+  pid_t spawn(F f) {
+    pid_t pid = fork();
+    if (0 == pid) {
+      _exit(f() ? 0 : 1);
+    }
+    return pid;
+  }
+
+  bool child_ok(pid_t pid) {
+    int status;
+    return pid == waitpid(pid, &status, 0) &&
+      WIFEXITED(status) && 0 == WEXITSTATUS(status);
+  }
+}
+
+
+namespace crimson {
+  namespace dmclock {
+
+    TEST(dmclock_shm_queue, across_processes) {
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	// client 2 has twice client 1's weight
+	return dmc::ClientInfo(0.0, double(c), 0.0);
+      };
+
+      const std::string name = ring_name("across");
+      Queue pq(name, 256, client_info_f);
+      EXPECT_EQ(256u, pq.ring_capacity());
+
+      // each front-end process submits for both clients
+      Time t = get_time();
+      pid_t producers[2];
+      for (int p = 0; p < 2; ++p) {
+	producers[p] = spawn([&name, p, t] () -> bool {
+	    Submitter s(name);
+	    for (int i = 0; i < 50; ++i) {
+	      IoDesc d{uint64_t(p * 1000 + i), 4096};
+	      if (!s.add_request_time(d, 1, ReqParams(), t) ||
+		  !s.add_request_time(d, 2, ReqParams(), t)) {
+		return false;
+	      }
+	    }
+	    return true;
+	  });
+      }
+      for (pid_t pid : producers) {
+	ASSERT_TRUE(child_ok(pid));
+      }
+
+      EXPECT_EQ(200u, pq.drain());
+      EXPECT_EQ(200u, pq.request_count());
+      EXPECT_EQ(2u, pq.client_count()) << "one record per client";
+
+      // fairness holds across both processes' submissions
+      std::map<ClientId,int> counts;
+      for (int i = 0; i < 90; ++i) {
+	Queue::PullReq pr = pq.pull_request(t);
+	ASSERT_TRUE(pr.is_retn());
+	EXPECT_EQ(4096u, pr.get_retn().request->length);
+	++counts[pr.get_retn().client];
+      }
+      EXPECT_NEAR(30, counts[1], 1);
+      EXPECT_NEAR(60, counts[2], 1);
+    } // TEST
+
+
+    TEST(dmclock_shm_queue, ring_full) {
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+
+      const std::string name = ring_name("full");
+      Queue pq(name, 3, client_info_f);
+      EXPECT_EQ(4u, pq.ring_capacity()) << "rounded to a power of two";
+
+      Submitter s(name);
+      for (int i = 0; i < 4; ++i) {
+	EXPECT_TRUE(s.add_request(IoDesc{uint64_t(i), 512}, 1, ReqParams()));
+      }
+      EXPECT_FALSE(s.add_request(IoDesc{4, 512}, 1, ReqParams()));
+      EXPECT_EQ(1u, s.get_full_count());
+      EXPECT_EQ(1u, pq.get_ring_full_count());
+
+      // pulling frees the ring's slots
+      Queue::PullReq pr = pq.pull_request();
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_EQ(0u, pr.get_retn().request->offset);
+      EXPECT_TRUE(s.add_request(IoDesc{4, 512}, 1, ReqParams()));
+      EXPECT_EQ(1u, pq.drain());
+      EXPECT_EQ(4u, pq.request_count());
+    } // TEST
+
+
+    TEST(dmclock_shm_queue, wait_pull) {
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+
+      const std::string name = ring_name("wait");
+      Queue pq(name, 16, client_info_f);
+
+      Queue::PullReq pr = pq.wait_pull(std::chrono::milliseconds(20));
+      EXPECT_TRUE(pr.is_none()) << "times out with nothing submitted";
+
+      pid_t pid = spawn([&name] () -> bool {
+	  Submitter s(name);
+	  usleep(50000);
+	  return s.add_request(IoDesc{7, 512}, 3, ReqParams());
+	});
+
+      auto start = std::chrono::steady_clock::now();
+      pr = pq.wait_pull(std::chrono::seconds(10));
+      auto waited = std::chrono::steady_clock::now() - start;
+      ASSERT_TRUE(pr.is_retn()) << "woken by the other process";
+      EXPECT_EQ(7u, pr.get_retn().request->offset);
+      EXPECT_EQ(3, pr.get_retn().client);
+      EXPECT_LT(waited, std::chrono::seconds(5));
+      EXPECT_TRUE(child_ok(pid));
+    } // TEST
+
+
+    TEST(dmclock_shm_queue, pooled_requests) {
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+
+      const std::string name = ring_name("pooled");
+      Queue pq(name, 16, client_info_f);
+      Submitter s(name);
+
+      // requests freed on another thread are reused here, and freeing
+      // and reusing them never disturbs the ones still held
+      std::set<const void*> addrs;
+      std::vector<std::unique_ptr<Queue::Request>> held;
+      for (uint64_t i = 0; i < 1000; ++i) {
+	ASSERT_TRUE(s.add_request(IoDesc{i, 512}, 1, ReqParams()));
+	Queue::PullReq pr = pq.pull_request();
+	ASSERT_TRUE(pr.is_retn());
+	ASSERT_EQ(i, pr.get_retn().request->offset);
+	addrs.insert(pr.get_retn().request.get());
+	held.push_back(std::move(pr.get_retn().request));
+	if (8 == held.size()) {
+	  std::thread([&held] () { held.clear(); }).join();
+	}
+	for (size_t j = 0; j < held.size(); ++j) {
+	  EXPECT_EQ(i - held.size() + 1 + j, held[j]->offset);
+	}
+      }
+      EXPECT_GT(500u, addrs.size()) << "storage is recycled";
+    } // TEST
+
+
+    TEST(dmclock_shm_queue, type_mismatch) {
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+
+      const std::string name = ring_name("mismatch");
+      Queue pq(name, 16, client_info_f);
+
+      using OtherSubmitter = dmc::ShmSubmitter<ClientId,uint64_t>;
+      EXPECT_THROW(OtherSubmitter s(name), std::runtime_error);
+      EXPECT_THROW(Submitter s(name + "-none"), std::system_error);
+    } // TEST
+
+
+    TEST(dmclock_shm_queue, existing_segment) {
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+
+      const std::string name = ring_name("existing");
+      {
+	Queue pq(name, 16, client_info_f);
+	try {
+	  Queue other(name, 16, client_info_f);
+	  ADD_FAILURE() << "a live ring was replaced";
+	} catch (const std::system_error& e) {
+	  EXPECT_EQ(EEXIST, e.code().value());
+	}
+
+	// the first ring is untouched
+	Submitter s(name);
+	EXPECT_TRUE(s.add_request(IoDesc{1, 512}, 1, ReqParams()));
+	EXPECT_EQ(1u, pq.drain());
+      }
+
+      // a stale segment, as a crashed dispatcher would leave
+      int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+      ASSERT_LE(0, fd);
+      close(fd);
+      EXPECT_THROW(Queue(name, 16, client_info_f), std::system_error);
+
+      Queue pq(name, 16, client_info_f, false, true);
+      Submitter s(name);
+      EXPECT_TRUE(s.add_request(IoDesc{2, 512}, 1, ReqParams()));
+      Queue::PullReq pr = pq.pull_request();
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_EQ(2u, pr.get_retn().request->offset);
+    } // TEST
+
+  } // namespace dmclock
+} // namespace crimson
@@ -0,0 +1,233 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2017 Red Hat Inc.
+ */
+
+
+#include <memory>
+#include <map>
+#include <chrono>
+#include <thread>
+
+#include "dmclock_tenant_queue.h"
+#include "dmclock_util.h"
+#include "gtest/gtest.h"
+
+
+namespace dmc = crimson::dmclock;
+
+
+namespace {
+  struct Request {
+    int seq;
+  };
+
+  using TenantId = int;
+  using ClientId = int;
+  using Queue = dmc::PullTenantQueue<TenantId,ClientId,Request>;
+}
+
+
+namespace crimson {
+  namespace dmclock {
+
+    // tenant 1 has five clients and tenant 2 one; with equal tenant
+    // weights the tenants, not the clients, share service equally
+    TEST(dmclock_tenant_queue, tenant_weight) {
+      auto tenant_info_f = [] (TenantId t) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+
+      Queue pq(tenant_info_f, client_info_f);
+      ReqParams req_params(1,1);
+      const Time t = get_time();
+
+      for (int i = 0; i < 100; ++i) {
+	for (ClientId c = 10; c < 15; ++c) {
+	  pq.add_request_time(Request{i}, 1, c, req_params, t);
+	}
+	pq.add_request_time(Request{i}, 2, 20, req_params, t);
+      }
+      EXPECT_EQ(2u, pq.tenant_count());
+      EXPECT_EQ(600u, pq.request_count());
+
+      std::map<TenantId,int> tenants;
+      std::map<ClientId,int> clients;
+      for (int i = 0; i < 200; ++i) {
+	Queue::PullReq pr = pq.pull_request(t);
+	ASSERT_TRUE(pr.is_retn());
+	++tenants[pr.get_retn().tenant];
+	++clients[pr.get_retn().client];
+      }
+
+      EXPECT_EQ(100, tenants[1]);
+      EXPECT_EQ(100, tenants[2]);
+      for (ClientId c = 10; c < 15; ++c) {
+	EXPECT_EQ(20, clients[c]) << "clients within a tenant by weight";
+      }
+    } // TEST
+
+
+    // tenant 1's reservation is met ahead of tenant 2's greater
+    // weight, and tenant 2's limit caps it
+    TEST(dmclock_tenant_queue, tenant_reservation_limit) {
+      auto tenant_info_f = [] (TenantId t) -> dmc::ClientInfo {
+	if (1 == t) return dmc::ClientInfo(50.0, 1.0, 0.0);
+	return dmc::ClientInfo(0.0, 10.0, 100.0);
+      };
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+
+      Queue pq(tenant_info_f, client_info_f);
+      ReqParams req_params(1,1);
+      const Time start = get_time();
+
+      std::map<TenantId,int> counts;
+      int seq = 0;
+      // one second in 10ms steps, serving up to 3 requests a step
+      for (int step = 0; step < 100; ++step) {
+	const Time now = start + step * 0.01;
+	for (int i = 0; i < 3; ++i, ++seq) {
+	  pq.add_request_time(Request{seq}, 1, 10 + seq % 4, req_params, now);
+	  pq.add_request_time(Request{seq}, 2, 20 + seq % 4, req_params, now);
+	}
+	for (int i = 0; i < 3; ++i) {
+	  Queue::PullReq pr = pq.pull_request(now);
+	  if (!pr.is_retn()) break;
+	  ++counts[pr.get_retn().tenant];
+	}
+      }
+
+      EXPECT_NEAR(100, counts[2], 3) << "limited to 100/s";
+      EXPECT_NEAR(200, counts[1], 3) << "the rest, above its reservation";
+    } // TEST
+
+
+    // a tenant whose only client is at its limit is set aside without
+    // holding up the other tenant, and the queue reports when it is due
+    TEST(dmclock_tenant_queue, client_limit_sets_tenant_aside) {
+      auto tenant_info_f = [] (TenantId t) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	if (10 == c) return dmc::ClientInfo(0.0, 1.0, 10.0);
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+
+      Queue pq(tenant_info_f, client_info_f);
+      ReqParams req_params(1,1);
+      const Time t = get_time();
+
+      for (int i = 0; i < 5; ++i) {
+	pq.add_request_time(Request{i}, 1, 10, req_params, t);
+      }
+      for (int i = 0; i < 5; ++i) {
+	pq.add_request_time(Request{i}, 2, 20, req_params, t);
+      }
+
+      std::map<TenantId,int> counts;
+      for (int i = 0; i < 6; ++i) {
+	Queue::PullReq pr = pq.pull_request(t);
+	ASSERT_TRUE(pr.is_retn());
+	++counts[pr.get_retn().tenant];
+      }
+      EXPECT_EQ(1, counts[1]) << "client 10 is then at its limit";
+      EXPECT_EQ(5, counts[2]);
+
+      Queue::PullReq pr = pq.pull_request(t);
+      ASSERT_TRUE(pr.is_future());
+      EXPECT_NEAR(t + 0.1, pr.getTime(), 0.001);
+
+      pr = pq.pull_request(t + 0.1);
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_EQ(10, pr.get_retn().client);
+
+      // a request from an unlimited client of the tenant is served
+      // at once
+      pq.add_request_time(Request{9}, 1, 11, req_params, t + 0.1);
+      pr = pq.pull_request(t + 0.1);
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_EQ(11, pr.get_retn().client);
+    } // TEST
+
+
+    TEST(dmclock_tenant_queue, tenant_limit_break) {
+      auto tenant_info_f = [] (TenantId t) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 10.0);
+      };
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+
+      Queue strict(tenant_info_f, client_info_f, false);
+      Queue breaking(tenant_info_f, client_info_f, true);
+      ReqParams req_params(1,1);
+      const Time t = get_time();
+
+      for (int i = 0; i < 10; ++i) {
+	strict.add_request_time(Request{i}, 1, 10, req_params, t);
+	breaking.add_request_time(Request{i}, 1, 10, req_params, t);
+      }
+
+      int strict_count = 0;
+      int breaking_count = 0;
+      for (int i = 0; i < 10; ++i) {
+	if (strict.pull_request(t).is_retn()) ++strict_count;
+	if (breaking.pull_request(t).is_retn()) ++breaking_count;
+      }
+      EXPECT_EQ(1, strict_count);
+      EXPECT_EQ(10, breaking_count);
+      EXPECT_TRUE(breaking.empty());
+    } // TEST
+
+
+    // queues sharing an executor start no threads, and a tenant with
+    // no requests is erased, with its client queue, after erase_age
+    TEST(dmclock_tenant_queue, shared_executor_erases_idle_tenants) {
+      auto tenant_info_f = [] (TenantId t) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+      auto client_info_f = [] (ClientId c) -> dmc::ClientInfo {
+	return dmc::ClientInfo(0.0, 1.0, 0.0);
+      };
+
+      TimerExecutor executor;
+      Queue pq1(tenant_info_f, client_info_f, executor,
+		std::chrono::milliseconds(200),
+		std::chrono::milliseconds(400),
+		std::chrono::milliseconds(100));
+      Queue pq2(tenant_info_f, client_info_f, executor);
+      EXPECT_EQ(2u, executor.job_count()) << "one cleaning job each";
+
+      ReqParams req_params(1,1);
+      pq1.add_request(Request{0}, 1, 10, req_params);
+      pq1.add_request(Request{1}, 2, 20, req_params);
+      EXPECT_EQ(2u, pq1.tenant_count());
+      EXPECT_EQ(4u, executor.job_count()) << "and one per tenant queue";
+      for (int i = 0; i < 2; ++i) {
+	ASSERT_TRUE(pq1.pull_request().is_retn());
+      }
+
+      // tenant 2 stays in use while tenant 1 sits idle
+      for (int i = 0; i < 20; ++i) {
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	pq1.add_request(Request{i}, 2, 20, req_params);
+	ASSERT_TRUE(pq1.pull_request().is_retn());
+      }
+      EXPECT_EQ(1u, pq1.tenant_count()) << "only the tenant in use";
+      EXPECT_EQ(3u, executor.job_count());
+
+      pq1.add_request(Request{2}, 1, 10, req_params);
+      EXPECT_EQ(2u, pq1.tenant_count()) << "an erased tenant comes back";
+      Queue::PullReq pr = pq1.pull_request();
+      ASSERT_TRUE(pr.is_retn());
+      EXPECT_EQ(1, pr.get_retn().tenant);
+    } // TEST
+
+  } // namespace dmclock
+} // namespace crimson